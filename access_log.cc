@@ -0,0 +1,183 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "access_log.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::string_view;
+
+namespace {
+
+// Returns the next space separated token of text, advancing *pos past
+// it.  Returns an empty view at the end of the text.
+string_view NextToken(string_view text, size_t* pos) {
+  while (*pos < text.size() && text[*pos] == ' ') (*pos)++;
+  size_t start = *pos;
+  while (*pos < text.size() && text[*pos] != ' ') (*pos)++;
+  return text.substr(start, *pos - start);
+}
+
+// Returns the contents of the next double quoted string of text,
+// advancing *pos past its closing quote.  Backslash escapes are skipped
+// over but left in the result.
+bool NextQuoted(string_view text, size_t* pos, string_view* result) {
+  size_t start = text.find('"', *pos);
+  if (start == string_view::npos) return false;
+  size_t end = start + 1;
+  while (end < text.size() && text[end] != '"') {
+    end += text[end] == '\\' ? 2 : 1;
+  }
+  if (end >= text.size()) return false;
+  *result = text.substr(start + 1, end - start - 1);
+  *pos = end + 1;
+  return true;
+}
+
+}  // namespace
+
+
+bool LogHttpRequest::Parse(string_view line) {
+  if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+  if (line.find('\t') == string_view::npos) return ParseCombined(line);
+
+  string_view* fields[] = {&path_, &referrer_, &host_, &user_agent_};
+  size_t start = 0;
+  for (int i = 0; i < 4; i++) {
+    size_t end = i == 3 ? line.size() : line.find('\t', start);
+    if (end == string_view::npos) return false;
+    *fields[i] = line.substr(start, end - start);
+    start = end + 1;
+  }
+  return true;
+}
+
+
+// host ident user [time] "METHOD path PROTOCOL" status bytes "referrer"
+// "user agent"
+bool LogHttpRequest::ParseCombined(string_view line) {
+  size_t pos = 0;
+  host_ = NextToken(line, &pos);
+  if (host_.empty()) return false;
+
+  string_view request_line;
+  if (!NextQuoted(line, &pos, &request_line)) return false;
+  size_t request_pos = 0;
+  NextToken(request_line, &request_pos);
+  path_ = NextToken(request_line, &request_pos);
+  if (path_.empty()) return false;
+
+  if (!NextQuoted(line, &pos, &referrer_)) return false;
+  if (referrer_ == "-") referrer_ = string_view();
+  if (!NextQuoted(line, &pos, &user_agent_)) return false;
+  return true;
+}
+
+
+AccessLogReader::AccessLogReader()
+    : data_(NULL), size_(0), position_(0), end_(0), released_(0), skipped_(0) {}
+
+
+AccessLogReader::~AccessLogReader() {
+  if (data_ != NULL) munmap(const_cast<char*>(data_), size_);
+}
+
+
+bool AccessLogReader::Open(const string& name) {
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (size_ == 0) {
+    close(fd);
+    return true;
+  }
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  madvise(data, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(data);
+  end_ = size_;
+  return true;
+}
+
+
+void AccessLogReader::Restrict(int part, int parts) {
+  position_ = LineStart(size_ * part / parts);
+  end_ = LineStart(size_ * (part + 1) / parts);
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  released_ = position_ - position_ % page_size;
+}
+
+
+size_t AccessLogReader::LineStart(size_t offset) const {
+  if (offset == 0) return 0;
+  if (offset >= size_) return size_;
+  // A line starts at offset if the byte before it ends a line.
+  const void* newline = memchr(data_ + offset - 1, '\n', size_ - offset + 1);
+  if (newline == NULL) return size_;
+  return static_cast<const char*>(newline) - data_ + 1;
+}
+
+
+bool AccessLogReader::Next(LogHttpRequest* request) {
+  string_view log(data_, size_);
+  while (position_ < end_) {
+    size_t end = log.find('\n', position_);
+    if (end == string_view::npos) end = size_;
+    string_view line = log.substr(position_, end - position_);
+    position_ = end + 1;
+    if (line.empty() || line == "\r") continue;
+    if (request->Parse(line)) return true;
+    skipped_++;
+  }
+  return false;
+}
+
+
+void AccessLogReader::Release() {
+  // Keep the page holding the next line.
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t end = position_ < size_ ? position_ : size_;
+  end -= end % page_size;
+  if (end < released_ + kReleaseInterval) return;
+  madvise(const_cast<char*>(data_) + released_, end - released_,
+          MADV_DONTNEED);
+  released_ = end;
+}
@@ -0,0 +1,121 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef ACCESS_LOG_H_
+#define ACCESS_LOG_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <string_view>
+
+#include "http_processor.h"
+
+/**
+ * A request parsed in place from a line of an access log.  The fields
+ * point into the log's mapping, so they stay valid for as long as the
+ * AccessLogReader that produced them is open.
+ */
+class LogHttpRequest : public HttpRequest {
+ public:
+  virtual std::string_view Path() { return path_; }
+  virtual std::string_view Referrer() { return referrer_; }
+  virtual std::string_view Host() { return host_; }
+  virtual std::string_view UserAgent() { return user_agent_; }
+  virtual bool IsStorageStable() { return true; }
+
+  // Parses a log line, either four tab separated fields (path, referrer,
+  // host and user agent) or an entry in the combined log format, whose
+  // first field is taken as the host.  Returns false if the line is
+  // neither.
+  bool Parse(std::string_view line);
+
+ private:
+  bool ParseCombined(std::string_view line);
+
+  std::string_view path_;
+  std::string_view referrer_;
+  std::string_view host_;
+  std::string_view user_agent_;
+};
+
+
+/**
+ * Reads an access log through a read-only mapping of the whole file,
+ * one request at a time.  Pages that have been read are handed back to
+ * the kernel as the reader moves on, so the resident size stays flat
+ * no matter how large the log is.  Dropped pages are still part of the
+ * mapping; touching them again reads them back from the file.
+ *
+ * Logs may be appended to while they are read, since only the size seen
+ * by Open is mapped, but must not be truncated or rewritten in place
+ * (rotate them by renaming instead): the requests point into the
+ * mapping, and reading a page past the end of a truncated file kills
+ * the process with SIGBUS.
+ */
+class AccessLogReader {
+ public:
+  // Pages are released in chunks of at least this many bytes.
+  static const size_t kReleaseInterval = 16 << 20;
+
+  AccessLogReader();
+  ~AccessLogReader();
+
+  bool Open(const std::string& name);
+
+  // Limits the reader to the lines that start in the part-th of parts
+  // equal byte ranges of the log, so that parts readers of the same log
+  // together read every line exactly once.  Call this right after Open.
+  void Restrict(int part, int parts);
+
+  // Parses the next well-formed line into *request.  Returns false at
+  // the end of the log.
+  bool Next(LogHttpRequest* request);
+
+  // Releases the pages before the next line once there are enough of
+  // them.  Requests returned earlier stay valid but may fault their
+  // pages back in.  Call this after the requests have been processed.
+  void Release();
+
+  size_t size() const { return size_; }
+  size_t position() const { return position_; }
+  int skipped() const { return skipped_; }
+
+ private:
+  // Returns the offset of the first line that starts at or after offset.
+  size_t LineStart(size_t offset) const;
+
+  const char* data_;
+  size_t size_;
+  size_t position_;
+  // Where the lines of this reader end; see Restrict.
+  size_t end_;
+  size_t released_;
+  int skipped_;
+};
+
+#endif  // ACCESS_LOG_H_
@@ -0,0 +1,219 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "async_file.h"
+
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "code_cache.h"
+
+using std::string;
+
+namespace {
+
+// Reads a whole file.  Returns false if it cannot be read.
+bool ReadWholeFile(const string& path, string* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) return false;
+  char buffer[64 * 1024];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, count);
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+
+v8::Local<v8::Value> LoadError(v8::Isolate* isolate, const string& path) {
+  string message = "Error loading file '" + path + "'";
+  return v8::Exception::Error(
+      v8::String::NewFromUtf8(isolate, message.c_str()).ToLocalChecked());
+}
+
+}  // namespace
+
+
+// One readAsync or loadAsync call.  Created on the isolate thread, filled
+// in on a worker thread and settled and destroyed on the isolate thread
+// again, so the handles are only touched there.
+struct AsyncFileLoader::Request {
+  AsyncFileLoader* loader;
+  string path;
+  bool load;
+  v8::Global<v8::Context> context;
+  v8::Global<v8::Promise::Resolver> resolver;
+  bool ok;
+  string contents;
+};
+
+
+// Settles the promise of a request whose file has been read.
+class AsyncFileLoader::SettleTask : public v8::Task {
+ public:
+  explicit SettleTask(std::unique_ptr<Request> request)
+      : request_(std::move(request)) {}
+
+  void Run() override { request_->loader->Settle(request_.get()); }
+
+ private:
+  std::unique_ptr<Request> request_;
+};
+
+
+// Reads the file of a request on a worker thread, then hands the request
+// back to the isolate thread.
+class AsyncFileLoader::ReadTask : public v8::Task {
+ public:
+  explicit ReadTask(std::unique_ptr<Request> request)
+      : request_(std::move(request)) {}
+
+  void Run() override {
+    request_->ok = ReadWholeFile(request_->path, &request_->contents);
+    AsyncFileLoader* loader = request_->loader;
+    loader->platform_->GetForegroundTaskRunner(loader->isolate_)
+        ->PostTask(std::unique_ptr<v8::Task>(
+            new SettleTask(std::move(request_))));
+  }
+
+ private:
+  std::unique_ptr<Request> request_;
+};
+
+
+AsyncFileLoader::AsyncFileLoader(v8::Isolate* isolate, v8::Platform* platform,
+                                 CodeCache* code_cache)
+    : isolate_(isolate),
+      platform_(platform),
+      code_cache_(code_cache),
+      pending_(0) {}
+
+
+void AsyncFileLoader::Install(v8::Local<v8::ObjectTemplate> global) {
+  v8::Local<v8::External> data = v8::External::New(isolate_, this);
+  global->Set(v8::String::NewFromUtf8Literal(isolate_, "readAsync"),
+              v8::FunctionTemplate::New(isolate_, ReadAsync, data));
+  global->Set(v8::String::NewFromUtf8Literal(isolate_, "loadAsync"),
+              v8::FunctionTemplate::New(isolate_, LoadAsync, data));
+}
+
+
+void AsyncFileLoader::RunUntilIdle() {
+  while (pending_ > 0) {
+    v8::platform::PumpMessageLoop(
+        platform_, isolate_, v8::platform::MessageLoopBehavior::kWaitForWork);
+  }
+}
+
+
+void AsyncFileLoader::ReadAsync(
+    const v8::FunctionCallbackInfo<v8::Value>& args) {
+  static_cast<AsyncFileLoader*>(args.Data().As<v8::External>()->Value())
+      ->Start(args, false);
+}
+
+
+void AsyncFileLoader::LoadAsync(
+    const v8::FunctionCallbackInfo<v8::Value>& args) {
+  static_cast<AsyncFileLoader*>(args.Data().As<v8::External>()->Value())
+      ->Start(args, true);
+}
+
+
+void AsyncFileLoader::Start(const v8::FunctionCallbackInfo<v8::Value>& args,
+                            bool load) {
+  v8::Local<v8::Context> context = isolate_->GetCurrentContext();
+  if (args.Length() != 1) {
+    isolate_->ThrowException(v8::Exception::TypeError(
+        v8::String::NewFromUtf8Literal(isolate_, "Bad parameters")));
+    return;
+  }
+  v8::String::Utf8Value path(isolate_, args[0]);
+  if (*path == NULL) return;
+  v8::Local<v8::Promise::Resolver> resolver;
+  if (!v8::Promise::Resolver::New(context).ToLocal(&resolver)) return;
+
+  std::unique_ptr<Request> request(new Request());
+  request->loader = this;
+  request->path = *path;
+  request->load = load;
+  request->context.Reset(isolate_, context);
+  request->resolver.Reset(isolate_, resolver);
+  request->ok = false;
+  pending_++;
+  platform_->CallOnWorkerThread(
+      std::unique_ptr<v8::Task>(new ReadTask(std::move(request))));
+  args.GetReturnValue().Set(resolver->GetPromise());
+}
+
+
+void AsyncFileLoader::Settle(Request* request) {
+  v8::HandleScope handle_scope(isolate_);
+  v8::Local<v8::Context> context = request->context.Get(isolate_);
+  v8::Context::Scope context_scope(context);
+  v8::Local<v8::Promise::Resolver> resolver = request->resolver.Get(isolate_);
+  pending_--;
+
+  v8::TryCatch try_catch(isolate_);
+  v8::Local<v8::String> source;
+  if (!request->ok ||
+      request->contents.size() > static_cast<size_t>(v8::String::kMaxLength) ||
+      !v8::String::NewFromUtf8(isolate_, request->contents.data(),
+                               v8::NewStringType::kNormal,
+                               static_cast<int>(request->contents.size()))
+           .ToLocal(&source)) {
+    resolver->Reject(context, LoadError(isolate_, request->path)).Check();
+  } else if (!request->load) {
+    resolver->Resolve(context, source).Check();
+  } else {
+    v8::ScriptOrigin origin(
+        v8::String::NewFromUtf8(isolate_, request->path.c_str())
+            .ToLocalChecked());
+    bool produce_cache = false;
+    v8::MaybeLocal<v8::Script> maybe_script =
+        code_cache_ != NULL
+            ? code_cache_->Compile(context, source, &origin, &produce_cache)
+            : v8::Script::Compile(context, source, &origin);
+    v8::Local<v8::Script> script;
+    v8::Local<v8::Value> result;
+    if (maybe_script.ToLocal(&script) && script->Run(context).ToLocal(&result)) {
+      if (produce_cache) code_cache_->Produce(isolate_, script, source);
+      resolver->Resolve(context, result).Check();
+    } else if (try_catch.HasCaught() && !try_catch.HasTerminated()) {
+      v8::Local<v8::Value> exception = try_catch.Exception();
+      try_catch.Reset();
+      resolver->Reject(context, exception).Check();
+    }
+  }
+  // Nothing else drains the microtask queue here, outside of any script.
+  isolate_->PerformMicrotaskCheckpoint();
+}
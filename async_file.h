@@ -0,0 +1,86 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef ASYNC_FILE_H_
+#define ASYNC_FILE_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+class CodeCache;
+
+/**
+ * Gives scripts promise-based versions of the shell's 'read' and 'load':
+ *
+ *   readAsync(path)   // a promise of the contents of the file
+ *   loadAsync(path)   // a promise of the completion value of running it
+ *
+ * The files are read on the platform's worker threads, so reads of many
+ * files overlap with each other and with JavaScript.  Once a read is
+ * done, a task on the isolate's foreground task runner settles the
+ * promise, running the script first for loadAsync.
+ *
+ * All methods must be called on the thread running the isolate, and the
+ * loader must outlive the contexts it was installed in.
+ */
+class AsyncFileLoader {
+ public:
+  // Scripts run by loadAsync are compiled through the code cache, if
+  // one is given.
+  AsyncFileLoader(v8::Isolate* isolate, v8::Platform* platform,
+                  CodeCache* code_cache);
+  AsyncFileLoader(const AsyncFileLoader&) = delete;
+  AsyncFileLoader& operator=(const AsyncFileLoader&) = delete;
+
+  // Adds readAsync and loadAsync to a global object template.
+  void Install(v8::Local<v8::ObjectTemplate> global);
+
+  // Runs foreground tasks until every read that has been started has
+  // settled its promise.
+  void RunUntilIdle();
+
+  int pending() const { return pending_; }
+
+ private:
+  struct Request;
+  class ReadTask;
+  class SettleTask;
+
+  static void ReadAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void LoadAsync(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  void Start(const v8::FunctionCallbackInfo<v8::Value>& args, bool load);
+  void Settle(Request* request);
+
+  v8::Isolate* isolate_;
+  v8::Platform* platform_;
+  CodeCache* code_cache_;
+  // Reads started whose promise has not been settled yet.
+  int pending_;
+};
+
+#endif  // ASYNC_FILE_H_
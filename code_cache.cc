@@ -0,0 +1,241 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "code_cache.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+
+using std::string;
+
+namespace {
+
+const uint32_t kMagic = 0x43433856;  // "V8CC"
+
+// The header in front of the cached data in every cache file.
+struct Header {
+  uint32_t magic;
+  uint32_t version_tag;
+  uint64_t source_hash;
+  uint32_t source_length;
+  uint32_t data_length;
+};
+
+uint64_t Fnv1a(const char* data, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace
+
+
+CodeCache::CodeCache(const string& directory)
+    : directory_(directory),
+      hits_(0),
+      misses_(0),
+      rejects_(0),
+      writes_(0),
+      wasm_hits_(0),
+      wasm_misses_(0),
+      wasm_rejects_(0) {}
+
+
+CodeCache::Key CodeCache::MakeKey(v8::Isolate* isolate,
+                                  v8::Local<v8::String> source) const {
+  v8::String::Utf8Value utf8(isolate, source);
+  Key key;
+  key.hash = Fnv1a(*utf8, utf8.length());
+  key.length = static_cast<uint32_t>(utf8.length());
+  return key;
+}
+
+
+CodeCache::Key CodeCache::WasmKey(const uint8_t* wire_bytes, size_t size) {
+  Key key;
+  key.hash = Fnv1a(reinterpret_cast<const char*>(wire_bytes), size);
+  key.length = static_cast<uint32_t>(size);
+  return key;
+}
+
+
+string CodeCache::PathFor(const Key& key, const char* extension) const {
+  char name[48];
+  snprintf(name, sizeof(name), "/%016llx%s",
+           static_cast<unsigned long long>(key.hash), extension);
+  return directory_ + name;
+}
+
+
+bool CodeCache::Read(const Key& key, const char* extension, string* data,
+                     bool* stale) const {
+  *stale = false;
+  FILE* file = fopen(PathFor(key, extension).c_str(), "rb");
+  if (file == NULL) return false;
+
+  Header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != kMagic ||
+      header.version_tag != v8::ScriptCompiler::CachedDataVersionTag() ||
+      header.source_hash != key.hash || header.source_length != key.length) {
+    fclose(file);
+    *stale = true;
+    return true;
+  }
+  data->resize(header.data_length);
+  if (header.data_length == 0 ||
+      fread(&(*data)[0], 1, header.data_length, file) != header.data_length) {
+    *stale = true;
+  }
+  fclose(file);
+  return true;
+}
+
+
+bool CodeCache::Write(const Key& key, const char* extension,
+                      const uint8_t* data, size_t length) {
+  Header header;
+  header.magic = kMagic;
+  header.version_tag = v8::ScriptCompiler::CachedDataVersionTag();
+  header.source_hash = key.hash;
+  header.source_length = key.length;
+  header.data_length = static_cast<uint32_t>(length);
+
+  // Write to a private file and rename it into place, so concurrent
+  // writers and readers never see a partial entry.
+  string path = PathFor(key, extension);
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%d.%d", static_cast<int>(getpid()),
+           writes_++);
+  string temp_path = path + suffix;
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == NULL) return false;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(data, 1, length, file) == length;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+v8::MaybeLocal<v8::Script> CodeCache::Compile(v8::Local<v8::Context> context,
+                                              v8::Local<v8::String> source,
+                                              v8::ScriptOrigin* origin,
+                                              bool* produce) {
+  *produce = false;
+  if (source->Length() < kMinSourceLength) {
+    return v8::Script::Compile(context, source, origin);
+  }
+
+  Key key = MakeKey(context->GetIsolate(), source);
+  string data;
+  bool stale;
+  v8::ScriptCompiler::CachedData* cached_data = NULL;
+  if (!Read(key, ".jscache", &data, &stale)) {
+    misses_++;
+  } else if (stale) {
+    rejects_++;
+  } else {
+    // The source owns the cached data object but not the buffer, which
+    // stays alive in 'data' until we are done compiling.
+    cached_data = new v8::ScriptCompiler::CachedData(
+        reinterpret_cast<const uint8_t*>(data.data()),
+        static_cast<int>(data.size()));
+  }
+
+  std::unique_ptr<v8::ScriptCompiler::Source> script_source(
+      origin != NULL
+          ? new v8::ScriptCompiler::Source(source, *origin, cached_data)
+          : new v8::ScriptCompiler::Source(source, cached_data));
+  v8::ScriptCompiler::CompileOptions options =
+      cached_data != NULL ? v8::ScriptCompiler::kConsumeCodeCache
+                          : v8::ScriptCompiler::kNoCompileOptions;
+  v8::MaybeLocal<v8::Script> script =
+      v8::ScriptCompiler::Compile(context, script_source.get(), options);
+
+  if (cached_data != NULL) {
+    if (script_source->GetCachedData()->rejected) {
+      rejects_++;
+    } else {
+      hits_++;
+      return script;
+    }
+  }
+  *produce = true;
+  return script;
+}
+
+
+void CodeCache::Produce(v8::Isolate* isolate, v8::Local<v8::Script> script,
+                        v8::Local<v8::String> source) {
+  v8::ScriptCompiler::CachedData* cached_data =
+      v8::ScriptCompiler::CreateCodeCache(script->GetUnboundScript());
+  if (cached_data == NULL) return;
+  Write(MakeKey(isolate, source), ".jscache", cached_data->data,
+        static_cast<size_t>(cached_data->length));
+  delete cached_data;
+}
+
+
+bool CodeCache::ReadWasm(const Key& key, string* data) {
+  bool stale;
+  if (!Read(key, ".wasmcache", data, &stale)) {
+    wasm_misses_++;
+    return false;
+  }
+  if (stale) {
+    wasm_rejects_++;
+    return false;
+  }
+  wasm_hits_++;
+  return true;
+}
+
+
+void CodeCache::WriteWasm(const Key& key, const uint8_t* data,
+                          size_t length) {
+  Write(key, ".wasmcache", data, length);
+}
+
+
+void CodeCache::PrintStats(FILE* out) const {
+  fprintf(out, "Code cache: %d hits, %d misses, %d rejects\n", hits(),
+          misses(), rejects());
+  if (wasm_hits_ + wasm_misses_ + wasm_rejects_ > 0) {
+    fprintf(out, "Wasm cache: %d hits, %d misses, %d rejects\n",
+            wasm_hits_.load(), wasm_misses_.load(), wasm_rejects_.load());
+  }
+}
@@ -0,0 +1,124 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CODE_CACHE_H_
+#define CODE_CACHE_H_
+
+#include <include/v8.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+
+/**
+ * A persistent code cache for scripts, kept as one file per script in
+ * a cache directory.  Entries are keyed by a hash of the script source
+ * and tagged with V8's cached data version, so caches written by a
+ * different V8 build or with different flags are rejected and replaced
+ * instead of being handed to V8.
+ *
+ * It also keeps compiled WebAssembly modules, keyed by a hash of their
+ * wire bytes.
+ *
+ * A cache may be shared by several isolates on different threads.
+ */
+class CodeCache {
+ public:
+  struct Key {
+    uint64_t hash;
+    uint32_t length;
+  };
+
+  // Sources shorter than this are compiled directly; parsing them is
+  // cheaper than reading a cache file.
+  static const int kMinSourceLength = 1024;
+
+  explicit CodeCache(const std::string& directory);
+
+  // Compiles the source in the given context, consuming the cached code
+  // for it if there is a usable entry.  If there was none, *produce is
+  // set to true and the caller should call Produce once the script has
+  // run, so the functions it compiled lazily end up in the cache too.
+  v8::MaybeLocal<v8::Script> Compile(v8::Local<v8::Context> context,
+                                     v8::Local<v8::String> source,
+                                     v8::ScriptOrigin* origin, bool* produce);
+
+  // Writes the code cache of a script compiled by Compile.
+  void Produce(v8::Isolate* isolate, v8::Local<v8::Script> script,
+               v8::Local<v8::String> source);
+
+  // The key of a WebAssembly module with the given wire bytes.
+  static Key WasmKey(const uint8_t* wire_bytes, size_t size);
+
+  // Reads the serialized compiled module for a key.  Returns false if
+  // there is no usable entry.
+  bool ReadWasm(const Key& key, std::string* data);
+
+  // Writes the serialized compiled module for a key.
+  void WriteWasm(const Key& key, const uint8_t* data, size_t length);
+
+  // Counts an entry returned by ReadWasm that V8 refused to use.
+  void RejectWasm() {
+    wasm_hits_--;
+    wasm_rejects_++;
+  }
+
+  int hits() const { return hits_; }
+  int misses() const { return misses_; }
+  int rejects() const { return rejects_; }
+
+  // Prints the hit/miss/reject counts, for wasm modules too if there
+  // were any.
+  void PrintStats(FILE* out) const;
+
+ private:
+  Key MakeKey(v8::Isolate* isolate, v8::Local<v8::String> source) const;
+  // The extension tells scripts (".jscache") and wasm modules
+  // (".wasmcache") apart.
+  std::string PathFor(const Key& key, const char* extension) const;
+
+  // Reads the entry for a key.  Returns false if there is none; sets
+  // *stale if there is one that cannot be used.
+  bool Read(const Key& key, const char* extension, std::string* data,
+            bool* stale) const;
+  bool Write(const Key& key, const char* extension, const uint8_t* data,
+             size_t length);
+
+  std::string directory_;
+  std::atomic<int> hits_;
+  std::atomic<int> misses_;
+  std::atomic<int> rejects_;
+  std::atomic<int> writes_;
+  std::atomic<int> wasm_hits_;
+  std::atomic<int> wasm_misses_;
+  std::atomic<int> wasm_rejects_;
+};
+
+#endif  // CODE_CACHE_H_
@@ -0,0 +1,217 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "cpu_profile.h"
+
+#include <signal.h>
+#include <stdio.h>
+
+#include <atomic>
+
+using std::string;
+
+namespace {
+
+// Bumped by the signal handler; every profiler toggles when it sees the
+// count move.
+std::atomic<int> toggle_signals(0);
+
+// The number of profiles written by all profilers, used to name them.
+std::atomic<int> profiles_written(0);
+
+void OnToggleSignal(int signal) {
+  toggle_signals.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WriteJsonString(FILE* out, const char* value) {
+  fputc('"', out);
+  for (const char* p = value; *p != '\0'; p++) {
+    unsigned char c = static_cast<unsigned char>(*p);
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+      fputc(c, out);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+// Writes a node and, after it, all nodes below it.
+void WriteNodes(FILE* out, const v8::CpuProfileNode* node, bool* first) {
+  fprintf(out, "%s\n{\"id\":%u,\"callFrame\":{\"functionName\":",
+          *first ? "" : ",", node->GetNodeId());
+  *first = false;
+  WriteJsonString(out, node->GetFunctionNameStr());
+  fprintf(out, ",\"scriptId\":\"%d\",\"url\":", node->GetScriptId());
+  WriteJsonString(out, node->GetScriptResourceNameStr());
+  // V8 numbers lines and columns from 1, DevTools from 0.
+  int line = node->GetLineNumber();
+  int column = node->GetColumnNumber();
+  fprintf(out, ",\"lineNumber\":%d,\"columnNumber\":%d},\"hitCount\":%u",
+          line > 0 ? line - 1 : -1, column > 0 ? column - 1 : -1,
+          node->GetHitCount());
+  int child_count = node->GetChildrenCount();
+  if (child_count > 0) {
+    fprintf(out, ",\"children\":[");
+    for (int i = 0; i < child_count; i++) {
+      fprintf(out, "%s%u", i > 0 ? "," : "", node->GetChild(i)->GetNodeId());
+    }
+    fprintf(out, "]");
+  }
+  fprintf(out, "}");
+  for (int i = 0; i < child_count; i++)
+    WriteNodes(out, node->GetChild(i), first);
+}
+
+}  // namespace
+
+
+ScriptProfiler::ScriptProfiler(v8::Isolate* isolate,
+                               const CpuProfileOptions& options)
+    : isolate_(isolate),
+      options_(options),
+      profiler_(v8::CpuProfiler::New(isolate)),
+      running_(false),
+      requests_seen_(0),
+      requests_profiled_(0),
+      signals_seen_(toggle_signals.load(std::memory_order_relaxed)) {
+  if (options_.interval_us > 0)
+    profiler_->SetSamplingInterval(options_.interval_us);
+  if (!options_.wait_for_signal && options_.start_after == 0) Start();
+}
+
+
+ScriptProfiler::~ScriptProfiler() {
+  if (running_) Stop();
+  profiler_->Dispose();
+}
+
+
+void ScriptProfiler::InstallSignalHandler() {
+  struct sigaction action;
+  action.sa_handler = OnToggleSignal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGUSR2, &action, NULL);
+}
+
+
+void ScriptProfiler::OnRequestsDone(int count) {
+  requests_seen_ += count;
+  if (running_) requests_profiled_ += count;
+
+  int signals = toggle_signals.load(std::memory_order_relaxed);
+  if (signals != signals_seen_) {
+    // An even number of signals since we last looked cancel out.
+    bool toggle = ((signals - signals_seen_) & 1) != 0;
+    signals_seen_ = signals;
+    if (toggle) {
+      if (running_) {
+        Stop();
+      } else {
+        Start();
+      }
+      return;
+    }
+  }
+
+  if (running_) {
+    if (options_.requests > 0 && requests_profiled_ >= options_.requests)
+      Stop();
+  } else if (!options_.wait_for_signal && options_.start_after > 0 &&
+             requests_seen_ >= options_.start_after &&
+             requests_seen_ - count < options_.start_after) {
+    Start();
+  }
+}
+
+
+void ScriptProfiler::Start() {
+  v8::HandleScope scope(isolate_);
+  profiler_->StartProfiling(v8::String::Empty(isolate_), true);
+  running_ = true;
+  requests_profiled_ = 0;
+}
+
+
+void ScriptProfiler::Stop() {
+  v8::HandleScope scope(isolate_);
+  v8::CpuProfile* profile =
+      profiler_->StopProfiling(v8::String::Empty(isolate_));
+  running_ = false;
+  if (profile == NULL) return;
+  string name = NextFileName();
+  if (Write(profile, name)) {
+    fprintf(stderr, "CPU profile of %lld requests written to %s\n",
+            static_cast<long long>(requests_profiled_), name.c_str());
+  } else {
+    fprintf(stderr, "Error writing CPU profile %s\n", name.c_str());
+  }
+  profile->Delete();
+}
+
+
+string ScriptProfiler::NextFileName() {
+  int index = profiles_written.fetch_add(1);
+  if (index == 0) return options_.file;
+  size_t dot = options_.file.rfind('.');
+  size_t slash = options_.file.rfind('/');
+  if (dot == string::npos || (slash != string::npos && dot < slash))
+    dot = options_.file.size();
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), ".%d", index);
+  return options_.file.substr(0, dot) + suffix + options_.file.substr(dot);
+}
+
+
+bool ScriptProfiler::Write(const v8::CpuProfile* profile, const string& name) {
+  FILE* out = fopen(name.c_str(), "w");
+  if (out == NULL) return false;
+  fprintf(out, "{\"nodes\":[");
+  bool first = true;
+  WriteNodes(out, profile->GetTopDownRoot(), &first);
+  fprintf(out, "],\n\"startTime\":%lld,\"endTime\":%lld,\n\"samples\":[",
+          static_cast<long long>(profile->GetStartTime()),
+          static_cast<long long>(profile->GetEndTime()));
+  int sample_count = profile->GetSamplesCount();
+  for (int i = 0; i < sample_count; i++) {
+    fprintf(out, "%s%u", i > 0 ? "," : "", profile->GetSample(i)->GetNodeId());
+  }
+  fprintf(out, "],\n\"timeDeltas\":[");
+  int64_t last = profile->GetStartTime();
+  for (int i = 0; i < sample_count; i++) {
+    int64_t timestamp = profile->GetSampleTimestamp(i);
+    fprintf(out, "%s%lld", i > 0 ? "," : "",
+            static_cast<long long>(timestamp - last));
+    last = timestamp;
+  }
+  fprintf(out, "]}\n");
+  return fclose(out) == 0;
+}
@@ -0,0 +1,99 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CPU_PROFILE_H_
+#define CPU_PROFILE_H_
+
+#include <include/v8-profiler.h>
+#include <include/v8.h>
+
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * When and how to profile the script of a processor.
+ */
+struct CpuProfileOptions {
+  CpuProfileOptions()
+      : interval_us(0), start_after(0), wait_for_signal(false), requests(0) {}
+
+  // The file to write profiles to; profiling is off if this is empty.
+  // Later profiles get a number inserted before the extension.
+  std::string file;
+  // The sampling interval in microseconds, or 0 for V8's default.
+  int interval_us;
+  // The number of requests to skip before profiling starts.
+  int start_after;
+  // Whether to wait for a signal instead of starting on our own.
+  bool wait_for_signal;
+  // The number of requests to profile, or 0 for all of them.
+  int requests;
+};
+
+
+/**
+ * Profiles the JavaScript running in an isolate over a window of
+ * requests and writes the profiles in the .cpuprofile format Chrome
+ * DevTools opens.  Besides the window set in the options, SIGUSR2
+ * toggles profiling in every isolate that has a profiler, so a running
+ * process can be profiled for a while without restarting it.
+ *
+ * All methods must be called on the thread running the isolate.
+ */
+class ScriptProfiler {
+ public:
+  ScriptProfiler(v8::Isolate* isolate, const CpuProfileOptions& options);
+  // Writes the profile being collected, if any.
+  ~ScriptProfiler();
+
+  // Makes SIGUSR2 toggle profiling.
+  static void InstallSignalHandler();
+
+  // Starts or stops profiling as the window and signals ask; called
+  // whenever the processor has handled some requests.
+  void OnRequestsDone(int count);
+
+  bool running() const { return running_; }
+
+ private:
+  void Start();
+  void Stop();
+  bool Write(const v8::CpuProfile* profile, const std::string& name);
+  std::string NextFileName();
+
+  v8::Isolate* isolate_;
+  CpuProfileOptions options_;
+  v8::CpuProfiler* profiler_;
+  bool running_;
+  int64_t requests_seen_;
+  int64_t requests_profiled_;
+  // The number of signals acted upon.
+  int signals_seen_;
+};
+
+#endif  // CPU_PROFILE_H_
@@ -0,0 +1,227 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "heap_control.h"
+
+#include <include/v8-profiler.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using std::string;
+
+
+void SetHeapLimits(size_t max_young_mb, size_t max_old_mb,
+                   v8::Isolate::CreateParams* create_params) {
+  if (max_young_mb > 0) {
+    create_params->constraints.set_max_young_generation_size_in_bytes(
+        max_young_mb << 20);
+  }
+  if (max_old_mb > 0) {
+    create_params->constraints.set_max_old_generation_size_in_bytes(
+        max_old_mb << 20);
+  }
+}
+
+
+void PrintHeapStatistics(v8::Isolate* isolate, FILE* out) {
+  v8::HeapStatistics stats;
+  isolate->GetHeapStatistics(&stats);
+  fprintf(out,
+          "Heap: %zu used, %zu total, %zu limit, %zu external, "
+          "%zu malloced\n",
+          stats.used_heap_size(), stats.total_heap_size(),
+          stats.heap_size_limit(), stats.external_memory(),
+          stats.malloced_memory());
+  for (size_t i = 0; i < isolate->NumberOfHeapSpaces(); i++) {
+    v8::HeapSpaceStatistics space;
+    if (!isolate->GetHeapSpaceStatistics(&space, i)) continue;
+    fprintf(out, "  %-24s %zu used, %zu size, %zu available\n",
+            space.space_name(), space.space_used_size(), space.space_size(),
+            space.space_available_size());
+  }
+}
+
+
+namespace {
+
+class FileOutputStream : public v8::OutputStream {
+ public:
+  explicit FileOutputStream(FILE* file) : file_(file), ok_(true) {}
+  virtual void EndOfStream() {}
+  virtual WriteResult WriteAsciiChunk(char* data, int size) {
+    ok_ = fwrite(data, 1, size, file_) == static_cast<size_t>(size);
+    return ok_ ? kContinue : kAbort;
+  }
+  bool ok() const { return ok_; }
+
+ private:
+  FILE* file_;
+  bool ok_;
+};
+
+}  // namespace
+
+
+bool WriteHeapSnapshot(v8::Isolate* isolate, const string& name) {
+  FILE* file = fopen(name.c_str(), "w");
+  if (file == NULL) return false;
+  const v8::HeapSnapshot* snapshot =
+      isolate->GetHeapProfiler()->TakeHeapSnapshot();
+  FileOutputStream stream(file);
+  snapshot->Serialize(&stream, v8::HeapSnapshot::kJSON);
+  const_cast<v8::HeapSnapshot*>(snapshot)->Delete();
+  return fclose(file) == 0 && stream.ok();
+}
+
+
+MemoryPressureMonitor::MemoryPressureMonitor()
+    : inotify_fd_(-1), level_(v8::MemoryPressureLevel::kNone) {
+  wake_fds_[0] = wake_fds_[1] = -1;
+  counters_.high = counters_.max = counters_.oom = 0;
+}
+
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+  if (thread_.joinable()) {
+    char byte = 0;
+    if (write(wake_fds_[1], &byte, 1) < 0) perror("write");
+    thread_.join();
+  }
+  if (inotify_fd_ >= 0) close(inotify_fd_);
+  if (wake_fds_[0] >= 0) close(wake_fds_[0]);
+  if (wake_fds_[1] >= 0) close(wake_fds_[1]);
+}
+
+
+bool MemoryPressureMonitor::Start(const string& events_file) {
+  events_file_ = events_file;
+  if (!ReadCounters(&counters_)) return false;
+  inotify_fd_ = inotify_init1(IN_CLOEXEC);
+  if (inotify_fd_ < 0) return false;
+  // The kernel reports changes to memory.events as modifications.
+  if (inotify_add_watch(inotify_fd_, events_file.c_str(), IN_MODIFY) < 0)
+    return false;
+  if (pipe(wake_fds_) != 0) return false;
+  thread_ = std::thread(&MemoryPressureMonitor::Run, this);
+  return true;
+}
+
+
+void MemoryPressureMonitor::Add(v8::Isolate* isolate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  isolates_.push_back(isolate);
+}
+
+
+void MemoryPressureMonitor::Remove(v8::Isolate* isolate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  isolates_.erase(std::remove(isolates_.begin(), isolates_.end(), isolate),
+                  isolates_.end());
+}
+
+
+bool MemoryPressureMonitor::ReadCounters(Counters* counters) {
+  FILE* file = fopen(events_file_.c_str(), "r");
+  if (file == NULL) return false;
+  counters->high = counters->max = counters->oom = 0;
+  char key[32];
+  long long value;
+  while (fscanf(file, "%31s %lld", key, &value) == 2) {
+    if (strcmp(key, "high") == 0) {
+      counters->high = value;
+    } else if (strcmp(key, "max") == 0) {
+      counters->max = value;
+    } else if (strcmp(key, "oom") == 0 || strcmp(key, "oom_kill") == 0) {
+      counters->oom += value;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+
+void MemoryPressureMonitor::Run() {
+  struct pollfd fds[2];
+  fds[0].fd = inotify_fd_;
+  fds[0].events = POLLIN;
+  fds[1].fd = wake_fds_[0];
+  fds[1].events = POLLIN;
+  char buffer[4096];
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      // Anything else will not go away by itself.
+      fprintf(stderr, "Memory pressure monitor stopped: %s\n",
+              strerror(errno));
+      break;
+    }
+    if (fds[1].revents != 0) break;
+    if ((fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+      fprintf(stderr, "Memory pressure monitor stopped: inotify failed\n");
+      break;
+    }
+    if ((fds[0].revents & POLLIN) == 0) continue;
+    if (read(inotify_fd_, buffer, sizeof(buffer)) < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      fprintf(stderr, "Memory pressure monitor stopped: %s\n",
+              strerror(errno));
+      break;
+    }
+
+    Counters counters;
+    if (!ReadCounters(&counters)) continue;
+    v8::MemoryPressureLevel level = v8::MemoryPressureLevel::kNone;
+    if (counters.max > counters_.max || counters.oom > counters_.oom) {
+      level = v8::MemoryPressureLevel::kCritical;
+    } else if (counters.high > counters_.high) {
+      level = v8::MemoryPressureLevel::kModerate;
+    }
+    counters_ = counters;
+    // Pressure is passed on every time the cgroup hits a boundary again,
+    // but lifted only once.
+    if (level != v8::MemoryPressureLevel::kNone || level != level_) {
+      level_ = level;
+      Notify(level);
+    }
+  }
+}
+
+
+void MemoryPressureMonitor::Notify(v8::MemoryPressureLevel level) {
+  // MemoryPressureNotification may be called from any thread; V8 acts
+  // on it through an interrupt if the isolate is busy.  Holding the
+  // lock keeps isolates from being removed and disposed meanwhile.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < isolates_.size(); i++)
+    isolates_[i]->MemoryPressureNotification(level);
+}
@@ -0,0 +1,95 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef HEAP_CONTROL_H_
+#define HEAP_CONTROL_H_
+
+#include <include/v8.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Limits the young and old generations of an isolate to the given
+// number of megabytes.  Zero keeps V8's default for that generation.
+void SetHeapLimits(size_t max_young_mb, size_t max_old_mb,
+                   v8::Isolate::CreateParams* create_params);
+
+// Prints the heap statistics of an isolate, one line per space.
+void PrintHeapStatistics(v8::Isolate* isolate, FILE* out);
+
+// Writes a heap snapshot of the isolate to a file in the JSON format
+// DevTools loads.
+bool WriteHeapSnapshot(v8::Isolate* isolate, const std::string& name);
+
+
+/**
+ * Watches the memory.events file of a cgroup (v2) and passes memory
+ * pressure on to the isolates it knows about.  Hitting the cgroup's
+ * 'high' boundary counts as moderate pressure, hitting 'max' or the
+ * OOM killer as critical pressure; events that do neither lift it.
+ */
+class MemoryPressureMonitor {
+ public:
+  MemoryPressureMonitor();
+  ~MemoryPressureMonitor();
+
+  // Starts watching the given memory.events file.
+  bool Start(const std::string& events_file);
+
+  // Isolates must be removed before they are disposed.
+  void Add(v8::Isolate* isolate);
+  void Remove(v8::Isolate* isolate);
+
+ private:
+  struct Counters {
+    int64_t high;
+    int64_t max;
+    int64_t oom;
+  };
+
+  bool ReadCounters(Counters* counters);
+  void Run();
+  void Notify(v8::MemoryPressureLevel level);
+
+  std::string events_file_;
+  int inotify_fd_;
+  // Written to when the monitor shuts down, to wake up the thread.
+  int wake_fds_[2];
+  Counters counters_;
+  v8::MemoryPressureLevel level_;
+  std::mutex mutex_;
+  std::vector<v8::Isolate*> isolates_;
+  std::thread thread_;
+};
+
+#endif  // HEAP_CONTROL_H_
@@ -9,6 +9,9 @@
 #include "include/libplatform/libplatform.h"
 #include "include/v8.h"
 
+#include "heap_control.h"
+#include "pooled_allocator.h"
+
 int main(int argc, char* argv[]) {
   // Initialize V8.
   v8::V8::InitializeICUDefaultLocation(argv[0]);
@@ -17,10 +20,27 @@ int main(int argc, char* argv[]) {
   v8::V8::InitializePlatform(platform.get());
   v8::V8::Initialize();
 
-  // Create a new Isolate and make it the current one.
+  // Create a new Isolate and make it the current one.  Its generations
+  // can be limited with --heap-young-mb=<n> and --heap-old-mb=<n>, and
+  // --allocator=pooled|huge picks a PooledAllocator for its ArrayBuffers.
   v8::Isolate::CreateParams create_params;
-  create_params.array_buffer_allocator =
-      v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+  size_t max_young_mb = 0;
+  size_t max_old_mb = 0;
+  ArrayBufferAllocatorKind allocator = kDefaultAllocator;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--heap-young-mb=", 16) == 0) {
+      max_young_mb = strtoul(argv[i] + 16, NULL, 10);
+    } else if (strncmp(argv[i], "--heap-old-mb=", 14) == 0) {
+      max_old_mb = strtoul(argv[i] + 14, NULL, 10);
+    } else if (strncmp(argv[i], "--allocator=", 12) == 0 &&
+               !ParseAllocatorKind(argv[i] + 12, &allocator)) {
+      fprintf(stderr, "Unknown allocator '%s'\n", argv[i] + 12);
+      return 1;
+    }
+  }
+  create_params.array_buffer_allocator_shared =
+      NewArrayBufferAllocator(allocator);
+  SetHeapLimits(max_young_mb, max_old_mb, &create_params);
   v8::Isolate* isolate = v8::Isolate::New(create_params);
   {
     v8::Isolate::Scope isolate_scope(isolate);
@@ -97,6 +117,5 @@ int main(int argc, char* argv[]) {
   isolate->Dispose();
   v8::V8::Dispose();
   v8::V8::ShutdownPlatform();
-  delete create_params.array_buffer_allocator;
   return 0;
 }
@@ -0,0 +1,1871 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "http_processor.h"
+
+#include <include/libplatform/libplatform.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using std::map;
+using std::string;
+
+using v8::Array;
+using v8::Context;
+using v8::EscapableHandleScope;
+using v8::Function;
+using v8::FunctionTemplate;
+using v8::Global;
+using v8::HandleScope;
+using v8::Isolate;
+using v8::Local;
+using v8::MaybeLocal;
+using v8::Name;
+using v8::NamedPropertyHandlerConfiguration;
+using v8::NewStringType;
+using v8::Number;
+using v8::Object;
+using v8::ObjectTemplate;
+using v8::PropertyCallbackInfo;
+using v8::Script;
+using v8::SnapshotCreator;
+using v8::StartupData;
+using v8::String;
+using v8::TryCatch;
+using v8::Value;
+
+// -------------------------
+// --- P r o c e s s o r ---
+// -------------------------
+
+
+static void LogCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  if (args.Length() < 1) return;
+  Isolate* isolate = args.GetIsolate();
+  HandleScope scope(isolate);
+  Local<Value> arg = args[0];
+  String::Utf8Value value(isolate, arg);
+  HttpRequestProcessor::Log(*value);
+}
+
+
+// Execute the script and fetch the Process method.
+bool JsHttpRequestProcessor::Initialize(map<string, string>* opts,
+                                        map<string, string>* output) {
+  // Let the accessors find their way back to this processor.
+  GetIsolate()->SetData(kProcessorSlot, this);
+  options_ = opts;
+
+  if (from_snapshot_) return InitializeFromSnapshot(opts, output);
+
+  // Create a handle scope to hold the temporary references.
+  HandleScope handle_scope(GetIsolate());
+
+  // Create a template for the global object where we set the
+  // built-in global functions.
+  Local<ObjectTemplate> global = ObjectTemplate::New(GetIsolate());
+  global->Set(String::NewFromUtf8(GetIsolate(), "log", NewStringType::kNormal)
+                  .ToLocalChecked(),
+              FunctionTemplate::New(GetIsolate(), LogCallback));
+
+  // Each processor gets its own context so different processors don't
+  // affect each other. Context::New returns a persistent handle which
+  // is what we need for the reference to remain after we return from
+  // this method. That persistent handle has to be disposed in the
+  // destructor.
+  v8::Local<v8::Context> context = Context::New(GetIsolate(), NULL, global);
+  context_.Reset(GetIsolate(), context);
+
+  // Enter the new context so all the following operations take place
+  // within it.
+  Context::Scope context_scope(context);
+
+  // Make the options mapping available within the context
+  if (!InstallMaps(opts, output))
+    return false;
+
+  // Compile and run the script
+  if (!ExecuteScript(Local<String>::New(GetIsolate(), script_)))
+    return false;
+
+  // The script compiled and ran correctly.  Now we fetch out the
+  // Process function from the global object.
+  return FetchProcessFunction(context);
+}
+
+
+bool JsHttpRequestProcessor::FetchProcessFunction(Local<Context> context) {
+  // A WebAssembly module takes the place of Process and ProcessBatch.
+  if (wasm_module_ != NULL) return InstantiateWasm(context);
+
+  // ProcessBatch is optional; when present it is used for batches.
+  Local<String> process_batch_name =
+      String::NewFromUtf8(GetIsolate(), "ProcessBatch", NewStringType::kNormal)
+          .ToLocalChecked();
+  Local<Value> process_batch_val;
+  if (context->Global()
+          ->Get(context, process_batch_name)
+          .ToLocal(&process_batch_val) &&
+      process_batch_val->IsFunction()) {
+    process_batch_.Reset(GetIsolate(),
+                         Local<Function>::Cast(process_batch_val));
+  }
+
+  Local<String> process_name =
+      String::NewFromUtf8(GetIsolate(), "Process", NewStringType::kNormal)
+          .ToLocalChecked();
+  Local<Value> process_val;
+  // If there is no Process function, or if it is not a function,
+  // bail out
+  if (!context->Global()->Get(context, process_name).ToLocal(&process_val) ||
+      !process_val->IsFunction()) {
+    return false;
+  }
+
+  // It is a function; cast it to a Function
+  Local<Function> process_fun = Local<Function>::Cast(process_val);
+
+  // Store the function in a Global handle, since we also want
+  // that to remain after this call returns
+  process_.Reset(GetIsolate(), process_fun);
+
+  // All done; all went well
+  return true;
+}
+
+
+bool JsHttpRequestProcessor::ExecuteScript(Local<String> script) {
+  HandleScope handle_scope(GetIsolate());
+
+  // We're just about to compile the script; set up an error handler to
+  // catch any exceptions the script might throw.
+  TryCatch try_catch(GetIsolate());
+
+  Local<Context> context(GetIsolate()->GetCurrentContext());
+
+  // Compile the script and check for errors.
+  Local<Script> compiled_script;
+  bool produce_cache = false;
+  MaybeLocal<Script> maybe_script;
+  {
+    StageTimer timer(&metrics_, kStageCompile);
+    maybe_script =
+        code_cache_ != NULL
+            ? code_cache_->Compile(context, script, NULL, &produce_cache)
+            : Script::Compile(context, script);
+  }
+  if (!maybe_script.ToLocal(&compiled_script)) {
+    StageTimer timer(&metrics_, kStageException);
+    String::Utf8Value error(GetIsolate(), try_catch.Exception());
+    Log(*error);
+    // The script failed to compile; bail out.
+    return false;
+  }
+
+  // Run the script!
+  Local<Value> result;
+  bool ran;
+  {
+    StageTimer timer(&metrics_, kStageRun);
+    ran = compiled_script->Run(context).ToLocal(&result);
+  }
+  if (!ran) {
+    // The TryCatch above is still in effect and will have caught the error.
+    StageTimer timer(&metrics_, kStageException);
+    String::Utf8Value error(GetIsolate(), try_catch.Exception());
+    Log(*error);
+    // Running the script failed; bail out.
+    return false;
+  }
+
+  // Now that the script has run, the cache will also cover the
+  // functions it compiled lazily.
+  if (produce_cache)
+    code_cache_->Produce(GetIsolate(), compiled_script, script);
+
+  return true;
+}
+
+
+bool JsHttpRequestProcessor::InstallMaps(map<string, string>* opts,
+                                         map<string, string>* output) {
+  HandleScope handle_scope(GetIsolate());
+
+  // Wrap the map object in a JavaScript wrapper, or load it into a
+  // native store and wrap that.
+  Local<Object> opts_obj;
+  if (use_native_store_) {
+    options_store_.CopyFrom(*opts);
+    opts_obj = WrapNativeStore(&options_store_);
+  } else {
+    opts_obj = WrapMap(opts);
+  }
+
+  v8::Local<v8::Context> context =
+      v8::Local<v8::Context>::New(GetIsolate(), context_);
+
+  // Set the options object as a property on the global object.
+  context->Global()
+      ->Set(context,
+            String::NewFromUtf8(GetIsolate(), "options", NewStringType::kNormal)
+                .ToLocalChecked(),
+            opts_obj)
+      .FromJust();
+
+  output_ = output;
+  Local<Object> output_obj;
+  if (use_native_store_) {
+    output_store_.CopyFrom(*output);
+    output_obj = WrapNativeStore(&output_store_);
+  } else {
+    output_obj = WrapMap(output);
+  }
+  context->Global()
+      ->Set(context,
+            String::NewFromUtf8(GetIsolate(), "output", NewStringType::kNormal)
+                .ToLocalChecked(),
+            output_obj)
+      .FromJust();
+
+  return true;
+}
+
+
+bool JsHttpRequestProcessor::Process(HttpRequest* request) {
+  if (shedding_ && ShedRequest()) return false;
+  if (!count_allocations_) {
+    bool result = CallProcess(request);
+    AfterCall(1);
+    return result;
+  }
+
+  int gc_count = gc_count_;
+  size_t heap_before = UsedHeapSize();
+  bool result = CallProcess(request);
+  size_t heap_after = UsedHeapSize();
+  // A garbage collection during the call makes the difference
+  // meaningless, so such calls are left out.
+  if (gc_count_ == gc_count && heap_after >= heap_before) {
+    heap_bytes_allocated_ += heap_after - heap_before;
+    requests_measured_++;
+  }
+  AfterCall(1);
+  return result;
+}
+
+
+bool JsHttpRequestProcessor::CallProcess(HttpRequest* request) {
+  if (!wasm_process_.IsEmpty()) return CallWasmProcess(request);
+
+  // A failed restart leaves nothing to call.
+  if (process_.IsEmpty()) {
+    restart_failed_requests_++;
+    dropped_requests_++;
+    return false;
+  }
+
+  // Create a handle scope to keep the temporary object references.
+  HandleScope handle_scope(GetIsolate());
+
+  v8::Local<v8::Context> context =
+      v8::Local<v8::Context>::New(GetIsolate(), context_);
+
+  // Enter this processor's context so all the remaining operations
+  // take place there
+  Context::Scope context_scope(context);
+
+  // Wrap the C++ request object in a JavaScript wrapper
+  Local<Object> request_obj;
+  {
+    StageTimer timer(&metrics_, kStageWrap);
+    request_obj = WrapRequest(request);
+  }
+
+  // Set up an exception handler before calling the Process function
+  TryCatch try_catch(GetIsolate());
+
+  // Invoke the process function, giving the global object as 'this'
+  // and one argument, the request.
+  const int argc = 1;
+  Local<Value> argv[argc] = {request_obj};
+  v8::Local<v8::Function> process =
+      v8::Local<v8::Function>::New(GetIsolate(), process_);
+  Local<Value> result;
+  bool called;
+  {
+    StageTimer timer(&metrics_, kStageCall);
+    if (watchdog_) watchdog_->Arm();
+    called =
+        process->Call(context, context->Global(), argc, argv).ToLocal(&result);
+  }
+  if (watchdog_ && watchdog_->Disarm()) {
+    RecoverFromTimeout(request, 1);
+    return false;
+  }
+  if (!called) {
+    // Terminations are reported by whoever asked for them.
+    if (!try_catch.HasTerminated()) {
+      StageTimer timer(&metrics_, kStageException);
+      String::Utf8Value error(GetIsolate(), try_catch.Exception());
+      Log(*error);
+    }
+    return false;
+  }
+  return true;
+}
+
+
+bool HttpRequestProcessor::ProcessBatch(HttpRequest** reqs, int count,
+                                        bool* results) {
+  bool all_succeeded = true;
+  for (int i = 0; i < count; i++) {
+    results[i] = Process(reqs[i]);
+    if (!results[i]) all_succeeded = false;
+  }
+  return all_succeeded;
+}
+
+
+bool JsHttpRequestProcessor::ProcessBatch(HttpRequest** reqs, int count,
+                                          bool* results) {
+  if (process_batch_.IsEmpty())
+    return HttpRequestProcessor::ProcessBatch(reqs, count, results);
+  if (shedding_ && ShedRequest()) {
+    shed_requests_ += count - 1;
+    dropped_requests_ += count - 1;
+    for (int i = 0; i < count; i++) results[i] = false;
+    return false;
+  }
+  bool all_succeeded = CallProcessBatch(reqs, count, results);
+  AfterCall(count);
+  return all_succeeded;
+}
+
+
+bool JsHttpRequestProcessor::CallProcessBatch(HttpRequest** reqs, int count,
+                                              bool* results) {
+  // One handle scope, context entry and call for the whole batch.
+  HandleScope handle_scope(GetIsolate());
+
+  v8::Local<v8::Context> context =
+      v8::Local<v8::Context>::New(GetIsolate(), context_);
+  Context::Scope context_scope(context);
+
+  TryCatch try_catch(GetIsolate());
+
+  // Wrap all the requests and hand them over as one array.  The array
+  // is reused for as long as batches keep the same size.  The elements
+  // are defined rather than assigned, so index setters a script put on
+  // the array or its prototype are not run.  A script may also have
+  // frozen the array it was handed, in which case it is replaced.
+  Local<Array> request_array;
+  bool filled = false;
+  {
+    StageTimer timer(&metrics_, kStageWrap);
+    if (!batch_array_.IsEmpty()) {
+      request_array = Local<Array>::New(GetIsolate(), batch_array_);
+    }
+    for (int attempt = 0; attempt < 2 && !filled; attempt++) {
+      if (attempt > 0 || request_array.IsEmpty() ||
+          static_cast<int>(request_array->Length()) != count) {
+        request_array = Array::New(GetIsolate(), count);
+        batch_array_.Reset(GetIsolate(), request_array);
+      }
+      filled = true;
+      for (int i = 0; i < count && filled; i++) {
+        filled = request_array
+                     ->CreateDataProperty(context, i, WrapRequest(reqs[i], i))
+                     .FromMaybe(false);
+      }
+    }
+  }
+  if (!filled) {
+    for (int i = 0; i < count; i++) results[i] = false;
+    return false;
+  }
+
+  const int argc = 1;
+  Local<Value> argv[argc] = {request_array};
+  v8::Local<v8::Function> process_batch =
+      v8::Local<v8::Function>::New(GetIsolate(), process_batch_);
+  Local<Value> result;
+  bool called;
+  {
+    StageTimer timer(&metrics_, kStageCall);
+    // The batch shares the budgets of all its requests.
+    if (watchdog_) watchdog_->Arm(count);
+    called = process_batch->Call(context, context->Global(), argc, argv)
+                 .ToLocal(&result);
+  }
+  bool timed_out = watchdog_ && watchdog_->Disarm();
+  if (timed_out) RecoverFromTimeout(reqs[0], count);
+  if (!called || timed_out) {
+    if (!timed_out && !try_catch.HasTerminated()) {
+      StageTimer timer(&metrics_, kStageException);
+      String::Utf8Value error(GetIsolate(), try_catch.Exception());
+      Log(*error);
+    }
+    for (int i = 0; i < count; i++) results[i] = false;
+    return false;
+  }
+
+  // Pick up the per request results, if the script returned any.
+  bool all_succeeded = true;
+  Local<Array> result_array;
+  if (result->IsArray()) result_array = Local<Array>::Cast(result);
+  for (int i = 0; i < count; i++) {
+    Local<Value> element;
+    results[i] = result_array.IsEmpty() ||
+                 static_cast<int>(result_array->Length()) <= i ||
+                 !result_array->Get(context, i).ToLocal(&element) ||
+                 !element->IsFalse();
+    if (!results[i]) all_succeeded = false;
+  }
+  return all_succeeded;
+}
+
+
+// ---------------------------------------------
+// --- W e b A s s e m b l y   P r o c e s s ---
+// ---------------------------------------------
+
+
+// Looks up an export of a WebAssembly instance.
+static bool GetExport(Local<Context> context, Local<Object> exports,
+                      const char* name, Local<Value>* value) {
+  return exports
+      ->Get(context, String::NewFromUtf8(context->GetIsolate(), name,
+                                         NewStringType::kInternalized)
+                         .ToLocalChecked())
+      .ToLocal(value);
+}
+
+
+// Reads an address or size exported as a number or as a
+// WebAssembly.Global holding one.
+static bool GetExportedUint32(Local<Context> context, Local<Object> exports,
+                              const char* name, uint32_t* result) {
+  Local<Value> value;
+  if (!GetExport(context, exports, name, &value)) return false;
+  if (value->IsObject() &&
+      !GetExport(context, value.As<Object>(), "value", &value)) {
+    return false;
+  }
+  return value->IsNumber() && value->Uint32Value(context).To(result);
+}
+
+
+// Releases the module file an ArrayBuffer over its wire bytes kept
+// mapped.
+static void ReleaseWasmFile(void* data, size_t length, void* file) {
+  delete static_cast<std::shared_ptr<SourceFile>*>(file);
+}
+
+
+// Stores a u32 the way WebAssembly loads it, whatever the byte order of
+// the host.
+static void StoreWasmUint32(uint8_t* p, uint32_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  p[2] = static_cast<uint8_t>(value >> 16);
+  p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+
+bool JsHttpRequestProcessor::InstantiateWasm(Local<Context> context) {
+  Isolate* isolate = GetIsolate();
+  TryCatch try_catch(isolate);
+
+  // Compile and instantiate the module the way the script would, with
+  // the imports the script set up.
+  Local<Object> global = context->Global();
+  Local<Value> wasm;
+  Local<Value> module_class;
+  Local<Value> instance_class;
+  Local<Value> imports;
+  Local<Object> module;
+  Local<Object> instance;
+  Local<Value> exports;
+  if (!GetExport(context, global, "WebAssembly", &wasm) || !wasm->IsObject() ||
+      !GetExport(context, wasm.As<Object>(), "Module", &module_class) ||
+      !module_class->IsFunction() ||
+      !GetExport(context, wasm.As<Object>(), "Instance", &instance_class) ||
+      !instance_class->IsFunction() ||
+      !GetExport(context, global, "wasmImports", &imports)) {
+    Log("WebAssembly is not available");
+    return false;
+  }
+
+  // The buffer points into the mapping of the file, which WebAssembly
+  // only reads from.
+  std::unique_ptr<v8::BackingStore> store = v8::ArrayBuffer::NewBackingStore(
+      const_cast<char*>(wasm_module_->data()), wasm_module_->size(),
+      ReleaseWasmFile, new std::shared_ptr<SourceFile>(wasm_module_));
+  Local<Value> bytes = v8::ArrayBuffer::New(isolate, std::move(store));
+  bool compiled;
+  {
+    StageTimer timer(&metrics_, kStageCompile);
+    compiled = module_class.As<Function>()
+                   ->NewInstance(context, 1, &bytes)
+                   .ToLocal(&module);
+  }
+  if (!compiled) {
+    StageTimer timer(&metrics_, kStageException);
+    String::Utf8Value error(isolate, try_catch.Exception());
+    Log(*error);
+    return false;
+  }
+
+  if (!imports->IsObject()) imports = Object::New(isolate);
+  Local<Value> argv[] = {module, imports};
+  bool instantiated;
+  {
+    StageTimer timer(&metrics_, kStageRun);
+    instantiated = instance_class.As<Function>()
+                       ->NewInstance(context, 2, argv)
+                       .ToLocal(&instance);
+  }
+  if (!instantiated) {
+    StageTimer timer(&metrics_, kStageException);
+    String::Utf8Value error(isolate, try_catch.Exception());
+    Log(*error);
+    return false;
+  }
+
+  Local<Value> process;
+  Local<Value> memory;
+  if (!GetExport(context, instance, "exports", &exports) ||
+      !exports->IsObject() ||
+      !GetExport(context, exports.As<Object>(), "process", &process) ||
+      !process->IsFunction() ||
+      !GetExport(context, exports.As<Object>(), "memory", &memory) ||
+      !memory->IsWasmMemoryObject() ||
+      !GetExportedUint32(context, exports.As<Object>(), "request_area",
+                         &wasm_area_) ||
+      !GetExportedUint32(context, exports.As<Object>(), "request_area_size",
+                         &wasm_area_size_)) {
+    Log("The WebAssembly module must export memory, process, request_area "
+        "and request_area_size");
+    return false;
+  }
+  if (wasm_area_size_ < kWasmHeaderSize) {
+    Log("The WebAssembly request area is too small");
+    return false;
+  }
+  wasm_process_.Reset(isolate, process.As<Function>());
+  wasm_memory_.Reset(isolate, memory.As<v8::WasmMemoryObject>());
+  wasm_buffer_.Reset();
+  wasm_base_ = NULL;
+  return true;
+}
+
+
+uint8_t* JsHttpRequestProcessor::GetWasmRequestArea() {
+  // The module may have grown its memory since the last request, which
+  // replaces the buffer and may move it.
+  Local<v8::ArrayBuffer> buffer =
+      Local<v8::WasmMemoryObject>::New(GetIsolate(), wasm_memory_)->Buffer();
+  if (wasm_base_ == NULL || wasm_buffer_ != buffer) {
+    std::shared_ptr<v8::BackingStore> store = buffer->GetBackingStore();
+    wasm_buffer_.Reset(GetIsolate(), buffer);
+    wasm_base_ = static_cast<uint8_t*>(store->Data());
+    wasm_buffer_size_ = store->ByteLength();
+  }
+  if (wasm_base_ == NULL || wasm_area_ > wasm_buffer_size_ ||
+      wasm_area_size_ > wasm_buffer_size_ - wasm_area_) {
+    return NULL;
+  }
+  return wasm_base_ + wasm_area_;
+}
+
+
+bool JsHttpRequestProcessor::CallWasmProcess(HttpRequest* request) {
+  HandleScope handle_scope(GetIsolate());
+  v8::Local<v8::Context> context =
+      v8::Local<v8::Context>::New(GetIsolate(), context_);
+  Context::Scope context_scope(context);
+
+  // Copy the fields from wherever the request keeps them straight into
+  // the module's memory.
+  {
+    StageTimer timer(&metrics_, kStageWrap);
+    uint8_t* area = GetWasmRequestArea();
+    if (area == NULL) {
+      Log("The WebAssembly request area is outside of its memory");
+      return false;
+    }
+    std::string_view fields[kWasmFieldCount] = {
+        request->Path(), request->Referrer(), request->Host(),
+        request->UserAgent()};
+    size_t offset = kWasmHeaderSize;
+    for (int i = 0; i < kWasmFieldCount; i++) {
+      size_t length = fields[i].size();
+      if (length > wasm_area_size_ - offset) {
+        Log("Request does not fit in the WebAssembly request area");
+        return false;
+      }
+      StoreWasmUint32(area + i * 8, static_cast<uint32_t>(offset));
+      StoreWasmUint32(area + i * 8 + 4, static_cast<uint32_t>(length));
+      memcpy(area + offset, fields[i].data(), length);
+      offset += length;
+    }
+  }
+
+  TryCatch try_catch(GetIsolate());
+  v8::Local<v8::Function> process =
+      v8::Local<v8::Function>::New(GetIsolate(), wasm_process_);
+  Local<Value> result;
+  bool called;
+  {
+    StageTimer timer(&metrics_, kStageCall);
+    if (watchdog_) watchdog_->Arm();
+    called = process->Call(context, v8::Undefined(GetIsolate()), 0, NULL)
+                 .ToLocal(&result);
+  }
+  if (watchdog_ && watchdog_->Disarm()) {
+    RecoverFromTimeout(request, 1);
+    return false;
+  }
+  if (!called) {
+    if (!try_catch.HasTerminated()) {
+      StageTimer timer(&metrics_, kStageException);
+      String::Utf8Value error(GetIsolate(), try_catch.Exception());
+      Log(*error);
+    }
+    return false;
+  }
+  // A process function without results cannot fail.
+  return !result->IsInt32() || result.As<v8::Int32>()->Value() != 0;
+}
+
+
+void JsHttpRequestProcessor::set_time_budget(int budget_ms) {
+  watchdog_.reset(budget_ms > 0 ? new Watchdog(GetIsolate(), budget_ms)
+                                : NULL);
+}
+
+
+void JsHttpRequestProcessor::RecoverFromTimeout(HttpRequest* request,
+                                                int count) {
+  // Execution is terminated until every JavaScript frame is gone, which
+  // is the case now that the call has returned.
+  GetIsolate()->CancelTerminateExecution();
+  timeouts_++;
+  dropped_requests_ += count;
+  std::string_view path = request->Path();
+  int path_length = static_cast<int>(path.size() < 128 ? path.size() : 128);
+  char message[256];
+  if (count == 1) {
+    snprintf(message, sizeof(message),
+             "Request for %.*s exceeded its %d ms budget", path_length,
+             path.data(), watchdog_->budget_ms());
+  } else {
+    snprintf(message, sizeof(message),
+             "Batch of %d requests starting with %.*s exceeded its %d ms "
+             "budget",
+             count, path_length, path.data(), count * watchdog_->budget_ms());
+  }
+  Log(message);
+}
+
+
+void JsHttpRequestProcessor::set_heap_limit_policy(HeapLimitPolicy policy) {
+  if (heap_limit_policy_ == kHeapLimitNone && policy != kHeapLimitNone) {
+    GetIsolate()->AddNearHeapLimitCallback(OnNearHeapLimit, this);
+    // Once the heap is back down, the headroom handed out is taken back.
+    GetIsolate()->AutomaticallyRestoreInitialHeapLimit(0.5);
+  } else if (heap_limit_policy_ != kHeapLimitNone &&
+             policy == kHeapLimitNone) {
+    GetIsolate()->RemoveNearHeapLimitCallback(OnNearHeapLimit, 0);
+  }
+  heap_limit_policy_ = policy;
+}
+
+
+void JsHttpRequestProcessor::set_heap_snapshot(size_t threshold,
+                                               const string& file) {
+  heap_snapshot_threshold_ = threshold;
+  heap_snapshot_file_ = file;
+}
+
+
+void JsHttpRequestProcessor::set_metrics_exporter(MetricsExporter* exporter) {
+  if (metrics_exporter_ != NULL) metrics_exporter_->Remove(&metrics_);
+  metrics_exporter_ = exporter;
+  if (metrics_exporter_ != NULL) metrics_exporter_->Add(&metrics_);
+}
+
+
+void JsHttpRequestProcessor::set_cpu_profile(
+    const CpuProfileOptions& options) {
+  cpu_profiler_.reset();
+  if (!options.file.empty())
+    cpu_profiler_.reset(new ScriptProfiler(GetIsolate(), options));
+}
+
+
+void JsHttpRequestProcessor::set_memory_monitor(
+    MemoryPressureMonitor* monitor) {
+  if (memory_monitor_ != NULL) memory_monitor_->Remove(GetIsolate());
+  memory_monitor_ = monitor;
+  if (memory_monitor_ != NULL) memory_monitor_->Add(GetIsolate());
+}
+
+
+size_t JsHttpRequestProcessor::OnNearHeapLimit(void* data,
+                                               size_t current_heap_limit,
+                                               size_t initial_heap_limit) {
+  JsHttpRequestProcessor* processor =
+      static_cast<JsHttpRequestProcessor*>(data);
+  processor->near_heap_limit_ = true;
+  processor->heap_limit_hits_++;
+  processor->initial_heap_limit_ = initial_heap_limit;
+  if (processor->heap_limit_policy_ != kHeapLimitGC) {
+    // Unwind the request; AfterCall cancels the termination.
+    processor->GetIsolate()->TerminateExecution();
+  } else if (current_heap_limit >= 2 * initial_heap_limit) {
+    // The garbage collections after each request did not help.
+    return current_heap_limit;
+  }
+  return current_heap_limit + current_heap_limit / 4;
+}
+
+
+void JsHttpRequestProcessor::AfterCall(int requests) {
+  if (near_heap_limit_) {
+    near_heap_limit_ = false;
+    if (heap_limit_policy_ != kHeapLimitGC) {
+      GetIsolate()->CancelTerminateExecution();
+      terminated_requests_ += requests;
+      dropped_requests_ += requests;
+    }
+    switch (heap_limit_policy_) {
+      case kHeapLimitShed:
+        Log("Heap limit reached, shedding requests");
+        shedding_ = true;
+        shed_since_gc_ = 0;
+        break;
+      case kHeapLimitRestart:
+        Log("Heap limit reached, restarting");
+        if (!Restart()) Log("Restart failed");
+        break;
+      default:
+        Log("Heap limit reached, collecting garbage");
+        break;
+    }
+    // Restart collects before it runs the script again.
+    if (heap_limit_policy_ != kHeapLimitRestart)
+      GetIsolate()->LowMemoryNotification();
+  }
+
+  if (heap_snapshot_threshold_ > 0 && ++heap_checks_ >= kHeapCheckInterval) {
+    heap_checks_ = 0;
+    if (UsedHeapSize() > heap_snapshot_threshold_) {
+      if (WriteHeapSnapshot(GetIsolate(), heap_snapshot_file_)) {
+        Log(("Heap snapshot written to " + heap_snapshot_file_).c_str());
+      } else {
+        Log(("Error writing heap snapshot " + heap_snapshot_file_).c_str());
+      }
+      heap_snapshot_threshold_ = 0;
+    }
+  }
+
+  if (cpu_profiler_) cpu_profiler_->OnRequestsDone(requests);
+}
+
+
+bool JsHttpRequestProcessor::ShedRequest() {
+  if (++shed_since_gc_ >= kShedRetryInterval) {
+    shed_since_gc_ = 0;
+    GetIsolate()->LowMemoryNotification();
+    if (UsedHeapSize() < initial_heap_limit_ / 2) {
+      shedding_ = false;
+      Log("Heap recovered, no longer shedding requests");
+      return false;
+    }
+  }
+  shed_requests_++;
+  dropped_requests_++;
+  return true;
+}
+
+
+bool JsHttpRequestProcessor::Restart() {
+  restarts_++;
+  // The output collected so far survives the restart.
+  SyncOutput();
+  context_.Reset();
+  process_.Reset();
+  process_batch_.Reset();
+  request_wrappers_.clear();
+  batch_array_.Reset();
+  wasm_process_.Reset();
+  wasm_memory_.Reset();
+  wasm_buffer_.Reset();
+  wasm_base_ = NULL;
+  // Collect the old context first, so the old and the new script state
+  // never have to fit in the heap together.
+  GetIsolate()->LowMemoryNotification();
+  return Initialize(options_, output_);
+}
+
+
+void JsHttpRequestProcessor::PrintHeapStatistics(FILE* out) {
+  ::PrintHeapStatistics(GetIsolate(), out);
+  fprintf(out,
+          "Heap limit: %d hits, %d requests terminated, %d requests shed, "
+          "%d restarts, %d requests failed after a failed restart\n",
+          heap_limit_hits_, terminated_requests_, shed_requests_, restarts_,
+          restart_failed_requests_);
+}
+
+
+void JsHttpRequestProcessor::set_count_allocations(bool count) {
+  if (count == count_allocations_) return;
+  count_allocations_ = count;
+  if (count) {
+    GetIsolate()->AddGCEpilogueCallback(OnGarbageCollection, this);
+  } else {
+    GetIsolate()->RemoveGCEpilogueCallback(OnGarbageCollection, this);
+  }
+}
+
+
+void JsHttpRequestProcessor::OnGarbageCollection(Isolate* isolate,
+                                                 v8::GCType type,
+                                                 v8::GCCallbackFlags flags,
+                                                 void* data) {
+  static_cast<JsHttpRequestProcessor*>(data)->gc_count_++;
+}
+
+
+size_t JsHttpRequestProcessor::UsedHeapSize() {
+  v8::HeapStatistics stats;
+  GetIsolate()->GetHeapStatistics(&stats);
+  return stats.used_heap_size();
+}
+
+
+void JsHttpRequestProcessor::PrintAllocationStats(FILE* out) {
+  fprintf(out,
+          "Allocations: %d request wrappers created, %.1f heap bytes per "
+          "request over %d requests\n",
+          wrappers_allocated_,
+          requests_measured_ > 0
+              ? static_cast<double>(heap_bytes_allocated_) / requests_measured_
+              : 0.0,
+          requests_measured_);
+}
+
+
+JsHttpRequestProcessor::~JsHttpRequestProcessor() {
+  set_count_allocations(false);
+  set_heap_limit_policy(kHeapLimitNone);
+  set_memory_monitor(NULL);
+  set_metrics_exporter(NULL);
+  // Write out the profile while the isolate is still around.
+  cpu_profiler_.reset();
+
+  // Dispose the persistent handles.  When no one else has any
+  // references to the objects stored in the handles they will be
+  // automatically reclaimed.
+  context_.Reset();
+  script_.Reset();
+  process_.Reset();
+  process_batch_.Reset();
+  request_wrappers_.clear();
+  batch_array_.Reset();
+  wasm_process_.Reset();
+  wasm_memory_.Reset();
+  wasm_buffer_.Reset();
+  request_template_.Reset();
+  map_template_.Reset();
+  native_store_template_.Reset();
+}
+
+
+// -------------------------
+// --- S n a p s h o t s ---
+// -------------------------
+
+
+const intptr_t* JsHttpRequestProcessor::ExternalReferences() {
+  static const intptr_t references[] = {
+      reinterpret_cast<intptr_t>(LogCallback),
+      reinterpret_cast<intptr_t>(MapGet),
+      reinterpret_cast<intptr_t>(MapSet),
+      reinterpret_cast<intptr_t>(GetPath),
+      reinterpret_cast<intptr_t>(GetReferrer),
+      reinterpret_cast<intptr_t>(GetHost),
+      reinterpret_cast<intptr_t>(GetUserAgent),
+      0};
+  return references;
+}
+
+
+bool JsHttpRequestProcessor::CreateSnapshot(const string& source,
+                                            map<string, string>* opts,
+                                            StartupData* blob) {
+  SnapshotCreator creator(ExternalReferences());
+  Isolate* isolate = creator.GetIsolate();
+  {
+    HandleScope handle_scope(isolate);
+    Local<String> script;
+    if (!String::NewFromUtf8(isolate, source.data(), NewStringType::kNormal,
+                             static_cast<int>(source.size()))
+             .ToLocal(&script)) {
+      return false;
+    }
+
+    // Anything the top level of the script writes to the output is
+    // dropped; the output belongs to whoever boots from the snapshot.
+    map<string, string> output;
+    JsHttpRequestProcessor processor(isolate, script);
+    if (!processor.Initialize(opts, &output)) return false;
+
+    Local<Context> context = Local<Context>::New(isolate, processor.context_);
+    // The maps live in this process only, so their wrappers go into the
+    // snapshot empty and get reattached when a processor boots from it.
+    if (!processor.AttachMap(context, "options", NULL) ||
+        !processor.AttachMap(context, "output", NULL)) {
+      return false;
+    }
+    creator.SetDefaultContext(context);
+    if (creator.AddData(processor.GetRequestTemplate()) !=
+            kRequestTemplateIndex ||
+        creator.AddData(processor.GetMapTemplate()) != kMapTemplateIndex) {
+      return false;
+    }
+    // The processor's global handles are released here; there must be
+    // none left when the blob is created.
+  }
+  *blob = creator.CreateBlob(SnapshotCreator::FunctionCodeHandling::kKeep);
+  return blob->data != NULL;
+}
+
+
+bool JsHttpRequestProcessor::InitializeFromSnapshot(
+    map<string, string>* opts, map<string, string>* output) {
+  HandleScope handle_scope(GetIsolate());
+
+  // Each template can only be taken out of the snapshot once, which is
+  // fine since there is one processor per isolate.  If they are missing
+  // they are created on demand as usual.
+  Local<ObjectTemplate> templ;
+  if (GetIsolate()
+          ->GetDataFromSnapshotOnce<ObjectTemplate>(kRequestTemplateIndex)
+          .ToLocal(&templ)) {
+    request_template_.Reset(GetIsolate(), templ);
+  }
+  if (GetIsolate()
+          ->GetDataFromSnapshotOnce<ObjectTemplate>(kMapTemplateIndex)
+          .ToLocal(&templ)) {
+    map_template_.Reset(GetIsolate(), templ);
+  }
+
+  // Without a global template we get the snapshot's default context,
+  // which already has 'log', the map wrappers and everything the script
+  // set up at its top level.
+  Local<Context> context = Context::New(GetIsolate());
+  context_.Reset(GetIsolate(), context);
+  Context::Scope context_scope(context);
+
+  if (!AttachMap(context, "options", opts) ||
+      !AttachMap(context, "output", output)) {
+    return false;
+  }
+  return FetchProcessFunction(context);
+}
+
+
+// -----------------------------------
+// --- A c c e s s i n g   M a p s ---
+// -----------------------------------
+
+// Utility function that wraps a C++ http request object in a
+// JavaScript object.
+Local<Object> JsHttpRequestProcessor::WrapMap(map<string, string>* obj) {
+  // Local scope for temporary handles.
+  EscapableHandleScope handle_scope(GetIsolate());
+
+  // Fetch the template for creating JavaScript map wrappers.
+  Local<ObjectTemplate> templ = GetMapTemplate();
+
+  // Create an empty map wrapper.
+  Local<Object> result =
+      templ->NewInstance(GetIsolate()->GetCurrentContext()).ToLocalChecked();
+
+  // Store the raw map pointer in the JavaScript wrapper.  It is stored
+  // as an aligned pointer, which saves allocating an External for it.
+  result->SetAlignedPointerInInternalField(0, obj);
+
+  // Return the result through the current handle scope.  Since each
+  // of these handles will go away when the handle scope is deleted
+  // we need to call Close to let one, the result, escape into the
+  // outer handle scope.
+  return handle_scope.Escape(result);
+}
+
+
+// Fetches the template for map wrappers.  It only has to be created
+// once, which we do on demand.
+Local<ObjectTemplate> JsHttpRequestProcessor::GetMapTemplate() {
+  if (map_template_.IsEmpty()) {
+    Local<ObjectTemplate> raw_template = MakeMapTemplate(GetIsolate());
+    map_template_.Reset(GetIsolate(), raw_template);
+  }
+  return Local<ObjectTemplate>::New(GetIsolate(), map_template_);
+}
+
+
+bool JsHttpRequestProcessor::AttachMap(Local<Context> context,
+                                       const char* name,
+                                       map<string, string>* target) {
+  Local<Value> value;
+  if (!context->Global()
+           ->Get(context, String::NewFromUtf8(GetIsolate(), name,
+                                              NewStringType::kNormal)
+                              .ToLocalChecked())
+           .ToLocal(&value) ||
+      !value->IsObject()) {
+    return false;
+  }
+  Local<Object> obj = Local<Object>::Cast(value);
+  if (obj->InternalFieldCount() != 1) return false;
+  obj->SetAlignedPointerInInternalField(0, target);
+  return true;
+}
+
+
+// Utility function that extracts the C++ map pointer from a wrapper
+// object.
+map<string, string>* JsHttpRequestProcessor::UnwrapMap(Local<Object> obj) {
+  void* ptr = obj->GetAlignedPointerFromInternalField(0);
+  return static_cast<map<string, string>*>(ptr);
+}
+
+
+// Convert a JavaScript string to a std::string.  To not bother too
+// much with string encodings we just use ascii.
+string ObjectToString(v8::Isolate* isolate, Local<Value> value) {
+  String::Utf8Value utf8_value(isolate, value);
+  return string(*utf8_value);
+}
+
+
+void JsHttpRequestProcessor::MapGet(Local<Name> name,
+                                    const PropertyCallbackInfo<Value>& info) {
+  if (name->IsSymbol()) return;
+
+  // Fetch the map wrapped by this object.
+  map<string, string>* obj = UnwrapMap(info.Holder());
+
+  // Convert the JavaScript string to a std::string.
+  string key = ObjectToString(info.GetIsolate(), Local<String>::Cast(name));
+
+  // Look up the value if it exists using the standard STL ideom.
+  map<string, string>::iterator iter = obj->find(key);
+
+  // If the key is not present return an empty handle as signal
+  if (iter == obj->end()) return;
+
+  // Otherwise fetch the value and wrap it in a JavaScript string
+  const string& value = (*iter).second;
+  info.GetReturnValue().Set(
+      String::NewFromUtf8(info.GetIsolate(), value.c_str(),
+                          NewStringType::kNormal,
+                          static_cast<int>(value.length())).ToLocalChecked());
+}
+
+
+void JsHttpRequestProcessor::MapSet(Local<Name> name, Local<Value> value_obj,
+                                    const PropertyCallbackInfo<Value>& info) {
+  if (name->IsSymbol()) return;
+
+  // Fetch the map wrapped by this object.
+  map<string, string>* obj = UnwrapMap(info.Holder());
+
+  // Convert the key and value to std::strings.
+  string key = ObjectToString(info.GetIsolate(), Local<String>::Cast(name));
+  string value = ObjectToString(info.GetIsolate(), value_obj);
+
+  // Update the map.
+  (*obj)[key] = value;
+
+  // Return the value; any non-empty handle will work.
+  info.GetReturnValue().Set(value_obj);
+}
+
+
+Local<ObjectTemplate> JsHttpRequestProcessor::MakeMapTemplate(
+    Isolate* isolate) {
+  EscapableHandleScope handle_scope(isolate);
+
+  Local<ObjectTemplate> result = ObjectTemplate::New(isolate);
+  result->SetInternalFieldCount(1);
+  result->SetHandler(NamedPropertyHandlerConfiguration(MapGet, MapSet));
+
+  // Again, return the result through the current handle scope.
+  return handle_scope.Escape(result);
+}
+
+
+// ---------------------------------
+// --- N a t i v e   S t o r e s ---
+// ---------------------------------
+
+
+string NumberToString(double value) {
+  if (isnan(value)) return "NaN";
+  if (isinf(value)) return value > 0 ? "Infinity" : "-Infinity";
+  char buffer[32];
+  if (value == floor(value) && fabs(value) < 9007199254740992.0) {
+    snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value));
+    return buffer;
+  }
+  // Use the shortest representation that reads back as the same value.
+  for (int precision = 1; precision <= 17; precision++) {
+    snprintf(buffer, sizeof(buffer), "%.*g", precision, value);
+    if (strtod(buffer, NULL) == value) break;
+  }
+  return buffer;
+}
+
+
+NativeStore::NativeStore() : entries_(kInitialCapacity), size_(0) {
+  for (int i = 0; i < kKeyCacheSize; i++) key_cache_[i].slot = -1;
+}
+
+
+uint64_t NativeStore::Hash(const char* key, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+int NativeStore::FindSlot(const char* key, size_t length,
+                          uint64_t hash) const {
+  size_t mask = entries_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    const Entry& entry = entries_[i];
+    if (!entry.used) return static_cast<int>(i);
+    if (entry.hash == hash && entry.key.length() == length &&
+        memcmp(entry.key.data(), key, length) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+}
+
+
+int NativeStore::Add(const char* key, size_t length, uint64_t hash) {
+  // Keep the load factor below 0.7 so probe sequences stay short.
+  if ((size_ + 1) * 10 > entries_.size() * 7) Grow();
+  int slot = FindSlot(key, length, hash);
+  Entry& entry = entries_[slot];
+  entry.key.assign(key, length);
+  entry.hash = hash;
+  entry.used = true;
+  size_++;
+  return slot;
+}
+
+
+void NativeStore::Grow() {
+  std::vector<Entry> old_entries(entries_.size() * 2);
+  old_entries.swap(entries_);
+  for (size_t i = 0; i < old_entries.size(); i++) {
+    Entry& entry = old_entries[i];
+    if (!entry.used) continue;
+    int slot = FindSlot(entry.key.data(), entry.key.length(), entry.hash);
+    std::swap(entries_[slot], entry);
+  }
+  // Slots have moved, so the cached ones are no longer valid.
+  for (int i = 0; i < kKeyCacheSize; i++) {
+    key_cache_[i].name.Reset();
+    key_cache_[i].slot = -1;
+  }
+}
+
+
+int NativeStore::Lookup(Isolate* isolate, Local<Name> name, bool add) {
+  CachedKey& cached =
+      key_cache_[name->GetIdentityHash() & (kKeyCacheSize - 1)];
+  if (cached.slot >= 0 && cached.name == name) return cached.slot;
+
+  String::Utf8Value key(isolate, name);
+  size_t length = static_cast<size_t>(key.length());
+  uint64_t hash = Hash(*key, length);
+  int slot = FindSlot(*key, length, hash);
+  if (!entries_[slot].used) {
+    if (!add) return -1;
+    slot = Add(*key, length, hash);
+  }
+  cached.name.Reset(isolate, name);
+  cached.slot = slot;
+  return slot;
+}
+
+
+void NativeStore::Set(const string& key, const string& value) {
+  uint64_t hash = Hash(key.data(), key.length());
+  int slot = FindSlot(key.data(), key.length(), hash);
+  if (!entries_[slot].used) slot = Add(key.data(), key.length(), hash);
+  Entry& entry = entries_[slot];
+  entry.is_number = false;
+  entry.value = value;
+}
+
+
+void NativeStore::CopyFrom(const map<string, string>& from) {
+  for (map<string, string>::const_iterator i = from.begin(); i != from.end();
+       i++) {
+    Set(i->first, i->second);
+  }
+}
+
+
+void NativeStore::CopyTo(map<string, string>* to) const {
+  for (size_t i = 0; i < entries_.size(); i++) {
+    const Entry& entry = entries_[i];
+    if (!entry.used) continue;
+    (*to)[entry.key] =
+        entry.is_number ? NumberToString(entry.number) : entry.value;
+  }
+}
+
+
+void JsHttpRequestProcessor::SyncOutput() {
+  if (use_native_store_ && output_ != NULL) output_store_.CopyTo(output_);
+}
+
+
+Local<Object> JsHttpRequestProcessor::WrapNativeStore(NativeStore* obj) {
+  EscapableHandleScope handle_scope(GetIsolate());
+
+  if (native_store_template_.IsEmpty()) {
+    Local<ObjectTemplate> raw_template =
+        MakeNativeStoreTemplate(GetIsolate());
+    native_store_template_.Reset(GetIsolate(), raw_template);
+  }
+  Local<ObjectTemplate> templ =
+      Local<ObjectTemplate>::New(GetIsolate(), native_store_template_);
+
+  Local<Object> result =
+      templ->NewInstance(GetIsolate()->GetCurrentContext()).ToLocalChecked();
+  result->SetAlignedPointerInInternalField(0, obj);
+  return handle_scope.Escape(result);
+}
+
+
+NativeStore* JsHttpRequestProcessor::UnwrapNativeStore(Local<Object> obj) {
+  return static_cast<NativeStore*>(obj->GetAlignedPointerFromInternalField(0));
+}
+
+
+void JsHttpRequestProcessor::NativeStoreGet(
+    Local<Name> name, const PropertyCallbackInfo<Value>& info) {
+  if (name->IsSymbol()) return;
+
+  NativeStore* store = UnwrapNativeStore(info.Holder());
+  int slot = store->Lookup(info.GetIsolate(), name, false);
+
+  // If the key is not present return an empty handle as signal
+  if (slot < 0) return;
+
+  NativeStore::Entry* entry = store->At(slot);
+  if (entry->is_number) {
+    info.GetReturnValue().Set(entry->number);
+  } else {
+    info.GetReturnValue().Set(
+        String::NewFromUtf8(info.GetIsolate(), entry->value.c_str(),
+                            NewStringType::kNormal,
+                            static_cast<int>(entry->value.length()))
+            .ToLocalChecked());
+  }
+}
+
+
+void JsHttpRequestProcessor::NativeStoreSet(
+    Local<Name> name, Local<Value> value_obj,
+    const PropertyCallbackInfo<Value>& info) {
+  if (name->IsSymbol()) return;
+
+  NativeStore* store = UnwrapNativeStore(info.Holder());
+  NativeStore::Entry* entry =
+      store->At(store->Lookup(info.GetIsolate(), name, true));
+
+  // Numbers stay unboxed; everything else is stored as a string.
+  if (value_obj->IsNumber()) {
+    entry->is_number = true;
+    entry->number = Local<Number>::Cast(value_obj)->Value();
+  } else {
+    entry->is_number = false;
+    entry->value = ObjectToString(info.GetIsolate(), value_obj);
+  }
+
+  // Return the value; any non-empty handle will work.
+  info.GetReturnValue().Set(value_obj);
+}
+
+
+Local<ObjectTemplate> JsHttpRequestProcessor::MakeNativeStoreTemplate(
+    Isolate* isolate) {
+  EscapableHandleScope handle_scope(isolate);
+
+  Local<ObjectTemplate> result = ObjectTemplate::New(isolate);
+  result->SetInternalFieldCount(1);
+  result->SetHandler(
+      NamedPropertyHandlerConfiguration(NativeStoreGet, NativeStoreSet));
+
+  return handle_scope.Escape(result);
+}
+
+
+// -------------------------------------------
+// --- A c c e s s i n g   R e q u e s t s ---
+// -------------------------------------------
+
+/**
+ * Utility function that wraps a C++ http request object in a
+ * JavaScript object.  Wrappers are pooled: the first time a pool index
+ * is used a wrapper is created for it, after that the same wrapper is
+ * re-targeted at each new request, so wrapping allocates nothing in
+ * steady state.
+ */
+Local<Object> JsHttpRequestProcessor::WrapRequest(HttpRequest* request,
+                                                  size_t index) {
+  // Local scope for temporary handles.
+  EscapableHandleScope handle_scope(GetIsolate());
+
+  if (index >= request_wrappers_.size()) request_wrappers_.resize(index + 1);
+
+  Local<Object> result;
+  if (request_wrappers_[index].IsEmpty()) {
+    // Fetch the template for creating JavaScript http request wrappers
+    // and create an empty wrapper.
+    Local<ObjectTemplate> templ = GetRequestTemplate();
+    result =
+        templ->NewInstance(GetIsolate()->GetCurrentContext()).ToLocalChecked();
+    request_wrappers_[index].Reset(GetIsolate(), result);
+    wrappers_allocated_++;
+  } else {
+    result = Local<Object>::New(GetIsolate(), request_wrappers_[index]);
+    // Forget the strings made for the previous request.
+    result->SetInternalField(kPathField, v8::Undefined(GetIsolate()));
+    result->SetInternalField(kReferrerField, v8::Undefined(GetIsolate()));
+  }
+
+  // Store the raw request pointer in the JavaScript wrapper.
+  result->SetAlignedPointerInInternalField(kRequestField, request);
+
+  // Return the result through the current handle scope.  Since each
+  // of these handles will go away when the handle scope is deleted
+  // we need to call Close to let one, the result, escape into the
+  // outer handle scope.
+  return handle_scope.Escape(result);
+}
+
+
+// Fetches the template for request wrappers.  It only has to be
+// created once, which we do on demand.
+Local<ObjectTemplate> JsHttpRequestProcessor::GetRequestTemplate() {
+  if (request_template_.IsEmpty()) {
+    Local<ObjectTemplate> raw_template = MakeRequestTemplate(GetIsolate());
+    request_template_.Reset(GetIsolate(), raw_template);
+  }
+  return Local<ObjectTemplate>::New(GetIsolate(), request_template_);
+}
+
+
+/**
+ * Utility function that extracts the C++ http request object from a
+ * wrapper object.
+ */
+HttpRequest* JsHttpRequestProcessor::UnwrapRequest(Local<Object> obj) {
+  void* ptr = obj->GetAlignedPointerFromInternalField(kRequestField);
+  return static_cast<HttpRequest*>(ptr);
+}
+
+
+/**
+ * A string resource pointing straight at the storage of a request
+ * field.  Only used for requests whose storage outlives the isolate.
+ */
+class RequestFieldResource : public String::ExternalOneByteStringResource {
+ public:
+  RequestFieldResource(const char* data, size_t length)
+      : data_(data), length_(length) {}
+  virtual const char* data() const { return data_; }
+  virtual size_t length() const { return length_; }
+
+ private:
+  const char* data_;
+  size_t length_;
+};
+
+
+static bool IsAscii(std::string_view value) {
+  for (size_t i = 0; i < value.length(); i++) {
+    if (static_cast<unsigned char>(value[i]) >= 0x80) return false;
+  }
+  return true;
+}
+
+
+Local<String> StringInternTable::Get(Isolate* isolate,
+                                   std::string_view value) {
+  std::unordered_map<std::string_view, Global<String> >::iterator iter =
+      strings_.find(value);
+  if (iter != strings_.end()) return Local<String>::New(isolate, iter->second);
+
+  NewStringType type = strings_.size() < kMaxSize
+                           ? NewStringType::kInternalized
+                           : NewStringType::kNormal;
+  Local<String> result =
+      String::NewFromUtf8(isolate, value.data(), type,
+                          static_cast<int>(value.length())).ToLocalChecked();
+  if (type == NewStringType::kInternalized) {
+    keys_.push_back(string(value));
+    strings_.insert(std::make_pair(std::string_view(keys_.back()),
+                                   Global<String>(isolate, result)));
+  }
+  return result;
+}
+
+
+Local<String> JsHttpRequestProcessor::GetFieldString(Local<Object> holder,
+                                                     int field,
+                                                     HttpRequest* request,
+                                                     std::string_view value) {
+  Isolate* isolate = holder->GetIsolate();
+  Local<Value> cached = holder->GetInternalField(field);
+  if (cached->IsString()) return Local<String>::Cast(cached);
+
+  Local<String> result;
+  if (!request->IsStorageStable() ||
+      value.length() < kMinExternalFieldLength || !IsAscii(value) ||
+      !String::NewExternalOneByte(
+           isolate, new RequestFieldResource(value.data(), value.length()))
+           .ToLocal(&result)) {
+    result = String::NewFromUtf8(isolate, value.data(),
+                                 NewStringType::kNormal,
+                                 static_cast<int>(value.length()))
+                 .ToLocalChecked();
+  }
+  holder->SetInternalField(field, result);
+  return result;
+}
+
+
+void JsHttpRequestProcessor::GetPath(Local<String> name,
+                                     const PropertyCallbackInfo<Value>& info) {
+  // Extract the C++ request object from the JavaScript wrapper.
+  HttpRequest* request = UnwrapRequest(info.Holder());
+
+  // Fetch the path and return it as a JavaScript string.
+  info.GetReturnValue().Set(
+      GetFieldString(info.Holder(), kPathField, request, request->Path()));
+}
+
+
+void JsHttpRequestProcessor::GetReferrer(
+    Local<String> name,
+    const PropertyCallbackInfo<Value>& info) {
+  HttpRequest* request = UnwrapRequest(info.Holder());
+  info.GetReturnValue().Set(GetFieldString(info.Holder(), kReferrerField,
+                                           request, request->Referrer()));
+}
+
+
+void JsHttpRequestProcessor::GetHost(Local<String> name,
+                                     const PropertyCallbackInfo<Value>& info) {
+  HttpRequest* request = UnwrapRequest(info.Holder());
+  JsHttpRequestProcessor* processor = FromIsolate(info.GetIsolate());
+  info.GetReturnValue().Set(
+      processor->hosts_.Get(info.GetIsolate(), request->Host()));
+}
+
+
+void JsHttpRequestProcessor::GetUserAgent(
+    Local<String> name,
+    const PropertyCallbackInfo<Value>& info) {
+  HttpRequest* request = UnwrapRequest(info.Holder());
+  JsHttpRequestProcessor* processor = FromIsolate(info.GetIsolate());
+  info.GetReturnValue().Set(
+      processor->user_agents_.Get(info.GetIsolate(), request->UserAgent()));
+}
+
+
+Local<ObjectTemplate> JsHttpRequestProcessor::MakeRequestTemplate(
+    Isolate* isolate) {
+  EscapableHandleScope handle_scope(isolate);
+
+  Local<ObjectTemplate> result = ObjectTemplate::New(isolate);
+  result->SetInternalFieldCount(kRequestFieldCount);
+
+  // Add accessors for each of the fields of the request.
+  result->SetAccessor(
+      String::NewFromUtf8(isolate, "path", NewStringType::kInternalized)
+          .ToLocalChecked(),
+      GetPath);
+  result->SetAccessor(
+      String::NewFromUtf8(isolate, "referrer", NewStringType::kInternalized)
+          .ToLocalChecked(),
+      GetReferrer);
+  result->SetAccessor(
+      String::NewFromUtf8(isolate, "host", NewStringType::kInternalized)
+          .ToLocalChecked(),
+      GetHost);
+  result->SetAccessor(
+      String::NewFromUtf8(isolate, "userAgent", NewStringType::kInternalized)
+          .ToLocalChecked(),
+      GetUserAgent);
+
+  // Again, return the result through the current handle scope.
+  return handle_scope.Escape(result);
+}
+
+// -----------------------------------
+// --- D r i v e r   S u p p o r t ---
+// -----------------------------------
+
+
+void HttpRequestProcessor::Log(const char* event) {
+  printf("Logged: %s\n", event);
+}
+
+
+StringHttpRequest::StringHttpRequest(const string& path,
+                                     const string& referrer,
+                                     const string& host,
+                                     const string& user_agent)
+    : path_(path),
+      referrer_(referrer),
+      host_(host),
+      user_agent_(user_agent) { }
+
+
+void ParseOptions(int argc,
+                  char* argv[],
+                  map<string, string>* options,
+                  string* file) {
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    size_t index = arg.find('=', 0);
+    if (index == string::npos) {
+      *file = arg;
+    } else {
+      string key = arg.substr(0, index);
+      string value = arg.substr(index+1);
+      (*options)[key] = value;
+    }
+  }
+}
+
+
+bool ReadFileContents(const string& name, string* contents) {
+  FILE* file = fopen(name.c_str(), "rb");
+  if (file == NULL) return false;
+
+  fseek(file, 0, SEEK_END);
+  size_t size = ftell(file);
+  rewind(file);
+
+  contents->resize(size);
+  for (size_t i = 0; i < size;) {
+    i += fread(&(*contents)[i], 1, size - i, file);
+    if (ferror(file)) {
+      fclose(file);
+      return false;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+
+bool WriteFileContents(const string& name, const char* data, size_t size) {
+  FILE* file = fopen(name.c_str(), "wb");
+  if (file == NULL) return false;
+  bool ok = fwrite(data, 1, size, file) == size;
+  return fclose(file) == 0 && ok;
+}
+
+
+void InitCreateParams(const ProcessorConfig& config,
+                      Isolate::CreateParams* create_params) {
+  create_params->array_buffer_allocator_shared =
+      NewArrayBufferAllocator(config.allocator);
+  SetHeapLimits(config.max_young_mb, config.max_old_mb, create_params);
+  if (config.snapshot != NULL) {
+    create_params->snapshot_blob = config.snapshot;
+    create_params->external_references =
+        JsHttpRequestProcessor::ExternalReferences();
+  }
+}
+
+
+ProcessorConfig::ProcessorConfig()
+    : snapshot(NULL),
+      code_cache(NULL),
+      batch_size(1),
+      native_store(false),
+      count_allocations(false),
+      time_budget_ms(0),
+      max_young_mb(0),
+      max_old_mb(0),
+      heap_limit_policy(JsHttpRequestProcessor::kHeapLimitNone),
+      heap_snapshot_threshold(0),
+      memory_monitor(NULL),
+      metrics_exporter(NULL),
+      allocator(kDefaultAllocator) {
+  snapshot_blob.data = NULL;
+  snapshot_blob.raw_size = 0;
+}
+
+
+JsHttpRequestProcessor* NewProcessor(Isolate* isolate,
+                                     const ProcessorConfig& config) {
+  JsHttpRequestProcessor* processor;
+  if (config.snapshot != NULL) {
+    processor = new JsHttpRequestProcessor(isolate);
+  } else {
+    Local<String> script =
+        SourceFile::NewString(isolate, config.source).ToLocalChecked();
+    processor = new JsHttpRequestProcessor(isolate, script);
+    processor->set_code_cache(config.code_cache);
+    processor->set_use_native_store(config.native_store);
+  }
+  processor->set_count_allocations(config.count_allocations);
+  processor->set_time_budget(config.time_budget_ms);
+  processor->set_heap_limit_policy(config.heap_limit_policy);
+  if (config.heap_snapshot_threshold > 0) {
+    processor->set_heap_snapshot(config.heap_snapshot_threshold,
+                                 config.heap_snapshot_file);
+  }
+  processor->set_memory_monitor(config.memory_monitor);
+  processor->set_metrics_exporter(config.metrics_exporter);
+  processor->set_cpu_profile(config.cpu_profile);
+  if (config.wasm != NULL) processor->set_wasm_module(config.wasm);
+  return processor;
+}
+
+
+// Returns the batch size requested through the 'batch' option.
+static int GetBatchSize(const map<string, string>& options) {
+  map<string, string>::const_iterator iter = options.find("batch");
+  if (iter == options.end()) return 1;
+  int size = atoi(iter->second.c_str());
+  return size < 1 ? 1 : size;
+}
+
+
+// Returns the value of a size option, or 0 if it is not given.
+static size_t GetSizeOption(const map<string, string>& options,
+                            const string& key) {
+  map<string, string>::const_iterator iter = options.find(key);
+  if (iter == options.end()) return 0;
+  return static_cast<size_t>(strtoull(iter->second.c_str(), NULL, 10));
+}
+
+
+bool ConfigureProcessor(const map<string, string>& options,
+                        const string& file, ProcessorConfig* config) {
+  // 'snapshot=<blob>' boots the processors from a snapshot made with
+  // 'snapshot_out=<blob>' instead of running the script.
+  map<string, string>::const_iterator snapshot_file = options.find("snapshot");
+  if (snapshot_file != options.end()) {
+    if (!ReadFileContents(snapshot_file->second, &config->snapshot_data)) {
+      fprintf(stderr, "Error reading snapshot '%s'.\n",
+              snapshot_file->second.c_str());
+      return false;
+    }
+    config->snapshot_blob.data = config->snapshot_data.data();
+    config->snapshot_blob.raw_size =
+        static_cast<int>(config->snapshot_data.size());
+    if (!config->snapshot_blob.IsValid()) {
+      fprintf(stderr, "Snapshot '%s' was not made by this V8 build.\n",
+              snapshot_file->second.c_str());
+      return false;
+    }
+    config->snapshot = &config->snapshot_blob;
+  } else if (file.empty()) {
+    fprintf(stderr, "No script was specified.\n");
+    return false;
+  } else if ((config->source = SourceFile::Open(file)) == NULL) {
+    fprintf(stderr, "Error reading '%s'.\n", file.c_str());
+    return false;
+  }
+
+  config->batch_size = GetBatchSize(options);
+  // 'store=native' keeps the options and output in native hash tables
+  // instead of std::maps.  Snapshots carry their own map wrappers, so
+  // this only applies when running the script.
+  map<string, string>::const_iterator store = options.find("store");
+  config->native_store = store != options.end() && store->second == "native";
+  config->count_allocations = options.count("alloc_stats") > 0;
+  // 'budget_ms=<n>' terminates requests that run for longer than that.
+  map<string, string>::const_iterator budget = options.find("budget_ms");
+  if (budget != options.end()) {
+    config->time_budget_ms = atoi(budget->second.c_str());
+  }
+
+  // 'heap_young_mb=<n>' and 'heap_old_mb=<n>' limit the generations,
+  // 'heap_limit=gc|shed|restart' picks what happens when the heap gets
+  // close to the limit, and 'heap_snapshot_mb=<n>' writes a snapshot to
+  // 'heap_snapshot=<file>' once more than n megabytes are in use.
+  config->max_young_mb = GetSizeOption(options, "heap_young_mb");
+  config->max_old_mb = GetSizeOption(options, "heap_old_mb");
+  map<string, string>::const_iterator policy = options.find("heap_limit");
+  if (policy != options.end()) {
+    if (policy->second == "gc") {
+      config->heap_limit_policy = JsHttpRequestProcessor::kHeapLimitGC;
+    } else if (policy->second == "shed") {
+      config->heap_limit_policy = JsHttpRequestProcessor::kHeapLimitShed;
+    } else if (policy->second == "restart") {
+      config->heap_limit_policy = JsHttpRequestProcessor::kHeapLimitRestart;
+    } else {
+      fprintf(stderr, "Unknown heap limit policy '%s'.\n",
+              policy->second.c_str());
+      return false;
+    }
+  }
+  config->heap_snapshot_threshold = GetSizeOption(options, "heap_snapshot_mb")
+                                    << 20;
+  map<string, string>::const_iterator heap_snapshot =
+      options.find("heap_snapshot");
+  config->heap_snapshot_file = heap_snapshot != options.end()
+                                   ? heap_snapshot->second
+                                   : "process.heapsnapshot";
+
+  // 'memory_events=<file>' passes the memory pressure reported in a
+  // cgroup's memory.events file on to the processors.
+  map<string, string>::const_iterator memory_events =
+      options.find("memory_events");
+  if (memory_events != options.end()) {
+    config->memory_monitor_storage.reset(new MemoryPressureMonitor());
+    if (!config->memory_monitor_storage->Start(memory_events->second)) {
+      fprintf(stderr, "Error watching '%s'.\n",
+              memory_events->second.c_str());
+      return false;
+    }
+    config->memory_monitor = config->memory_monitor_storage.get();
+  }
+
+  // 'metrics=<file>' writes the stage metrics of all processors to the
+  // file every 'metrics_interval_ms' (10 s by default), as JSON if the
+  // file name ends in .json or 'metrics_format=json' is given and as
+  // Prometheus text otherwise.
+  map<string, string>::const_iterator metrics = options.find("metrics");
+  if (metrics != options.end()) {
+    const string& name = metrics->second;
+    map<string, string>::const_iterator format =
+        options.find("metrics_format");
+    bool json = format != options.end()
+                    ? format->second == "json"
+                    : name.size() >= 5 &&
+                          name.compare(name.size() - 5, 5, ".json") == 0;
+    size_t interval = GetSizeOption(options, "metrics_interval_ms");
+    config->metrics_exporter_storage.reset(new MetricsExporter(
+        name, json ? MetricsExporter::kJson : MetricsExporter::kPrometheus,
+        interval > 0 ? static_cast<int>(interval) : 10000));
+    config->metrics_exporter = config->metrics_exporter_storage.get();
+  }
+
+  // 'cpu_profile=<file>' profiles the script and writes the profile to
+  // the file for DevTools, sampling every 'cpu_profile_interval_us'.
+  // Profiling starts after 'cpu_profile_start' requests, or only on
+  // SIGUSR2 with 'cpu_profile_start=signal', and stops after
+  // 'cpu_profile_requests' requests, on the next SIGUSR2 or at exit.
+  map<string, string>::const_iterator cpu_profile =
+      options.find("cpu_profile");
+  if (cpu_profile != options.end()) {
+    config->cpu_profile.file = cpu_profile->second;
+    config->cpu_profile.interval_us =
+        static_cast<int>(GetSizeOption(options, "cpu_profile_interval_us"));
+    map<string, string>::const_iterator start =
+        options.find("cpu_profile_start");
+    if (start != options.end() && start->second == "signal") {
+      config->cpu_profile.wait_for_signal = true;
+    } else {
+      config->cpu_profile.start_after =
+          static_cast<int>(GetSizeOption(options, "cpu_profile_start"));
+    }
+    config->cpu_profile.requests =
+        static_cast<int>(GetSizeOption(options, "cpu_profile_requests"));
+    ScriptProfiler::InstallSignalHandler();
+  }
+
+  // 'wasm=<file>' hands the requests to the process function of the
+  // WebAssembly module in the file; see set_wasm_module.
+  map<string, string>::const_iterator wasm = options.find("wasm");
+  if (wasm != options.end() &&
+      (config->wasm = SourceFile::Open(wasm->second)) == NULL) {
+    fprintf(stderr, "Error reading '%s'.\n", wasm->second.c_str());
+    return false;
+  }
+
+  // 'allocator=pooled' gives the processor isolates PooledAllocators,
+  // and 'allocator=huge' ones backing large buffers with huge pages.
+  map<string, string>::const_iterator allocator = options.find("allocator");
+  if (allocator != options.end() &&
+      !ParseAllocatorKind(allocator->second, &config->allocator)) {
+    fprintf(stderr, "Unknown allocator '%s'.\n", allocator->second.c_str());
+    return false;
+  }
+
+  // 'code_cache=<dir>' compiles the script through a code cache kept in
+  // the given directory.
+  map<string, string>::const_iterator code_cache_dir =
+      options.find("code_cache");
+  if (code_cache_dir != options.end()) {
+    config->code_cache_storage.reset(new CodeCache(code_cache_dir->second));
+    config->code_cache = config->code_cache_storage.get();
+  }
+  return true;
+}
+
+
+void DrainMessageLoop(v8::Platform* platform, Isolate* isolate,
+                      StageMetrics* metrics) {
+  StageTimer timer(metrics, kStagePump);
+  while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
+}
@@ -0,0 +1,700 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef HTTP_PROCESSOR_H_
+#define HTTP_PROCESSOR_H_
+
+#include <include/v8.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "code_cache.h"
+#include "cpu_profile.h"
+#include "heap_control.h"
+#include "metrics.h"
+#include "pooled_allocator.h"
+#include "source_file.h"
+#include "watchdog.h"
+
+
+// These interfaces represent an existing request processing interface.
+// The idea is to imagine a real application that uses these interfaces
+// and then add scripting capabilities that allow you to interact with
+// the objects through JavaScript.
+
+/**
+ * A simplified http request.
+ */
+class HttpRequest {
+ public:
+  virtual ~HttpRequest() { }
+  virtual std::string_view Path() = 0;
+  virtual std::string_view Referrer() = 0;
+  virtual std::string_view Host() = 0;
+  virtual std::string_view UserAgent() = 0;
+
+  // Returns true if the strings viewed above stay valid, at the same
+  // address, for as long as the isolate processing the request lives.
+  // Their contents can then be handed to scripts without copying.
+  virtual bool IsStorageStable() { return false; }
+};
+
+
+/**
+ * The abstract superclass of http request processors.
+ */
+class HttpRequestProcessor {
+ public:
+  virtual ~HttpRequestProcessor() { }
+
+  // Initialize this processor.  The map contains options that control
+  // how requests should be processed.
+  virtual bool Initialize(std::map<std::string, std::string>* options,
+                          std::map<std::string, std::string>* output) = 0;
+
+  // Process a single request.
+  virtual bool Process(HttpRequest* req) = 0;
+
+  // Process a batch of requests.  results[i] is set to whether reqs[i]
+  // was processed successfully, and the return value tells whether all
+  // of them were.  By default this processes the requests one by one.
+  virtual bool ProcessBatch(HttpRequest** reqs, int count, bool* results);
+
+  static void Log(const char* event);
+};
+
+
+/**
+ * Maps the values of low-cardinality request fields, such as the host,
+ * to internalized strings so that all requests with the same value
+ * share one string instead of each allocating their own.  The table
+ * stops growing at a fixed size so high-cardinality values cannot fill
+ * up the old generation; those are returned as ordinary strings.
+ */
+class StringInternTable {
+ public:
+  static const size_t kMaxSize = 4096;
+
+  v8::Local<v8::String> Get(v8::Isolate* isolate, std::string_view value);
+
+ private:
+  // The table is keyed by views of the copies in keys_, which never
+  // move, so lookups do not need to build a std::string.
+  std::deque<std::string> keys_;
+  std::unordered_map<std::string_view, v8::Global<v8::String> > strings_;
+};
+
+
+/**
+ * A native replacement for the std::map behind the options and output
+ * objects, tuned for scripts that update the same few keys on every
+ * request.  Keys live in an open-addressing hash table, and a small
+ * cache maps the identity of the (internalized) V8 property names seen
+ * recently to their slots, so most lookups never convert the name to a
+ * std::string.  Numbers are kept unboxed and only turned into strings
+ * when the store is copied out.
+ */
+class NativeStore {
+ public:
+  struct Entry {
+    Entry() : hash(0), used(false), is_number(false), number(0) {}
+    std::string key;
+    uint64_t hash;
+    bool used;
+    bool is_number;
+    double number;
+    std::string value;
+  };
+
+  NativeStore();
+
+  // Returns the slot of the key with the given name, adding the key if
+  // add is true.  Returns -1 if the key is absent and add is false.
+  int Lookup(v8::Isolate* isolate, v8::Local<v8::Name> name, bool add);
+  Entry* At(int slot) { return &entries_[slot]; }
+
+  void Set(const std::string& key, const std::string& value);
+  void CopyFrom(const std::map<std::string, std::string>& from);
+  void CopyTo(std::map<std::string, std::string>* to) const;
+
+ private:
+  static const size_t kInitialCapacity = 64;
+  static const int kKeyCacheSize = 256;
+
+  struct CachedKey {
+    v8::Global<v8::Name> name;
+    int slot;
+  };
+
+  static uint64_t Hash(const char* key, size_t length);
+
+  // Returns the slot holding the key, or the empty slot it would go in.
+  int FindSlot(const char* key, size_t length, uint64_t hash) const;
+  int Add(const char* key, size_t length, uint64_t hash);
+  void Grow();
+
+  std::vector<Entry> entries_;
+  size_t size_;
+  CachedKey key_cache_[kKeyCacheSize];
+};
+
+
+/**
+ * An http request processor that is scriptable using JavaScript.
+ */
+class JsHttpRequestProcessor : public HttpRequestProcessor {
+ public:
+  // Creates a new processor that processes requests by invoking the
+  // Process function of the JavaScript script given as an argument.
+  JsHttpRequestProcessor(v8::Isolate* isolate, v8::Local<v8::String> script)
+      : isolate_(isolate),
+        script_(isolate, script),
+        from_snapshot_(false),
+        code_cache_(NULL),
+        use_native_store_(false),
+        output_(NULL),
+        wrappers_allocated_(0),
+        count_allocations_(false),
+        gc_count_(0),
+        requests_measured_(0),
+        heap_bytes_allocated_(0),
+        timeouts_(0),
+        dropped_requests_(0),
+        options_(NULL),
+        heap_limit_policy_(kHeapLimitNone),
+        near_heap_limit_(false),
+        shedding_(false),
+        shed_since_gc_(0),
+        initial_heap_limit_(0),
+        heap_limit_hits_(0),
+        shed_requests_(0),
+        terminated_requests_(0),
+        restarts_(0),
+        restart_failed_requests_(0),
+        heap_snapshot_threshold_(0),
+        heap_checks_(0),
+        memory_monitor_(NULL),
+        metrics_exporter_(NULL),
+        wasm_base_(NULL),
+        wasm_buffer_size_(0),
+        wasm_area_(0),
+        wasm_area_size_(0) {}
+  // Creates a processor whose context, with the script already run in
+  // it, is the default context of the snapshot the isolate was created
+  // from (see CreateSnapshot).
+  explicit JsHttpRequestProcessor(v8::Isolate* isolate)
+      : isolate_(isolate),
+        from_snapshot_(true),
+        code_cache_(NULL),
+        use_native_store_(false),
+        output_(NULL),
+        wrappers_allocated_(0),
+        count_allocations_(false),
+        gc_count_(0),
+        requests_measured_(0),
+        heap_bytes_allocated_(0),
+        timeouts_(0),
+        dropped_requests_(0),
+        options_(NULL),
+        heap_limit_policy_(kHeapLimitNone),
+        near_heap_limit_(false),
+        shedding_(false),
+        shed_since_gc_(0),
+        initial_heap_limit_(0),
+        heap_limit_hits_(0),
+        shed_requests_(0),
+        terminated_requests_(0),
+        restarts_(0),
+        restart_failed_requests_(0),
+        heap_snapshot_threshold_(0),
+        heap_checks_(0),
+        memory_monitor_(NULL),
+        metrics_exporter_(NULL),
+        wasm_base_(NULL),
+        wasm_buffer_size_(0),
+        wasm_area_(0),
+        wasm_area_size_(0) {}
+  virtual ~JsHttpRequestProcessor();
+
+  // Compile the script through the given code cache.  The cache must
+  // outlive Initialize.
+  void set_code_cache(CodeCache* code_cache) { code_cache_ = code_cache; }
+
+  // Back the options and output objects with NativeStores instead of
+  // the maps given to Initialize.  The output only reaches the map
+  // when SyncOutput is called.
+  void set_use_native_store(bool use) { use_native_store_ = use; }
+
+  // Copies the native output store into the output map.
+  void SyncOutput();
+
+  // Measure how much heap every Process call allocates.  This samples
+  // the heap statistics around each call, so it is for checking, not
+  // for production.
+  void set_count_allocations(bool count);
+  void PrintAllocationStats(FILE* out);
+
+  // Terminate script calls that run for longer than the given number of
+  // milliseconds per request; 0 lets them run for as long as they like.
+  // A terminated request fails and the processor carries on with the
+  // next one.
+  void set_time_budget(int budget_ms);
+  // The number of calls that ran out of time.
+  int timeouts() const { return timeouts_; }
+
+  // The number of requests that failed because the processor gave up on
+  // them rather than because the script did.  The isolate is still
+  // usable after those, so drivers count them and go on: a failed call
+  // is only an error if this did not change.
+  int dropped_requests() const { return dropped_requests_; }
+
+  // What to do when the heap comes close to its limit.  V8 gets some
+  // headroom beyond the limit so the current request can unwind.
+  enum HeapLimitPolicy {
+    kHeapLimitNone,
+    // Collect all garbage once the current request is done.  The heap
+    // may grow to twice its limit before V8 gives up.
+    kHeapLimitGC,
+    // Fail the current request, and fail further requests until garbage
+    // collection brings the heap down to half its limit.
+    kHeapLimitShed,
+    // Fail the current request and start over in a fresh context,
+    // dropping whatever the script has accumulated.
+    kHeapLimitRestart
+  };
+  void set_heap_limit_policy(HeapLimitPolicy policy);
+  int heap_limit_hits() const { return heap_limit_hits_; }
+  // Shed requests, requests terminated at the limit and requests that
+  // found nothing to call after a failed restart are all dropped (see
+  // dropped_requests).
+  int shed_requests() const { return shed_requests_; }
+  int terminated_requests() const { return terminated_requests_; }
+  int restarts() const { return restarts_; }
+  int restart_failed_requests() const { return restart_failed_requests_; }
+
+  // Write a heap snapshot to the given file, once, when the used heap is
+  // seen above the threshold after a request.
+  void set_heap_snapshot(size_t threshold, const std::string& file);
+
+  // Pass the memory pressure seen by the monitor on to this processor's
+  // isolate.  The monitor must outlive the processor.
+  void set_memory_monitor(MemoryPressureMonitor* monitor);
+
+  // Prints the heap statistics and how often the heap limit was hit.
+  void PrintHeapStatistics(FILE* out);
+
+  // Times spent in the stages of Initialize and Process.  Drivers add
+  // the time they spend draining the message loop.
+  StageMetrics* metrics() { return &metrics_; }
+  // Export the metrics through the given exporter, which must outlive
+  // the processor.
+  void set_metrics_exporter(MetricsExporter* exporter);
+
+  // Profile the script over the window of requests given in the
+  // options, or whenever SIGUSR2 says so.
+  void set_cpu_profile(const CpuProfileOptions& options);
+
+  // Hand requests to the exported process function of a WebAssembly
+  // module instead of to the script's Process.  The module is
+  // instantiated in the processor's context once the script has run,
+  // with the script's global 'wasmImports' as its imports, and must
+  // export
+  //
+  //   memory             its linear memory
+  //   process()          returns 0 if the request failed
+  //   request_area       the address of a region reserved for requests
+  //   request_area_size  and its size in bytes
+  //
+  // the last two as numbers or WebAssembly.Globals.  Each request is
+  // written straight into the region: kWasmFieldCount pairs of
+  // little-endian u32 offsets and lengths of the path, referrer, host
+  // and user agent, relative to the start of the region, followed by
+  // their bytes.  No strings are made for it on the way.  Requests that
+  // do not fit fail.
+  void set_wasm_module(const std::shared_ptr<SourceFile>& wasm) {
+    wasm_module_ = wasm;
+  }
+
+  virtual bool Initialize(std::map<std::string, std::string>* opts,
+                          std::map<std::string, std::string>* output);
+  virtual bool Process(HttpRequest* req);
+
+  // If the script defines a ProcessBatch function, the whole batch is
+  // handed to it in one call as an array of request objects.  It may
+  // return an array in which 'false' marks the requests that failed;
+  // anything else means they all succeeded.  Scripts without
+  // ProcessBatch get one Process call per request.
+  virtual bool ProcessBatch(HttpRequest** reqs, int count, bool* results);
+
+  // Builds a startup snapshot holding an initialized processor context:
+  // the global template with 'log', the options and output maps and the
+  // top-level state of the script after running it with the given
+  // options.  Isolates created from the blob must be given
+  // ExternalReferences() as their external references.  The caller
+  // owns blob->data.
+  static bool CreateSnapshot(const std::string& source,
+                             std::map<std::string, std::string>* opts,
+                             v8::StartupData* blob);
+
+  // The native callbacks that a snapshot may refer to, NULL terminated.
+  static const intptr_t* ExternalReferences();
+
+ private:
+  // Indices of the templates added to the snapshot with AddData.
+  static const size_t kRequestTemplateIndex = 0;
+  static const size_t kMapTemplateIndex = 1;
+
+  // The isolate data slot holding the processor running in the isolate.
+  static const uint32_t kProcessorSlot = 0;
+
+  // Internal fields of request wrappers: the request itself and the
+  // strings already made for its path and referrer.
+  static const int kRequestField = 0;
+  static const int kPathField = 1;
+  static const int kReferrerField = 2;
+  static const int kRequestFieldCount = 3;
+
+  // Fields shorter than this are copied rather than exposed as external
+  // strings; the resource would cost more than the copy.
+  static const size_t kMinExternalFieldLength = 32;
+
+  // The request fields written to the request area of a WebAssembly
+  // module, and the size of the offsets and lengths ahead of them.
+  static const int kWasmFieldCount = 4;
+  static const size_t kWasmHeaderSize = kWasmFieldCount * 8;
+
+  // Picks up the context from the isolate's startup snapshot and points
+  // its options and output maps at the given ones.
+  bool InitializeFromSnapshot(std::map<std::string, std::string>* opts,
+                              std::map<std::string, std::string>* output);
+
+  // Fetch the Process and ProcessBatch functions from the global object.
+  bool FetchProcessFunction(v8::Local<v8::Context> context);
+
+  // Call the script's Process or ProcessBatch function.
+  bool CallProcess(HttpRequest* req);
+  bool CallProcessBatch(HttpRequest** reqs, int count, bool* results);
+
+  // Instantiate the WebAssembly module and fetch its exports.
+  bool InstantiateWasm(v8::Local<v8::Context> context);
+  // Write a request into the module's request area and call its
+  // process function.
+  bool CallWasmProcess(HttpRequest* req);
+  // Returns where the request area is in memory right now, or NULL if
+  // it is not within the module's memory.
+  uint8_t* GetWasmRequestArea();
+
+  // Makes the isolate usable again after the watchdog terminated a call
+  // that was handling count requests, the first of which is given.
+  void RecoverFromTimeout(HttpRequest* request, int count);
+
+  // Shed requests are counted until it is time to see whether garbage
+  // collection brought the heap back down.
+  static const int kShedRetryInterval = 64;
+  // The used heap is checked against the snapshot threshold this often.
+  static const int kHeapCheckInterval = 256;
+
+  static size_t OnNearHeapLimit(void* data, size_t current_heap_limit,
+                                size_t initial_heap_limit);
+  // Applies the heap limit policy and the heap snapshot threshold after
+  // a call into the script.
+  void AfterCall(int requests);
+  // Returns true if requests are being shed and this one should be too.
+  bool ShedRequest();
+  // Drops the old context, collects garbage and runs the script again in
+  // a fresh context.
+  bool Restart();
+
+  size_t UsedHeapSize();
+  static void OnGarbageCollection(v8::Isolate* isolate, v8::GCType type,
+                                  v8::GCCallbackFlags flags, void* data);
+
+  // Execute the script associated with this processor and extract the
+  // Process function.  Returns true if this succeeded, otherwise false.
+  bool ExecuteScript(v8::Local<v8::String> script);
+
+  // Wrap the options and output map in a JavaScript objects and
+  // install it in the global namespace as 'options' and 'output'.
+  bool InstallMaps(std::map<std::string, std::string>* opts,
+                   std::map<std::string, std::string>* output);
+
+  // Constructs the template that describes the JavaScript wrapper
+  // type for requests.
+  static v8::Local<v8::ObjectTemplate> MakeRequestTemplate(
+      v8::Isolate* isolate);
+  static v8::Local<v8::ObjectTemplate> MakeMapTemplate(v8::Isolate* isolate);
+
+  // Callbacks that access the individual fields of request objects.
+  static void GetPath(v8::Local<v8::String> name,
+                      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void GetReferrer(v8::Local<v8::String> name,
+                          const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void GetHost(v8::Local<v8::String> name,
+                      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void GetUserAgent(v8::Local<v8::String> name,
+                           const v8::PropertyCallbackInfo<v8::Value>& info);
+
+  // Returns the string for a request field, creating it on the first
+  // read and caching it in the given internal field of the wrapper.
+  static v8::Local<v8::String> GetFieldString(v8::Local<v8::Object> holder,
+                                              int field, HttpRequest* request,
+                                              std::string_view value);
+
+  static JsHttpRequestProcessor* FromIsolate(v8::Isolate* isolate) {
+    return static_cast<JsHttpRequestProcessor*>(
+        isolate->GetData(kProcessorSlot));
+  }
+
+  // Point the map wrapper stored in the given global property at a C++
+  // map, or at nothing if target is NULL.
+  bool AttachMap(v8::Local<v8::Context> context, const char* name,
+                 std::map<std::string, std::string>* target);
+
+  // Callbacks that access maps
+  static void MapGet(v8::Local<v8::Name> name,
+                     const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void MapSet(v8::Local<v8::Name> name, v8::Local<v8::Value> value,
+                     const v8::PropertyCallbackInfo<v8::Value>& info);
+
+  // Callbacks that access native stores
+  static void NativeStoreGet(v8::Local<v8::Name> name,
+                             const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void NativeStoreSet(v8::Local<v8::Name> name,
+                             v8::Local<v8::Value> value,
+                             const v8::PropertyCallbackInfo<v8::Value>& info);
+  static v8::Local<v8::ObjectTemplate> MakeNativeStoreTemplate(
+      v8::Isolate* isolate);
+
+  // Utility methods for wrapping C++ objects as JavaScript objects,
+  // and going back again.
+  v8::Local<v8::Object> WrapMap(std::map<std::string, std::string>* obj);
+  static std::map<std::string, std::string>* UnwrapMap(
+      v8::Local<v8::Object> obj);
+  v8::Local<v8::Object> WrapNativeStore(NativeStore* obj);
+  static NativeStore* UnwrapNativeStore(v8::Local<v8::Object> obj);
+  v8::Local<v8::Object> WrapRequest(HttpRequest* obj, size_t index = 0);
+  static HttpRequest* UnwrapRequest(v8::Local<v8::Object> obj);
+  v8::Local<v8::ObjectTemplate> GetRequestTemplate();
+  v8::Local<v8::ObjectTemplate> GetMapTemplate();
+
+  v8::Isolate* GetIsolate() { return isolate_; }
+
+  v8::Isolate* isolate_;
+  v8::Global<v8::String> script_;
+  bool from_snapshot_;
+  CodeCache* code_cache_;
+  bool use_native_store_;
+  NativeStore options_store_;
+  NativeStore output_store_;
+  std::map<std::string, std::string>* output_;
+  v8::Global<v8::Context> context_;
+  v8::Global<v8::Function> process_;
+  v8::Global<v8::Function> process_batch_;
+  // Templates belong to the isolate they were created in, so each
+  // processor keeps its own rather than sharing them process-wide.
+  v8::Global<v8::ObjectTemplate> request_template_;
+  v8::Global<v8::ObjectTemplate> map_template_;
+  v8::Global<v8::ObjectTemplate> native_store_template_;
+  StringInternTable hosts_;
+  StringInternTable user_agents_;
+  // The pooled request wrappers and the array batches are passed in.
+  // Scripts must not hold on to request objects across calls, since
+  // the same object is handed out again for a later request.
+  std::vector<v8::Global<v8::Object> > request_wrappers_;
+  v8::Global<v8::Array> batch_array_;
+  int wrappers_allocated_;
+  // Set when counting allocations; see set_count_allocations.
+  bool count_allocations_;
+  int gc_count_;
+  int requests_measured_;
+  size_t heap_bytes_allocated_;
+  std::unique_ptr<Watchdog> watchdog_;
+  int timeouts_;
+  int dropped_requests_;
+  // Kept for restarts.
+  std::map<std::string, std::string>* options_;
+  HeapLimitPolicy heap_limit_policy_;
+  // Set by OnNearHeapLimit, which runs inside V8, and acted upon once
+  // the call into the script has returned.
+  bool near_heap_limit_;
+  bool shedding_;
+  int shed_since_gc_;
+  size_t initial_heap_limit_;
+  int heap_limit_hits_;
+  int shed_requests_;
+  int terminated_requests_;
+  int restarts_;
+  int restart_failed_requests_;
+  size_t heap_snapshot_threshold_;
+  std::string heap_snapshot_file_;
+  int heap_checks_;
+  MemoryPressureMonitor* memory_monitor_;
+  StageMetrics metrics_;
+  MetricsExporter* metrics_exporter_;
+  std::unique_ptr<ScriptProfiler> cpu_profiler_;
+  // Set when requests go to a WebAssembly module; see set_wasm_module.
+  std::shared_ptr<SourceFile> wasm_module_;
+  v8::Global<v8::Function> wasm_process_;
+  v8::Global<v8::WasmMemoryObject> wasm_memory_;
+  // The buffer of the memory the last request was written to, and
+  // where it is.  Growing the memory replaces the buffer.
+  v8::Global<v8::ArrayBuffer> wasm_buffer_;
+  uint8_t* wasm_base_;
+  size_t wasm_buffer_size_;
+  uint32_t wasm_area_;
+  uint32_t wasm_area_size_;
+};
+
+
+/**
+ * A simplified http request.
+ */
+class StringHttpRequest : public HttpRequest {
+ public:
+  StringHttpRequest(const std::string& path,
+                    const std::string& referrer,
+                    const std::string& host,
+                    const std::string& user_agent);
+  virtual std::string_view Path() { return path_; }
+  virtual std::string_view Referrer() { return referrer_; }
+  virtual std::string_view Host() { return host_; }
+  virtual std::string_view UserAgent() { return user_agent_; }
+ private:
+  std::string path_;
+  std::string referrer_;
+  std::string host_;
+  std::string user_agent_;
+};
+
+
+// --- Driver support ---
+
+
+/**
+ * How processors are created and fed.
+ */
+struct ProcessorConfig {
+  ProcessorConfig();
+
+  // The script source, used unless there is a snapshot.  Every processor
+  // isolate's copy of the script is backed by the same mapping when the
+  // source allows it.
+  std::shared_ptr<SourceFile> source;
+  // The snapshot to boot processor isolates from, or NULL.
+  v8::StartupData* snapshot;
+  // The code cache to compile the script through, or NULL.
+  CodeCache* code_cache;
+  // The number of requests handed to ProcessBatch at once; 1 calls
+  // Process for every request.
+  int batch_size;
+  // Whether to back the options and output objects with native stores.
+  bool native_store;
+  // Whether to measure and print what every request allocates.
+  bool count_allocations;
+  // The time budget of a request in milliseconds, or 0 for none.
+  int time_budget_ms;
+  // Generation limits in megabytes, 0 for V8's defaults.
+  size_t max_young_mb;
+  size_t max_old_mb;
+  JsHttpRequestProcessor::HeapLimitPolicy heap_limit_policy;
+  // Where and above how many used heap bytes to write a heap snapshot;
+  // 0 for never.
+  size_t heap_snapshot_threshold;
+  std::string heap_snapshot_file;
+  // The monitor passing on cgroup memory pressure, or NULL.
+  MemoryPressureMonitor* memory_monitor;
+  // The exporter writing out stage metrics, or NULL.
+  MetricsExporter* metrics_exporter;
+  // When to profile the script; off unless a file is set.
+  CpuProfileOptions cpu_profile;
+  // The ArrayBuffer allocator of processor isolates.
+  ArrayBufferAllocatorKind allocator;
+  // The WebAssembly module handling the requests, or NULL to have the
+  // script handle them.
+  std::shared_ptr<SourceFile> wasm;
+
+  // Storage for the snapshot and code cache above, if they were set up
+  // by ConfigureProcessor.
+  std::string snapshot_data;
+  v8::StartupData snapshot_blob;
+  std::unique_ptr<CodeCache> code_cache_storage;
+  std::unique_ptr<MemoryPressureMonitor> memory_monitor_storage;
+  std::unique_ptr<MetricsExporter> metrics_exporter_storage;
+};
+
+
+// Sets up a processor config from the processor options (snapshot,
+// code_cache, store, batch, alloc_stats, budget_ms, metrics, wasm,
+// allocator and the heap and cpu_profile options), reading the script
+// from file unless a snapshot is given.  Prints what went wrong and
+// returns false if something could not be set up.
+bool ConfigureProcessor(const std::map<std::string, std::string>& options,
+                        const std::string& file, ProcessorConfig* config);
+
+// Sets up the parameters for a processor isolate, including its heap
+// limits and ArrayBuffer allocator.  If the config has a snapshot the
+// isolate boots from it.
+void InitCreateParams(const ProcessorConfig& config,
+                      v8::Isolate::CreateParams* create_params);
+
+// Creates the processor for an isolate, either from the script source
+// or, if the isolate was booted from a snapshot, from its context.
+JsHttpRequestProcessor* NewProcessor(v8::Isolate* isolate,
+                                     const ProcessorConfig& config);
+
+// Drains the platform's message loop for the isolate, timing it as the
+// pump stage.
+void DrainMessageLoop(v8::Platform* platform, v8::Isolate* isolate,
+                      StageMetrics* metrics);
+
+// Splits the command line into key=value options and the script file.
+void ParseOptions(int argc, char* argv[],
+                  std::map<std::string, std::string>* options,
+                  std::string* file);
+
+// Reads the contents of a file into a std::string.
+bool ReadFileContents(const std::string& name, std::string* contents);
+
+// Writes data to a file, replacing its contents.
+bool WriteFileContents(const std::string& name, const char* data,
+                       size_t size);
+
+// Converts a number to a string the way JavaScript does for the
+// values count style scripts produce.
+std::string NumberToString(double value);
+
+#endif  // HTTP_PROCESSOR_H_
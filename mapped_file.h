@@ -0,0 +1,51 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <include/v8.h>
+
+/**
+ * Maps a file into memory and returns an ArrayBuffer over the mapping.
+ * Nothing is copied: pages are read from the file as the script touches
+ * them, and the mapping is released when the buffer is collected, so
+ * files much larger than the heap can be scanned through typed arrays.
+ *
+ * The mapping is private.  Writes through the buffer land in private
+ * copies of the pages they touch and never reach the file.  Changes to
+ * the file may still show up in pages not written through the buffer,
+ * and touching a page beyond the end of a file truncated since
+ * kills the process with SIGBUS.  Replace mapped files by renaming a
+ * new file over them rather than by rewriting them in place.
+ *
+ * Returns an empty handle if the file cannot be mapped.
+ */
+v8::MaybeLocal<v8::ArrayBuffer> MapFileToArrayBuffer(v8::Isolate* isolate,
+                                                     const char* name);
+
+#endif  // MAPPED_FILE_H_
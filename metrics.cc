@@ -0,0 +1,184 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "metrics.h"
+
+#include <stdio.h>
+
+using std::string;
+
+
+const char* StageName(Stage stage) {
+  switch (stage) {
+    case kStageCompile: return "compile";
+    case kStageRun: return "run";
+    case kStageWrap: return "wrap";
+    case kStageCall: return "call";
+    case kStageException: return "exception";
+    case kStagePump: return "pump";
+    default: return "unknown";
+  }
+}
+
+
+void StageMetrics::AddTo(Counters* counters) const {
+  for (int stage = 0; stage < kStageCount; stage++) {
+    const Histogram& histogram = stages_[stage];
+    Counters* sum = &counters[stage];
+    sum->total_ns += histogram.total_ns.load(std::memory_order_relaxed);
+    for (int i = 0; i < kBucketCount; i++) {
+      uint64_t count = histogram.buckets[i].load(std::memory_order_relaxed);
+      sum->buckets[i] += count;
+      sum->count += count;
+    }
+  }
+}
+
+
+MetricsExporter::MetricsExporter(const string& file, Format format,
+                                 int interval_ms)
+    : file_(file), format_(format), interval_ms_(interval_ms), stop_(false) {
+  thread_ = std::thread(&MetricsExporter::Run, this);
+}
+
+
+MetricsExporter::~MetricsExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  stop_signal_.notify_one();
+  thread_.join();
+  Write();
+}
+
+
+void MetricsExporter::Add(const StageMetrics* metrics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  metrics_.push_back(metrics);
+}
+
+
+void MetricsExporter::Remove(const StageMetrics* metrics) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < metrics_.size(); i++) {
+    if (metrics_[i] != metrics) continue;
+    metrics->AddTo(retired_);
+    metrics_.erase(metrics_.begin() + i);
+    break;
+  }
+}
+
+
+bool MetricsExporter::Write() {
+  StageMetrics::Counters counters[kStageCount];
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int stage = 0; stage < kStageCount; stage++)
+      counters[stage] = retired_[stage];
+    for (size_t i = 0; i < metrics_.size(); i++) metrics_[i]->AddTo(counters);
+  }
+
+  string temp = file_ + ".tmp";
+  FILE* out = fopen(temp.c_str(), "w");
+  if (out == NULL) return false;
+  if (format_ == kPrometheus) {
+    WritePrometheus(out, counters);
+  } else {
+    WriteJson(out, counters);
+  }
+  if (fclose(out) != 0) return false;
+  return rename(temp.c_str(), file_.c_str()) == 0;
+}
+
+
+void MetricsExporter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    stop_signal_.wait_for(lock, std::chrono::milliseconds(interval_ms_));
+    if (stop_) break;
+    lock.unlock();
+    Write();
+    lock.lock();
+  }
+}
+
+
+void MetricsExporter::WritePrometheus(
+    FILE* out, const StageMetrics::Counters* counters) const {
+  fprintf(out,
+          "# HELP processor_stage_duration_seconds Time spent per "
+          "processor stage.\n"
+          "# TYPE processor_stage_duration_seconds histogram\n");
+  for (int stage = 0; stage < kStageCount; stage++) {
+    const char* name = StageName(static_cast<Stage>(stage));
+    const StageMetrics::Counters& c = counters[stage];
+    uint64_t cumulative = 0;
+    for (int i = 0; i < StageMetrics::kBucketCount; i++) {
+      cumulative += c.buckets[i];
+      fprintf(out,
+              "processor_stage_duration_seconds_bucket{stage=\"%s\","
+              "le=\"%.9g\"} %llu\n",
+              name, static_cast<double>(2ULL << i) / 1e9,
+              static_cast<unsigned long long>(cumulative));
+    }
+    fprintf(out,
+            "processor_stage_duration_seconds_bucket{stage=\"%s\","
+            "le=\"+Inf\"} %llu\n",
+            name, static_cast<unsigned long long>(cumulative));
+    fprintf(out, "processor_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n",
+            name, c.total_ns / 1e9);
+    fprintf(out, "processor_stage_duration_seconds_count{stage=\"%s\"} %llu\n",
+            name, static_cast<unsigned long long>(cumulative));
+  }
+}
+
+
+void MetricsExporter::WriteJson(FILE* out,
+                                const StageMetrics::Counters* counters) const {
+  fprintf(out, "{\n");
+  for (int stage = 0; stage < kStageCount; stage++) {
+    const StageMetrics::Counters& c = counters[stage];
+    fprintf(out, "  \"%s\": {\"count\": %llu, \"total_ns\": %llu, ",
+            StageName(static_cast<Stage>(stage)),
+            static_cast<unsigned long long>(c.count),
+            static_cast<unsigned long long>(c.total_ns));
+    // Buckets are keyed by their upper bound in nanoseconds; empty ones
+    // are left out.
+    fprintf(out, "\"buckets\": {");
+    bool first = true;
+    for (int i = 0; i < StageMetrics::kBucketCount; i++) {
+      if (c.buckets[i] == 0) continue;
+      fprintf(out, "%s\"%llu\": %llu", first ? "" : ", ",
+              static_cast<unsigned long long>(2ULL << i),
+              static_cast<unsigned long long>(c.buckets[i]));
+      first = false;
+    }
+    fprintf(out, "}}%s\n", stage + 1 < kStageCount ? "," : "");
+  }
+  fprintf(out, "}\n");
+}
@@ -0,0 +1,173 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The stages a request or script goes through in a processor.
+enum Stage {
+  kStageCompile,    // Compiling the script.
+  kStageRun,        // Running the script's top level.
+  kStageWrap,       // Wrapping requests for the script.
+  kStageCall,       // Calling Process or ProcessBatch.
+  kStageException,  // Reporting exceptions thrown by the script.
+  kStagePump,       // Draining the platform's message loop.
+  kStageCount
+};
+
+const char* StageName(Stage stage);
+
+
+/**
+ * Call counts and latency histograms per stage for one processor.  Only
+ * the thread running the processor records; exporters read the counters
+ * from other threads at any time.  As there is a single writer, the
+ * counters are bumped with relaxed loads and stores instead of atomic
+ * read-modify-write operations, which keeps recording to a few plain
+ * memory operations.
+ *
+ * Histogram bucket i counts durations in [2^i, 2^(i+1)) nanoseconds.
+ */
+class StageMetrics {
+ public:
+  static const int kBucketCount = 36;
+
+  struct Counters {
+    Counters() : count(0), total_ns(0) {
+      for (int i = 0; i < kBucketCount; i++) buckets[i] = 0;
+    }
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t buckets[kBucketCount];
+  };
+
+  void Record(Stage stage, int64_t ns) {
+    Histogram& histogram = stages_[stage];
+    int bucket = ns < 2 ? 0 : 63 - __builtin_clzll(static_cast<uint64_t>(ns));
+    if (bucket >= kBucketCount) bucket = kBucketCount - 1;
+    Bump(&histogram.total_ns, ns < 0 ? 0 : static_cast<uint64_t>(ns));
+    Bump(&histogram.buckets[bucket], 1);
+  }
+
+  // Adds the counters of this processor to counters, an array indexed
+  // by stage.
+  void AddTo(Counters* counters) const;
+
+ private:
+  // Every duration lands in exactly one bucket, so the count is the sum
+  // of the buckets; AddTo derives it from the buckets it read, which
+  // keeps it consistent with them while recording goes on.
+  struct Histogram {
+    Histogram() : total_ns(0) {
+      for (int i = 0; i < kBucketCount; i++) buckets[i] = 0;
+    }
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> buckets[kBucketCount];
+  };
+
+  static void Bump(std::atomic<uint64_t>* counter, uint64_t value) {
+    counter->store(counter->load(std::memory_order_relaxed) + value,
+                   std::memory_order_relaxed);
+  }
+
+  Histogram stages_[kStageCount];
+};
+
+
+/**
+ * Times a stage from construction to destruction.
+ */
+class StageTimer {
+ public:
+  StageTimer(StageMetrics* metrics, Stage stage)
+      : metrics_(metrics),
+        stage_(stage),
+        start_(std::chrono::steady_clock::now()) {}
+  ~StageTimer() {
+    metrics_->Record(
+        stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start_)
+                    .count());
+  }
+
+ private:
+  StageMetrics* metrics_;
+  Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+
+/**
+ * Periodically writes the combined stage metrics of all registered
+ * processors to a file, as Prometheus text or as JSON.  The file is
+ * replaced atomically so scrapers never see a partial one.  Processors
+ * only take the exporter's lock when they register or unregister, and
+ * the counts of unregistered processors are kept.
+ */
+class MetricsExporter {
+ public:
+  enum Format { kPrometheus, kJson };
+
+  MetricsExporter(const std::string& file, Format format, int interval_ms);
+  // Writes the metrics one last time.
+  ~MetricsExporter();
+
+  void Add(const StageMetrics* metrics);
+  void Remove(const StageMetrics* metrics);
+
+  // Writes the current metrics now.
+  bool Write();
+
+ private:
+  void Run();
+  void WritePrometheus(FILE* out,
+                       const StageMetrics::Counters* counters) const;
+  void WriteJson(FILE* out, const StageMetrics::Counters* counters) const;
+
+  std::string file_;
+  Format format_;
+  int interval_ms_;
+  std::mutex mutex_;
+  std::vector<const StageMetrics*> metrics_;
+  StageMetrics::Counters retired_[kStageCount];
+  std::condition_variable stop_signal_;
+  bool stop_;
+  std::thread thread_;
+};
+
+#endif  // METRICS_H_
@@ -0,0 +1,336 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "module_loader.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <utility>
+
+#include "source_file.h"
+
+using std::string;
+
+namespace {
+
+// Resolves a specifier imported from a module in the given directory to
+// a canonical path.
+bool ResolveSpecifier(const string& directory, const string& specifier,
+                      string* path) {
+  string joined;
+  if (specifier.compare(0, 1, "/") == 0) {
+    joined = specifier;
+  } else if (specifier.compare(0, 2, "./") == 0 ||
+             specifier.compare(0, 3, "../") == 0) {
+    joined = directory + "/" + specifier;
+  } else {
+    return false;
+  }
+  char* real = realpath(joined.c_str(), NULL);
+  if (real == NULL) return false;
+  *path = real;
+  free(real);
+  return true;
+}
+
+
+string DirectoryOf(const string& path) {
+  size_t slash = path.rfind('/');
+  return slash == string::npos ? "." : path.substr(0, slash);
+}
+
+}  // namespace
+
+
+struct ModuleLoader::Entry {
+  enum State { kParsing, kCompiled, kFailed };
+
+  string path;
+  State state;
+  std::shared_ptr<SourceFile> file;
+  // Alive from the start of parsing until the module is compiled.
+  std::unique_ptr<v8::ScriptCompiler::StreamedSource> streamed;
+  v8::Global<v8::Module> module;
+  // The last load that fetched the module or walked its imports.
+  int load;
+};
+
+
+// Compiles a parsed module on the isolate thread.
+class ModuleLoader::CompileTask : public v8::Task {
+ public:
+  CompileTask(ModuleLoader* loader, Entry* entry)
+      : loader_(loader), entry_(entry) {}
+
+  void Run() override { loader_->Compile(entry_); }
+
+ private:
+  ModuleLoader* loader_;
+  Entry* entry_;
+};
+
+
+// Parses a module on a worker thread, then hands it back to the isolate
+// thread to be compiled.
+class ModuleLoader::ParseTask : public v8::Task {
+ public:
+  ParseTask(ModuleLoader* loader, Entry* entry,
+            v8::ScriptCompiler::ScriptStreamingTask* task)
+      : loader_(loader), entry_(entry), task_(task) {}
+
+  void Run() override {
+    task_->Run();
+    loader_->platform_->GetForegroundTaskRunner(loader_->isolate_)
+        ->PostTask(
+            std::unique_ptr<v8::Task>(new CompileTask(loader_, entry_)));
+  }
+
+ private:
+  ModuleLoader* loader_;
+  Entry* entry_;
+  std::unique_ptr<v8::ScriptCompiler::ScriptStreamingTask> task_;
+};
+
+
+ModuleLoader::ModuleLoader(v8::Isolate* isolate, v8::Platform* platform)
+    : isolate_(isolate),
+      platform_(platform),
+      load_(0),
+      pending_(0),
+      compiled_(0) {
+  isolate_->SetData(kLoaderSlot, this);
+}
+
+
+ModuleLoader::~ModuleLoader() { isolate_->SetData(kLoaderSlot, NULL); }
+
+
+v8::MaybeLocal<v8::Value> ModuleLoader::Run(v8::Local<v8::Context> context,
+                                            const string& file) {
+  string path;
+  if (!ResolveSpecifier(".", file.compare(0, 1, "/") == 0 ? file : "./" + file,
+                        &path)) {
+    string message = "Error loading module '" + file + "'";
+    isolate_->ThrowException(v8::Exception::Error(
+        v8::String::NewFromUtf8(isolate_, message.c_str()).ToLocalChecked()));
+    return v8::MaybeLocal<v8::Value>();
+  }
+
+  context_.Reset(isolate_, context);
+  error_.clear();
+  load_++;
+  Fetch(path);
+  while (pending_ > 0) {
+    v8::platform::PumpMessageLoop(
+        platform_, isolate_, v8::platform::MessageLoopBehavior::kWaitForWork);
+  }
+  context_.Reset();
+  if (!error_.empty()) {
+    isolate_->ThrowException(v8::Exception::Error(
+        v8::String::NewFromUtf8(isolate_, error_.c_str()).ToLocalChecked()));
+    return v8::MaybeLocal<v8::Value>();
+  }
+
+  v8::Local<v8::Module> module = registry_[path]->module.Get(isolate_);
+  if (module->InstantiateModule(context, ResolveModule).IsNothing()) {
+    return v8::MaybeLocal<v8::Value>();
+  }
+  v8::Local<v8::Value> result;
+  if (!module->Evaluate(context).ToLocal(&result)) {
+    return v8::MaybeLocal<v8::Value>();
+  }
+  // With top-level await the completion value is a promise, settled
+  // once the microtasks have run.
+  if (result->IsPromise()) {
+    isolate_->PerformMicrotaskCheckpoint();
+    v8::Local<v8::Promise> promise = result.As<v8::Promise>();
+    if (promise->State() == v8::Promise::kRejected) {
+      isolate_->ThrowException(promise->Result());
+      return v8::MaybeLocal<v8::Value>();
+    }
+  }
+  return result;
+}
+
+
+void ModuleLoader::Fetch(const string& path) {
+  std::map<string, std::unique_ptr<Entry>>::iterator found =
+      registry_.find(path);
+  if (found != registry_.end()) {
+    Entry* entry = found->second.get();
+    if (entry->state == Entry::kCompiled && entry->load != load_) {
+      // An import of a module compiled by an earlier load may have
+      // failed then, so walk its imports again.
+      entry->load = load_;
+      FetchImports(entry);
+      return;
+    }
+    // Modules that failed are tried again by the next load, but only
+    // once per load, however many modules import them.
+    if (entry->state != Entry::kFailed || entry->load == load_) return;
+    registry_.erase(found);
+  }
+
+  Entry* entry = new Entry();
+  registry_[path].reset(entry);
+  entry->path = path;
+  entry->load = load_;
+  entry->state = Entry::kParsing;
+  entry->file = SourceFile::Open(path);
+  if (entry->file == NULL) {
+    entry->state = Entry::kFailed;
+    Fail("Error loading module '" + path + "'");
+    return;
+  }
+  entry->streamed = NewStreamedSource(entry->file);
+  v8::ScriptCompiler::ScriptStreamingTask* task =
+      v8::ScriptCompiler::StartStreaming(isolate_, entry->streamed.get(),
+                                         v8::ScriptType::kModule);
+  pending_++;
+  platform_->CallOnWorkerThread(
+      std::unique_ptr<v8::Task>(new ParseTask(this, entry, task)));
+}
+
+
+void ModuleLoader::Compile(Entry* entry) {
+  pending_--;
+  v8::HandleScope handle_scope(isolate_);
+  v8::Local<v8::Context> context = context_.Get(isolate_);
+  v8::Context::Scope context_scope(context);
+  v8::TryCatch try_catch(isolate_);
+
+  v8::Local<v8::String> source;
+  v8::Local<v8::Module> module;
+  v8::ScriptOrigin origin(
+      isolate_,
+      v8::String::NewFromUtf8(isolate_, entry->path.c_str()).ToLocalChecked(),
+      0, 0, false, -1, v8::Local<v8::Value>(), false, false, true);
+  bool compiled =
+      SourceFile::NewString(isolate_, entry->file).ToLocal(&source);
+  if (compiled && entry->file->encoding() == SourceFile::kLatin1) {
+    // The parser saw the file as UTF-8; start over from the string.
+    v8::ScriptCompiler::Source plain_source(source, origin);
+    compiled = v8::ScriptCompiler::CompileModule(isolate_, &plain_source)
+                   .ToLocal(&module);
+  } else if (compiled) {
+    compiled = v8::ScriptCompiler::CompileModule(
+                   context, entry->streamed.get(), source, origin)
+                   .ToLocal(&module);
+  }
+  entry->streamed.reset();
+  if (!compiled) {
+    entry->state = Entry::kFailed;
+    string message = entry->path;
+    if (try_catch.HasCaught()) {
+      v8::String::Utf8Value exception(isolate_, try_catch.Exception());
+      v8::Local<v8::Message> location = try_catch.Message();
+      if (!location.IsEmpty()) {
+        message += ":" + std::to_string(
+                             location->GetLineNumber(context).FromMaybe(0));
+      }
+      message += ": ";
+      message += *exception != NULL ? *exception : "compile error";
+    } else {
+      message += ": source too large";
+    }
+    Fail(message);
+    return;
+  }
+
+  entry->state = Entry::kCompiled;
+  entry->module.Reset(isolate_, module);
+  by_hash_.insert(std::make_pair(module->GetIdentityHash(), entry));
+  compiled_++;
+
+  // Start on the imports right away, so they are parsed while the rest
+  // of this level of the graph is.
+  FetchImports(entry);
+}
+
+
+void ModuleLoader::FetchImports(Entry* entry) {
+  v8::HandleScope handle_scope(isolate_);
+  v8::Local<v8::Context> context = context_.Get(isolate_);
+  v8::Local<v8::Module> module = entry->module.Get(isolate_);
+  string directory = DirectoryOf(entry->path);
+  v8::Local<v8::FixedArray> requests = module->GetModuleRequests();
+  for (int i = 0; i < requests->Length(); i++) {
+    v8::Local<v8::ModuleRequest> request =
+        requests->Get(context, i).As<v8::ModuleRequest>();
+    v8::String::Utf8Value specifier(isolate_, request->GetSpecifier());
+    string path;
+    if (!ResolveSpecifier(directory, *specifier, &path)) {
+      Fail("Cannot find module '" + string(*specifier) + "' imported from '" +
+           entry->path + "'");
+      continue;
+    }
+    Fetch(path);
+  }
+}
+
+
+void ModuleLoader::Fail(const string& message) {
+  if (error_.empty()) error_ = message;
+}
+
+
+ModuleLoader::Entry* ModuleLoader::Find(v8::Local<v8::Module> module) {
+  typedef std::unordered_multimap<int, Entry*>::iterator Iterator;
+  std::pair<Iterator, Iterator> range =
+      by_hash_.equal_range(module->GetIdentityHash());
+  for (Iterator it = range.first; it != range.second; ++it) {
+    if (it->second->module == module) return it->second;
+  }
+  return NULL;
+}
+
+
+v8::MaybeLocal<v8::Module> ModuleLoader::ResolveModule(
+    v8::Local<v8::Context> context, v8::Local<v8::String> specifier,
+    v8::Local<v8::FixedArray> import_assertions,
+    v8::Local<v8::Module> referrer) {
+  v8::Isolate* isolate = context->GetIsolate();
+  ModuleLoader* loader =
+      static_cast<ModuleLoader*>(isolate->GetData(kLoaderSlot));
+  Entry* from = loader->Find(referrer);
+  v8::String::Utf8Value name(isolate, specifier);
+  string path;
+  if (from != NULL &&
+      ResolveSpecifier(DirectoryOf(from->path), *name, &path)) {
+    std::map<string, std::unique_ptr<Entry>>::iterator found =
+        loader->registry_.find(path);
+    if (found != loader->registry_.end() &&
+        found->second->state == Entry::kCompiled) {
+      return found->second->module.Get(isolate);
+    }
+  }
+  string message = "Cannot resolve module '" + string(*name) + "'";
+  isolate->ThrowException(v8::Exception::Error(
+      v8::String::NewFromUtf8(isolate, message.c_str()).ToLocalChecked()));
+  return v8::MaybeLocal<v8::Module>();
+}
@@ -0,0 +1,116 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODULE_LOADER_H_
+#define MODULE_LOADER_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class SourceFile;
+
+/**
+ * Loads ES modules from files for one isolate.  Modules are kept in a
+ * registry keyed by their canonical path, so a module imported from
+ * many places, or by many entry points, is compiled once.
+ *
+ * Loading a module walks its import graph breadth first.  Each module
+ * is parsed on one of the platform's worker threads while the file is
+ * streamed to the parser, and as soon as a module is compiled on the
+ * isolate thread the modules it imports are started the same way.  The
+ * files of one level of the graph are thus read and parsed in parallel,
+ * and instantiation only starts once the whole graph is compiled.
+ *
+ * Specifiers are resolved relative to the importing module if they
+ * start with "./", "../" or "/"; bare specifiers are not supported.
+ *
+ * All methods must be called on the thread running the isolate.
+ */
+class ModuleLoader {
+ public:
+  ModuleLoader(v8::Isolate* isolate, v8::Platform* platform);
+  ~ModuleLoader();
+  ModuleLoader(const ModuleLoader&) = delete;
+  ModuleLoader& operator=(const ModuleLoader&) = delete;
+
+  // Loads, instantiates and evaluates the module in a file along with
+  // everything it imports.  Returns the completion value of the module,
+  // or throws and returns an empty handle.
+  v8::MaybeLocal<v8::Value> Run(v8::Local<v8::Context> context,
+                                const std::string& file);
+
+  // The number of modules compiled so far.
+  int compiled() const { return compiled_; }
+
+ private:
+  // The isolate data slot holding the loader.
+  static const uint32_t kLoaderSlot = 0;
+
+  struct Entry;
+  class ParseTask;
+  class CompileTask;
+
+  static v8::MaybeLocal<v8::Module> ResolveModule(
+      v8::Local<v8::Context> context, v8::Local<v8::String> specifier,
+      v8::Local<v8::FixedArray> import_assertions,
+      v8::Local<v8::Module> referrer);
+
+  // Starts loading the module in a file unless the registry has it.  For
+  // a module compiled by an earlier load only its imports are fetched.
+  void Fetch(const std::string& path);
+  // Fetches the modules a compiled module imports.
+  void FetchImports(Entry* entry);
+  // Finishes compiling a module parsed on a worker thread and fetches the
+  // modules it imports.
+  void Compile(Entry* entry);
+  // Records the first error of a load, to be thrown once it is done.
+  void Fail(const std::string& message);
+
+  // Returns the entry of a compiled module, or NULL.
+  Entry* Find(v8::Local<v8::Module> module);
+
+  v8::Isolate* isolate_;
+  v8::Platform* platform_;
+  // The context modules are compiled in while a load is running.
+  v8::Global<v8::Context> context_;
+  std::map<std::string, std::unique_ptr<Entry>> registry_;
+  // Compiled modules by identity hash, to find the path of a referrer.
+  std::unordered_multimap<int, Entry*> by_hash_;
+  // Counts the calls to Run, so each load walks a module's imports once.
+  int load_;
+  // Modules being parsed or waiting to be compiled.
+  int pending_;
+  int compiled_;
+  std::string error_;
+};
+
+#endif  // MODULE_LOADER_H_
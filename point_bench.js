@@ -0,0 +1,33 @@
+// Measures the per-call cost of Point.prototype.multi.  Compare
+//
+//   Shell point_bench.js
+//   Shell --no-turbo-fast-api-calls point_bench.js
+//
+// to see what the fast API call saves once the loop is optimized.
+// multi is called through a saved reference because looking it up on
+// the point goes through the Point named property interceptor.
+
+var multi = Point.prototype.multi;
+
+function run(point, calls) {
+    var sum = 0;
+    for (var i = 0; i < calls; i++) {
+        sum += multi.call(point);
+    }
+    return sum;
+}
+
+var point = new Point(3, 4);
+var calls = 1000000;
+
+// Warm up so the timed runs use optimized code.
+for (var i = 0; i < 20; i++) run(point, calls);
+
+var rounds = 10;
+var start = Date.now();
+var sum = 0;
+for (var i = 0; i < rounds; i++) sum += run(point, calls);
+var elapsed = Date.now() - start;
+
+if (sum !== 12 * calls * rounds) throw new Error("wrong sum " + sum);
+print("multi: " + (elapsed * 1e6 / (calls * rounds)).toFixed(2) + " ns/call");
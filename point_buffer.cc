@@ -0,0 +1,464 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "point_buffer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define POINT_BUFFER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Both arrays start on a 32 byte boundary so the AVX2 kernels can use
+// aligned loads on them.
+const size_t kAlignment = 32;
+const size_t kDoublesPerAlignment = kAlignment / sizeof(double);
+
+// Large enough for any script, small enough that the byte size of the
+// arrays cannot overflow.
+const int64_t kMaxLength = int64_t{1} << 28;
+
+enum InternalField { kBufferField, kTagField, kFieldCount };
+
+// Stored in kTagField so dot() can tell PointBuffers from other objects
+// with internal fields.
+int point_buffer_tag;
+
+
+// ----------------------------------
+// --- K e r n e l s ---
+// ----------------------------------
+
+
+void MultiplyScalar(const double* x, const double* y, double* out,
+                    size_t n) {
+  for (size_t i = 0; i < n; i++) out[i] = x[i] * y[i];
+}
+
+
+double SumScalar(const double* a, size_t n) {
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) sum += a[i];
+  return sum;
+}
+
+
+void ScaleScalar(double* a, double factor, size_t n) {
+  for (size_t i = 0; i < n; i++) a[i] *= factor;
+}
+
+
+double DotScalar(const double* ax, const double* ay, const double* bx,
+                 const double* by, size_t n) {
+  double sum = 0;
+  for (size_t i = 0; i < n; i++) sum += ax[i] * bx[i] + ay[i] * by[i];
+  return sum;
+}
+
+
+#ifdef POINT_BUFFER_X86
+
+// SSE2 is part of x86-64, so these need no check.  The point arrays are
+// aligned, but the output of multiAll may be any Float64Array, so
+// stores are unaligned.
+
+void MultiplySse2(const double* x, const double* y, double* out, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    _mm_storeu_pd(out + i, _mm_mul_pd(_mm_load_pd(x + i), _mm_load_pd(y + i)));
+  }
+  MultiplyScalar(x + i, y + i, out + i, n - i);
+}
+
+
+double SumSse2(const double* a, size_t n) {
+  __m128d sum0 = _mm_setzero_pd();
+  __m128d sum1 = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sum0 = _mm_add_pd(sum0, _mm_load_pd(a + i));
+    sum1 = _mm_add_pd(sum1, _mm_load_pd(a + i + 2));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+  return lanes[0] + lanes[1] + SumScalar(a + i, n - i);
+}
+
+
+void ScaleSse2(double* a, double factor, size_t n) {
+  __m128d f = _mm_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    _mm_store_pd(a + i, _mm_mul_pd(_mm_load_pd(a + i), f));
+  }
+  ScaleScalar(a + i, factor, n - i);
+}
+
+
+double DotSse2(const double* ax, const double* ay, const double* bx,
+               const double* by, size_t n) {
+  __m128d sum = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d px = _mm_mul_pd(_mm_load_pd(ax + i), _mm_load_pd(bx + i));
+    __m128d py = _mm_mul_pd(_mm_load_pd(ay + i), _mm_load_pd(by + i));
+    sum = _mm_add_pd(sum, _mm_add_pd(px, py));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1] + DotScalar(ax + i, ay + i, bx + i, by + i, n - i);
+}
+
+
+// The AVX2 kernels are compiled for AVX2 whatever the build targets and
+// only used if the CPU turns out to support it.
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+AVX2_KERNEL void MultiplyAvx2(const double* x, const double* y, double* out,
+                              size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_load_pd(x + i),
+                                            _mm256_load_pd(y + i)));
+  }
+  MultiplyScalar(x + i, y + i, out + i, n - i);
+}
+
+
+AVX2_KERNEL double HorizontalSum(__m256d v) {
+  __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v),
+                           _mm256_extractf128_pd(v, 1));
+  double lanes[2];
+  _mm_storeu_pd(lanes, sum);
+  return lanes[0] + lanes[1];
+}
+
+
+AVX2_KERNEL double SumAvx2(const double* a, size_t n) {
+  __m256d sum0 = _mm256_setzero_pd();
+  __m256d sum1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = _mm256_add_pd(sum0, _mm256_load_pd(a + i));
+    sum1 = _mm256_add_pd(sum1, _mm256_load_pd(a + i + 4));
+  }
+  return HorizontalSum(_mm256_add_pd(sum0, sum1)) + SumScalar(a + i, n - i);
+}
+
+
+AVX2_KERNEL void ScaleAvx2(double* a, double factor, size_t n) {
+  __m256d f = _mm256_set1_pd(factor);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_store_pd(a + i, _mm256_mul_pd(_mm256_load_pd(a + i), f));
+  }
+  ScaleScalar(a + i, factor, n - i);
+}
+
+
+AVX2_KERNEL double DotAvx2(const double* ax, const double* ay,
+                           const double* bx, const double* by, size_t n) {
+  __m256d sum = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d px = _mm256_mul_pd(_mm256_load_pd(ax + i), _mm256_load_pd(bx + i));
+    __m256d py = _mm256_mul_pd(_mm256_load_pd(ay + i), _mm256_load_pd(by + i));
+    sum = _mm256_add_pd(sum, _mm256_add_pd(px, py));
+  }
+  return HorizontalSum(sum) + DotScalar(ax + i, ay + i, bx + i, by + i, n - i);
+}
+
+#undef AVX2_KERNEL
+
+#endif  // POINT_BUFFER_X86
+
+
+struct Kernels {
+  void (*multiply)(const double* x, const double* y, double* out, size_t n);
+  double (*sum)(const double* a, size_t n);
+  void (*scale)(double* a, double factor, size_t n);
+  double (*dot)(const double* ax, const double* ay, const double* bx,
+                const double* by, size_t n);
+};
+
+
+// Picks the widest kernels the CPU supports, once.
+const Kernels& GetKernels() {
+  static const Kernels kernels = []() {
+#ifdef POINT_BUFFER_X86
+    if (__builtin_cpu_supports("avx2"))
+      return Kernels{MultiplyAvx2, SumAvx2, ScaleAvx2, DotAvx2};
+    return Kernels{MultiplySse2, SumSse2, ScaleSse2, DotSse2};
+#else
+    return Kernels{MultiplyScalar, SumScalar, ScaleScalar, DotScalar};
+#endif
+  }();
+  return kernels;
+}
+
+
+// ----------------------------------
+// --- P o i n t B u f f e r ---
+// ----------------------------------
+
+
+// The native side of a PointBuffer.  The arrays live in the backing
+// store of the ArrayBuffer under 'x' and 'y'; holding on to the store
+// keeps them valid even if a script manages to detach that buffer.
+struct PointBuffer {
+  size_t length;
+  double* x;
+  double* y;
+  std::shared_ptr<v8::BackingStore> store;
+  v8::Global<v8::Object> wrapper;
+};
+
+
+void FreeArrays(void* data, size_t length, void* deleter_data) {
+  free(data);
+}
+
+
+void OnPointBufferCollected(const v8::WeakCallbackInfo<PointBuffer>& info) {
+  PointBuffer* buffer = info.GetParameter();
+  buffer->wrapper.Reset();
+  delete buffer;
+}
+
+
+PointBuffer* UnwrapPointBuffer(v8::Local<v8::Object> object) {
+  return static_cast<PointBuffer*>(
+      object->GetAlignedPointerFromInternalField(kBufferField));
+}
+
+
+// Returns the PointBuffer behind a value, or NULL if it is not one.
+PointBuffer* ToPointBuffer(v8::Local<v8::Value> value) {
+  if (!value->IsObject()) return NULL;
+  v8::Local<v8::Object> object = value.As<v8::Object>();
+  if (object->InternalFieldCount() != kFieldCount ||
+      object->GetAlignedPointerFromInternalField(kTagField) !=
+          &point_buffer_tag) {
+    return NULL;
+  }
+  return UnwrapPointBuffer(object);
+}
+
+
+void ThrowError(v8::Isolate* isolate, const char* message) {
+  isolate->ThrowException(v8::Exception::TypeError(
+      v8::String::NewFromUtf8(isolate, message).ToLocalChecked()));
+}
+
+
+void DefineReadOnly(v8::Local<v8::Context> context,
+                    v8::Local<v8::Object> object, const char* name,
+                    v8::Local<v8::Value> value) {
+  v8::Isolate* isolate = context->GetIsolate();
+  object
+      ->DefineOwnProperty(
+          context,
+          v8::String::NewFromUtf8(isolate, name,
+                                  v8::NewStringType::kInternalized)
+              .ToLocalChecked(),
+          value,
+          static_cast<v8::PropertyAttribute>(v8::ReadOnly | v8::DontDelete))
+      .Check();
+}
+
+
+// new PointBuffer(length)
+void ConstructPointBuffer(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  if (!args.IsConstructCall()) {
+    ThrowError(isolate, "PointBuffer must be called with new");
+    return;
+  }
+  int64_t length;
+  if (!args[0]->IntegerValue(context).To(&length)) return;
+  if (length < 0 || length > kMaxLength) {
+    isolate->ThrowException(v8::Exception::RangeError(
+        v8::String::NewFromUtf8(isolate, "Invalid PointBuffer length")
+            .ToLocalChecked()));
+    return;
+  }
+
+  // Pad the x array so the y array starts aligned too.
+  size_t stride = (static_cast<size_t>(length) + kDoublesPerAlignment - 1) &
+                  ~(kDoublesPerAlignment - 1);
+  size_t byte_length = 2 * stride * sizeof(double);
+  void* data = aligned_alloc(kAlignment,
+                             byte_length > 0 ? byte_length : kAlignment);
+  if (data == NULL) {
+    isolate->ThrowException(v8::Exception::RangeError(
+        v8::String::NewFromUtf8(isolate, "Out of memory for PointBuffer")
+            .ToLocalChecked()));
+    return;
+  }
+  memset(data, 0, byte_length);
+
+  PointBuffer* buffer = new PointBuffer();
+  buffer->length = static_cast<size_t>(length);
+  buffer->x = static_cast<double*>(data);
+  buffer->y = buffer->x + stride;
+  buffer->store =
+      v8::ArrayBuffer::NewBackingStore(data, byte_length, FreeArrays, NULL);
+  v8::Local<v8::ArrayBuffer> array_buffer =
+      v8::ArrayBuffer::New(isolate, buffer->store);
+
+  v8::Local<v8::Object> self = args.This();
+  self->SetAlignedPointerInInternalField(kBufferField, buffer);
+  self->SetAlignedPointerInInternalField(kTagField, &point_buffer_tag);
+  DefineReadOnly(context, self, "x",
+                 v8::Float64Array::New(array_buffer, 0, buffer->length));
+  DefineReadOnly(context, self, "y",
+                 v8::Float64Array::New(array_buffer, stride * sizeof(double),
+                                       buffer->length));
+  DefineReadOnly(context, self, "length",
+                 v8::Number::New(isolate, static_cast<double>(length)));
+
+  buffer->wrapper.Reset(isolate, self);
+  buffer->wrapper.SetWeak(buffer, OnPointBufferCollected,
+                          v8::WeakCallbackType::kParameter);
+}
+
+
+// multiAll([out]) returns x[i] * y[i] for every point, written into out
+// if it is a Float64Array with room for them.
+void MultiAll(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  PointBuffer* buffer = UnwrapPointBuffer(args.Holder());
+  v8::Local<v8::Float64Array> out;
+  if (args[0]->IsFloat64Array()) {
+    out = args[0].As<v8::Float64Array>();
+    if (out->Length() < buffer->length) {
+      ThrowError(isolate, "multiAll output is too short");
+      return;
+    }
+  } else {
+    v8::Local<v8::ArrayBuffer> array_buffer =
+        v8::ArrayBuffer::New(isolate, buffer->length * sizeof(double));
+    out = v8::Float64Array::New(array_buffer, 0, buffer->length);
+  }
+  char* base = static_cast<char*>(out->Buffer()->GetBackingStore()->Data());
+  GetKernels().multiply(
+      buffer->x, buffer->y,
+      reinterpret_cast<double*>(base + out->ByteOffset()), buffer->length);
+  args.GetReturnValue().Set(out);
+}
+
+
+// sum() returns the sums of the x and the y coordinates.
+void Sum(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  PointBuffer* buffer = UnwrapPointBuffer(args.Holder());
+  const Kernels& kernels = GetKernels();
+  v8::Local<v8::Object> result = v8::Object::New(isolate);
+  result
+      ->Set(context, v8::String::NewFromUtf8Literal(isolate, "x"),
+            v8::Number::New(isolate, kernels.sum(buffer->x, buffer->length)))
+      .Check();
+  result
+      ->Set(context, v8::String::NewFromUtf8Literal(isolate, "y"),
+            v8::Number::New(isolate, kernels.sum(buffer->y, buffer->length)))
+      .Check();
+  args.GetReturnValue().Set(result);
+}
+
+
+// scale(factor) or scale(x_factor, y_factor) scales all points in place.
+void Scale(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Local<v8::Context> context = args.GetIsolate()->GetCurrentContext();
+  PointBuffer* buffer = UnwrapPointBuffer(args.Holder());
+  double x_factor;
+  if (!args[0]->NumberValue(context).To(&x_factor)) return;
+  double y_factor = x_factor;
+  if (args.Length() > 1 && !args[1]->NumberValue(context).To(&y_factor))
+    return;
+  const Kernels& kernels = GetKernels();
+  kernels.scale(buffer->x, x_factor, buffer->length);
+  kernels.scale(buffer->y, y_factor, buffer->length);
+  args.GetReturnValue().Set(args.Holder());
+}
+
+
+// dot(other) sums the dot products of the points with those of another
+// PointBuffer of the same length.
+void Dot(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  PointBuffer* buffer = UnwrapPointBuffer(args.Holder());
+  PointBuffer* other = ToPointBuffer(args[0]);
+  if (other == NULL) {
+    ThrowError(isolate, "dot expects a PointBuffer");
+    return;
+  }
+  if (other->length != buffer->length) {
+    ThrowError(isolate, "dot expects a PointBuffer of the same length");
+    return;
+  }
+  double dot = GetKernels().dot(buffer->x, buffer->y, other->x, other->y,
+                                buffer->length);
+  args.GetReturnValue().Set(dot);
+}
+
+}  // namespace
+
+
+v8::Local<v8::FunctionTemplate> NewPointBufferTemplate(v8::Isolate* isolate) {
+  v8::Local<v8::FunctionTemplate> templ =
+      v8::FunctionTemplate::New(isolate, ConstructPointBuffer);
+  templ->SetClassName(v8::String::NewFromUtf8Literal(isolate, "PointBuffer"));
+  templ->InstanceTemplate()->SetInternalFieldCount(kFieldCount);
+
+  // The signature makes sure the methods are only called on
+  // PointBuffers.
+  v8::Local<v8::Signature> signature = v8::Signature::New(isolate, templ);
+  v8::Local<v8::ObjectTemplate> proto = templ->PrototypeTemplate();
+  struct {
+    const char* name;
+    v8::FunctionCallback callback;
+  } methods[] = {
+      {"multiAll", MultiAll}, {"sum", Sum}, {"scale", Scale}, {"dot", Dot}};
+  for (const auto& method : methods) {
+    proto->Set(v8::String::NewFromUtf8(isolate, method.name,
+                                       v8::NewStringType::kInternalized)
+                   .ToLocalChecked(),
+               v8::FunctionTemplate::New(isolate, method.callback,
+                                         v8::Local<v8::Value>(), signature));
+  }
+  return templ;
+}
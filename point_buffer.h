@@ -0,0 +1,53 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef POINT_BUFFER_H_
+#define POINT_BUFFER_H_
+
+#include <include/v8.h>
+
+/**
+ * Creates the template of the PointBuffer constructor.  A PointBuffer
+ * holds the coordinates of many points as two contiguous, aligned
+ * arrays of doubles, visible to scripts as the Float64Arrays 'x' and
+ * 'y':
+ *
+ *   var points = new PointBuffer(1000000);
+ *   points.x[0] = 3; points.y[0] = 4;
+ *   points.scale(2);             // or scale(sx, sy); returns points
+ *   points.multiAll();           // Float64Array of x[i] * y[i]
+ *   points.multiAll(products);   // the same, into an existing array
+ *   points.sum();                // {x: sum of x, y: sum of y}
+ *   points.dot(other);           // sum of x[i] * other.x[i] +
+ *                                //        y[i] * other.y[i]
+ *
+ * The bulk operations run in native loops, using AVX2 or SSE2 where the
+ * CPU has them, so they cost nothing per point beyond the arithmetic.
+ */
+v8::Local<v8::FunctionTemplate> NewPointBufferTemplate(v8::Isolate* isolate);
+
+#endif  // POINT_BUFFER_H_
@@ -0,0 +1,331 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "pooled_allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+using std::memory_order_relaxed;
+
+namespace {
+
+// The size classes run from kMinPooledSize to kMaxPooledSize bytes.
+const int kClassCount = 15;
+// How many bytes of each class a thread keeps to itself, within bounds
+// on the number of blocks.
+const size_t kThreadCacheBytes = 1 << 20;
+const size_t kMinThreadCacheBlocks = 4;
+const size_t kMaxThreadCacheBlocks = 256;
+// How many bytes of each class are kept for all threads; blocks freed
+// beyond that go back to malloc.
+const size_t kSharedPoolBytes = 16 << 20;
+
+int SizeClass(size_t length) {
+  if (length <= PooledAllocator::kMinPooledSize) return 0;
+  return 64 - __builtin_clzll(static_cast<unsigned long long>(length - 1)) -
+         4;
+}
+
+
+size_t ClassSize(int size_class) {
+  return PooledAllocator::kMinPooledSize << size_class;
+}
+
+
+size_t ThreadCacheLimit(int size_class) {
+  size_t blocks = kThreadCacheBytes / ClassSize(size_class);
+  if (blocks < kMinThreadCacheBlocks) return kMinThreadCacheBlocks;
+  if (blocks > kMaxThreadCacheBlocks) return kMaxThreadCacheBlocks;
+  return blocks;
+}
+
+
+// The free lists shared by all threads, and the counters.
+class SharedPool {
+ public:
+  SharedPool()
+      : allocations(0),
+        allocated_bytes(0),
+        reused(0),
+        huge_page_buffers(0),
+        live_bytes(0),
+        peak_live_bytes(0),
+        pooled_bytes(0),
+        start(std::chrono::steady_clock::now()) {}
+
+  // Moves up to count blocks of a class into blocks.  Returns how many.
+  size_t Take(int size_class, void** blocks, size_t count) {
+    std::lock_guard<std::mutex> lock(mutexes_[size_class]);
+    std::vector<void*>& list = lists_[size_class];
+    if (count > list.size()) count = list.size();
+    if (count == 0) return 0;
+    memcpy(blocks, &list[list.size() - count], count * sizeof(void*));
+    list.resize(list.size() - count);
+    return count;
+  }
+
+  // Keeps blocks of a class for later, up to kSharedPoolBytes of them.
+  void Put(int size_class, void* const* blocks, size_t count) {
+    size_t size = ClassSize(size_class);
+    size_t kept = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutexes_[size_class]);
+      std::vector<void*>& list = lists_[size_class];
+      size_t room = kSharedPoolBytes / size - list.size();
+      kept = count < room ? count : room;
+      list.insert(list.end(), blocks, blocks + kept);
+    }
+    for (size_t i = kept; i < count; i++) free(blocks[i]);
+    pooled_bytes.fetch_sub((count - kept) * size, memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> allocations;
+  std::atomic<uint64_t> allocated_bytes;
+  std::atomic<uint64_t> reused;
+  std::atomic<uint64_t> huge_page_buffers;
+  std::atomic<size_t> live_bytes;
+  std::atomic<size_t> peak_live_bytes;
+  std::atomic<size_t> pooled_bytes;
+  const std::chrono::steady_clock::time_point start;
+
+ private:
+  std::mutex mutexes_[kClassCount];
+  std::vector<void*> lists_[kClassCount];
+};
+
+
+std::atomic<bool> pool_made(false);
+
+SharedPool* Shared() {
+  // Never deleted: threads hand their caches back when they exit, which
+  // may be after main has returned.
+  static SharedPool* pool = new SharedPool();
+  return pool;
+}
+
+
+// The blocks a thread has freed, by size class.  Given back to the
+// shared pool when the thread exits.
+struct ThreadCache {
+  ~ThreadCache() {
+    for (int i = 0; i < kClassCount; i++) {
+      if (!blocks[i].empty()) {
+        Shared()->Put(i, blocks[i].data(), blocks[i].size());
+      }
+    }
+  }
+
+  std::vector<void*> blocks[kClassCount];
+};
+
+thread_local ThreadCache thread_cache;
+
+
+size_t HugePageLength(size_t length) {
+  return (length + PooledAllocator::kHugePageSize - 1) &
+         ~(PooledAllocator::kHugePageSize - 1);
+}
+
+
+// Maps zeroed memory starting at a huge page boundary, so all of it can
+// be backed by huge pages.
+void* MapHugePages(size_t length) {
+  const size_t huge_page = PooledAllocator::kHugePageSize;
+  size_t size = HugePageLength(length);
+  // Map a huge page more than needed and trim both ends.
+  void* mapping = mmap(NULL, size + huge_page, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) return NULL;
+  char* base = static_cast<char*>(mapping);
+  char* start = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(base) + huge_page - 1) & ~(huge_page - 1));
+  size_t head = start - base;
+  if (head > 0) munmap(base, head);
+  if (huge_page - head > 0) munmap(start + size, huge_page - head);
+#ifdef MADV_HUGEPAGE
+  madvise(start, size, MADV_HUGEPAGE);
+#endif
+  return start;
+}
+
+}  // namespace
+
+
+bool ParseAllocatorKind(const std::string& name,
+                        ArrayBufferAllocatorKind* kind) {
+  if (name == "default") {
+    *kind = kDefaultAllocator;
+  } else if (name == "pooled") {
+    *kind = kPooledAllocator;
+  } else if (name == "huge") {
+    *kind = kHugePageAllocator;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+std::shared_ptr<v8::ArrayBuffer::Allocator> NewArrayBufferAllocator(
+    ArrayBufferAllocatorKind kind) {
+  switch (kind) {
+    case kPooledAllocator:
+      return std::make_shared<PooledAllocator>(false);
+    case kHugePageAllocator:
+      return std::make_shared<PooledAllocator>(true);
+    default:
+      return std::shared_ptr<v8::ArrayBuffer::Allocator>(
+          v8::ArrayBuffer::Allocator::NewDefaultAllocator());
+  }
+}
+
+
+PooledAllocator::PooledAllocator(bool huge_pages) : huge_pages_(huge_pages) {
+  Shared();
+  pool_made = true;
+}
+
+
+void* PooledAllocator::Allocate(size_t length) {
+  return AllocateBuffer(length, true);
+}
+
+
+void* PooledAllocator::AllocateUninitialized(size_t length) {
+  return AllocateBuffer(length, false);
+}
+
+
+void* PooledAllocator::AllocateBuffer(size_t length, bool zero) {
+  SharedPool* shared = Shared();
+  void* data;
+  if (length <= kMaxPooledSize) {
+    int size_class = SizeClass(length);
+    size_t size = ClassSize(size_class);
+    std::vector<void*>& cache = thread_cache.blocks[size_class];
+    if (cache.empty()) {
+      // Refill half the cache at once, to take the lock less often.
+      cache.resize(ThreadCacheLimit(size_class) / 2);
+      cache.resize(shared->Take(size_class, cache.data(), cache.size()));
+    }
+    if (!cache.empty()) {
+      data = cache.back();
+      cache.pop_back();
+      shared->pooled_bytes.fetch_sub(size, memory_order_relaxed);
+      shared->reused.fetch_add(1, memory_order_relaxed);
+      if (zero) memset(data, 0, length);
+    } else {
+      data = zero ? calloc(1, size) : malloc(size);
+    }
+  } else if (huge_pages_ && length >= kHugePageSize) {
+    data = MapHugePages(length);
+    if (data != NULL) {
+      shared->huge_page_buffers.fetch_add(1, memory_order_relaxed);
+    }
+  } else {
+    data = zero ? calloc(1, length) : malloc(length);
+  }
+  if (data == NULL) return NULL;
+
+  shared->allocations.fetch_add(1, memory_order_relaxed);
+  shared->allocated_bytes.fetch_add(length, memory_order_relaxed);
+  size_t live =
+      shared->live_bytes.fetch_add(length, memory_order_relaxed) + length;
+  size_t peak = shared->peak_live_bytes.load(memory_order_relaxed);
+  while (live > peak && !shared->peak_live_bytes.compare_exchange_weak(
+                            peak, live, memory_order_relaxed)) {
+  }
+  return data;
+}
+
+
+void PooledAllocator::Free(void* data, size_t length) {
+  if (data == NULL) return;
+  SharedPool* shared = Shared();
+  shared->live_bytes.fetch_sub(length, memory_order_relaxed);
+  if (length <= kMaxPooledSize) {
+    int size_class = SizeClass(length);
+    std::vector<void*>& cache = thread_cache.blocks[size_class];
+    size_t limit = ThreadCacheLimit(size_class);
+    if (cache.size() >= limit) {
+      // Hand half of the cache over, so the next frees do not have to.
+      shared->Put(size_class, cache.data() + limit / 2,
+                  cache.size() - limit / 2);
+      cache.resize(limit / 2);
+    }
+    cache.push_back(data);
+    shared->pooled_bytes.fetch_add(ClassSize(size_class),
+                                   memory_order_relaxed);
+  } else if (huge_pages_ && length >= kHugePageSize) {
+    munmap(data, HugePageLength(length));
+  } else {
+    free(data);
+  }
+}
+
+
+void PooledAllocator::GetStats(Stats* stats) {
+  SharedPool* shared = Shared();
+  stats->allocations = shared->allocations.load(memory_order_relaxed);
+  stats->allocated_bytes = shared->allocated_bytes.load(memory_order_relaxed);
+  stats->reused = shared->reused.load(memory_order_relaxed);
+  stats->huge_page_buffers =
+      shared->huge_page_buffers.load(memory_order_relaxed);
+  stats->live_bytes = shared->live_bytes.load(memory_order_relaxed);
+  stats->peak_live_bytes = shared->peak_live_bytes.load(memory_order_relaxed);
+  stats->pooled_bytes = shared->pooled_bytes.load(memory_order_relaxed);
+  stats->elapsed_s = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - shared->start)
+                         .count();
+}
+
+
+void PooledAllocator::PrintStats(FILE* out) {
+  if (!pool_made) return;
+  Stats stats;
+  GetStats(&stats);
+  double elapsed_s = stats.elapsed_s > 0 ? stats.elapsed_s : 1;
+  fprintf(out,
+          "ArrayBuffers: %llu allocations (%.0f/s, %.0f%% reused), "
+          "%.1f MB allocated (%.1f MB/s), %zu bytes live (peak %zu), "
+          "%zu bytes pooled, %llu on huge pages\n",
+          static_cast<unsigned long long>(stats.allocations),
+          stats.allocations / elapsed_s,
+          stats.allocations > 0 ? 100.0 * stats.reused / stats.allocations
+                                : 0.0,
+          stats.allocated_bytes / 1048576.0,
+          stats.allocated_bytes / 1048576.0 / elapsed_s, stats.live_bytes,
+          stats.peak_live_bytes, stats.pooled_bytes,
+          static_cast<unsigned long long>(stats.huge_page_buffers));
+}
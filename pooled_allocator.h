@@ -0,0 +1,120 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef POOLED_ALLOCATOR_H_
+#define POOLED_ALLOCATOR_H_
+
+#include <include/v8.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+
+/**
+ * The ArrayBuffer allocators the programs can be run with.
+ */
+enum ArrayBufferAllocatorKind {
+  // V8's default allocator, which goes to calloc for every buffer.
+  kDefaultAllocator,
+  // A PooledAllocator.
+  kPooledAllocator,
+  // A PooledAllocator backing large buffers with huge pages.
+  kHugePageAllocator
+};
+
+// Parses the value of an allocator option: "default", "pooled" or
+// "huge".  Returns false for anything else.
+bool ParseAllocatorKind(const std::string& name,
+                        ArrayBufferAllocatorKind* kind);
+
+// Makes an ArrayBuffer allocator of the given kind.  Give it to V8 as
+// CreateParams::array_buffer_allocator_shared: the backing stores of an
+// isolate may outlive it, and they free their memory through it.
+std::shared_ptr<v8::ArrayBuffer::Allocator> NewArrayBufferAllocator(
+    ArrayBufferAllocatorKind kind);
+
+
+/**
+ * An ArrayBuffer allocator that keeps freed buffers for reuse.  Buffers
+ * of up to kMaxPooledSize bytes are rounded up to a power of two, and
+ * freed ones go onto a free list of their size class: first one cached
+ * by the freeing thread, then, when that is full, one shared by all
+ * threads.  Scripts that keep making short-lived typed arrays get them
+ * from those lists rather than from malloc.
+ *
+ * Larger buffers are allocated on their own.  With huge pages, those of
+ * at least kHugePageSize bytes are mapped at huge page boundaries and
+ * the kernel is asked to back them with transparent huge pages.
+ *
+ * The free lists and counters are shared by all pooled allocators in
+ * the process, so one allocator per isolate is fine, and so are buffers
+ * freed on threads other than the one that allocated them.
+ */
+class PooledAllocator : public v8::ArrayBuffer::Allocator {
+ public:
+  // The smallest and largest pooled buffers.
+  static const size_t kMinPooledSize = 16;
+  static const size_t kMaxPooledSize = 256 * 1024;
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  // The counters of all pooled allocators in the process.
+  struct Stats {
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    // Allocations served from a free list.
+    uint64_t reused;
+    uint64_t huge_page_buffers;
+    // Bytes in buffers not freed yet, as requested by V8.
+    size_t live_bytes;
+    size_t peak_live_bytes;
+    // Bytes held on the free lists.
+    size_t pooled_bytes;
+    // Seconds since the first pooled allocator was made.
+    double elapsed_s;
+  };
+
+  explicit PooledAllocator(bool huge_pages);
+
+  void* Allocate(size_t length) override;
+  void* AllocateUninitialized(size_t length) override;
+  void Free(void* data, size_t length) override;
+
+  static void GetStats(Stats* stats);
+  // Prints the counters and the allocation rate, if a pooled allocator
+  // was ever made.
+  static void PrintStats(FILE* out);
+
+ private:
+  void* AllocateBuffer(size_t length, bool zero);
+
+  bool huge_pages_;
+};
+
+#endif  // POOLED_ALLOCATOR_H_
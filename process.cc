@@ -24,648 +24,33 @@
 // THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
 #include <include/v8.h>
 
 #include <include/libplatform/libplatform.h>
 
+#include "access_log.h"
+#include "http_processor.h"
+#include "processor_pool.h"
+
 #include <stdlib.h>
-#include <string.h>
 
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 using std::map;
 using std::pair;
 using std::string;
 
-using v8::Context;
-using v8::EscapableHandleScope;
-using v8::External;
-using v8::Function;
-using v8::FunctionTemplate;
-using v8::Global;
 using v8::HandleScope;
 using v8::Isolate;
-using v8::Local;
-using v8::MaybeLocal;
-using v8::Name;
-using v8::NamedPropertyHandlerConfiguration;
-using v8::NewStringType;
-using v8::Object;
-using v8::ObjectTemplate;
-using v8::PropertyCallbackInfo;
-using v8::Script;
-using v8::String;
-using v8::TryCatch;
-using v8::Value;
-
-// These interfaces represent an existing request processing interface.
-// The idea is to imagine a real application that uses these interfaces
-// and then add scripting capabilities that allow you to interact with
-// the objects through JavaScript.
-
-/**
- * A simplified http request.
- */
-class HttpRequest {
- public:
-  virtual ~HttpRequest() { }
-  virtual const string& Path() = 0;
-  virtual const string& Referrer() = 0;
-  virtual const string& Host() = 0;
-  virtual const string& UserAgent() = 0;
-};
-
-
-/**
- * The abstract superclass of http request processors.
- */
-class HttpRequestProcessor {
- public:
-  virtual ~HttpRequestProcessor() { }
-
-  // Initialize this processor.  The map contains options that control
-  // how requests should be processed.
-  virtual bool Initialize(map<string, string>* options,
-                          map<string, string>* output) = 0;
-
-  // Process a single request.
-  virtual bool Process(HttpRequest* req) = 0;
-
-  static void Log(const char* event);
-};
-
-
-/**
- * An http request processor that is scriptable using JavaScript.
- */
-class JsHttpRequestProcessor : public HttpRequestProcessor {
- public:
-  // Creates a new processor that processes requests by invoking the
-  // Process function of the JavaScript script given as an argument.
-  JsHttpRequestProcessor(Isolate* isolate, Local<String> script)
-      : isolate_(isolate), script_(script) {}
-  virtual ~JsHttpRequestProcessor();
-
-  virtual bool Initialize(map<string, string>* opts,
-                          map<string, string>* output);
-  virtual bool Process(HttpRequest* req);
-
- private:
-  // Execute the script associated with this processor and extract the
-  // Process function.  Returns true if this succeeded, otherwise false.
-  bool ExecuteScript(Local<String> script);
-
-  // Wrap the options and output map in a JavaScript objects and
-  // install it in the global namespace as 'options' and 'output'.
-  bool InstallMaps(map<string, string>* opts, map<string, string>* output);
-
-  // Constructs the template that describes the JavaScript wrapper
-  // type for requests.
-  static Local<ObjectTemplate> MakeRequestTemplate(Isolate* isolate);
-  static Local<ObjectTemplate> MakeMapTemplate(Isolate* isolate);
-
-  // Callbacks that access the individual fields of request objects.
-  static void GetPath(Local<String> name,
-                      const PropertyCallbackInfo<Value>& info);
-  static void GetReferrer(Local<String> name,
-                          const PropertyCallbackInfo<Value>& info);
-  static void GetHost(Local<String> name,
-                      const PropertyCallbackInfo<Value>& info);
-  static void GetUserAgent(Local<String> name,
-                           const PropertyCallbackInfo<Value>& info);
-
-  // Callbacks that access maps
-  static void MapGet(Local<Name> name, const PropertyCallbackInfo<Value>& info);
-  static void MapSet(Local<Name> name, Local<Value> value,
-                     const PropertyCallbackInfo<Value>& info);
-
-  // Utility methods for wrapping C++ objects as JavaScript objects,
-  // and going back again.
-  Local<Object> WrapMap(map<string, string>* obj);
-  static map<string, string>* UnwrapMap(Local<Object> obj);
-  Local<Object> WrapRequest(HttpRequest* obj);
-  static HttpRequest* UnwrapRequest(Local<Object> obj);
-
-  Isolate* GetIsolate() { return isolate_; }
-
-  Isolate* isolate_;
-  Local<String> script_;
-  Global<Context> context_;
-  Global<Function> process_;
-  static Global<ObjectTemplate> request_template_;
-  static Global<ObjectTemplate> map_template_;
-};
-
-
-// -------------------------
-// --- P r o c e s s o r ---
-// -------------------------
-
-
-static void LogCallback(const v8::FunctionCallbackInfo<v8::Value>& args) {
-  if (args.Length() < 1) return;
-  Isolate* isolate = args.GetIsolate();
-  HandleScope scope(isolate);
-  Local<Value> arg = args[0];
-  String::Utf8Value value(isolate, arg);
-  HttpRequestProcessor::Log(*value);
-}
-
-
-// Execute the script and fetch the Process method.
-bool JsHttpRequestProcessor::Initialize(map<string, string>* opts,
-                                        map<string, string>* output) {
-  // Create a handle scope to hold the temporary references.
-  HandleScope handle_scope(GetIsolate());
-
-  // Create a template for the global object where we set the
-  // built-in global functions.
-  Local<ObjectTemplate> global = ObjectTemplate::New(GetIsolate());
-  global->Set(String::NewFromUtf8(GetIsolate(), "log", NewStringType::kNormal)
-                  .ToLocalChecked(),
-              FunctionTemplate::New(GetIsolate(), LogCallback));
-
-  // Each processor gets its own context so different processors don't
-  // affect each other. Context::New returns a persistent handle which
-  // is what we need for the reference to remain after we return from
-  // this method. That persistent handle has to be disposed in the
-  // destructor.
-  v8::Local<v8::Context> context = Context::New(GetIsolate(), NULL, global);
-  context_.Reset(GetIsolate(), context);
-
-  // Enter the new context so all the following operations take place
-  // within it.
-  Context::Scope context_scope(context);
-
-  // Make the options mapping available within the context
-  if (!InstallMaps(opts, output))
-    return false;
-
-  // Compile and run the script
-  if (!ExecuteScript(script_))
-    return false;
-
-  // The script compiled and ran correctly.  Now we fetch out the
-  // Process function from the global object.
-  Local<String> process_name =
-      String::NewFromUtf8(GetIsolate(), "Process", NewStringType::kNormal)
-          .ToLocalChecked();
-  Local<Value> process_val;
-  // If there is no Process function, or if it is not a function,
-  // bail out
-  if (!context->Global()->Get(context, process_name).ToLocal(&process_val) ||
-      !process_val->IsFunction()) {
-    return false;
-  }
-
-  // It is a function; cast it to a Function
-  Local<Function> process_fun = Local<Function>::Cast(process_val);
-
-  // Store the function in a Global handle, since we also want
-  // that to remain after this call returns
-  process_.Reset(GetIsolate(), process_fun);
-
-  // All done; all went well
-  return true;
-}
-
-
-bool JsHttpRequestProcessor::ExecuteScript(Local<String> script) {
-  HandleScope handle_scope(GetIsolate());
-
-  // We're just about to compile the script; set up an error handler to
-  // catch any exceptions the script might throw.
-  TryCatch try_catch(GetIsolate());
-
-  Local<Context> context(GetIsolate()->GetCurrentContext());
-
-  // Compile the script and check for errors.
-  Local<Script> compiled_script;
-  if (!Script::Compile(context, script).ToLocal(&compiled_script)) {
-    String::Utf8Value error(GetIsolate(), try_catch.Exception());
-    Log(*error);
-    // The script failed to compile; bail out.
-    return false;
-  }
-
-  // Run the script!
-  Local<Value> result;
-  if (!compiled_script->Run(context).ToLocal(&result)) {
-    // The TryCatch above is still in effect and will have caught the error.
-    String::Utf8Value error(GetIsolate(), try_catch.Exception());
-    Log(*error);
-    // Running the script failed; bail out.
-    return false;
-  }
-
-  return true;
-}
-
-
-bool JsHttpRequestProcessor::InstallMaps(map<string, string>* opts,
-                                         map<string, string>* output) {
-  HandleScope handle_scope(GetIsolate());
-
-  // Wrap the map object in a JavaScript wrapper
-  Local<Object> opts_obj = WrapMap(opts);
-
-  v8::Local<v8::Context> context =
-      v8::Local<v8::Context>::New(GetIsolate(), context_);
-
-  // Set the options object as a property on the global object.
-  context->Global()
-      ->Set(context,
-            String::NewFromUtf8(GetIsolate(), "options", NewStringType::kNormal)
-                .ToLocalChecked(),
-            opts_obj)
-      .FromJust();
-
-  Local<Object> output_obj = WrapMap(output);
-  context->Global()
-      ->Set(context,
-            String::NewFromUtf8(GetIsolate(), "output", NewStringType::kNormal)
-                .ToLocalChecked(),
-            output_obj)
-      .FromJust();
-
-  return true;
-}
-
-
-bool JsHttpRequestProcessor::Process(HttpRequest* request) {
-  // Create a handle scope to keep the temporary object references.
-  HandleScope handle_scope(GetIsolate());
-
-  v8::Local<v8::Context> context =
-      v8::Local<v8::Context>::New(GetIsolate(), context_);
-
-  // Enter this processor's context so all the remaining operations
-  // take place there
-  Context::Scope context_scope(context);
-
-  // Wrap the C++ request object in a JavaScript wrapper
-  Local<Object> request_obj = WrapRequest(request);
-
-  // Set up an exception handler before calling the Process function
-  TryCatch try_catch(GetIsolate());
-
-  // Invoke the process function, giving the global object as 'this'
-  // and one argument, the request.
-  const int argc = 1;
-  Local<Value> argv[argc] = {request_obj};
-  v8::Local<v8::Function> process =
-      v8::Local<v8::Function>::New(GetIsolate(), process_);
-  Local<Value> result;
-  if (!process->Call(context, context->Global(), argc, argv).ToLocal(&result)) {
-    String::Utf8Value error(GetIsolate(), try_catch.Exception());
-    Log(*error);
-    return false;
-  }
-  return true;
-}
-
-
-JsHttpRequestProcessor::~JsHttpRequestProcessor() {
-  // Dispose the persistent handles.  When no one else has any
-  // references to the objects stored in the handles they will be
-  // automatically reclaimed.
-  context_.Reset();
-  process_.Reset();
-}
-
-
-Global<ObjectTemplate> JsHttpRequestProcessor::request_template_;
-Global<ObjectTemplate> JsHttpRequestProcessor::map_template_;
-
-
-// -----------------------------------
-// --- A c c e s s i n g   M a p s ---
-// -----------------------------------
-
-// Utility function that wraps a C++ http request object in a
-// JavaScript object.
-Local<Object> JsHttpRequestProcessor::WrapMap(map<string, string>* obj) {
-  // Local scope for temporary handles.
-  EscapableHandleScope handle_scope(GetIsolate());
-
-  // Fetch the template for creating JavaScript map wrappers.
-  // It only has to be created once, which we do on demand.
-  if (map_template_.IsEmpty()) {
-    Local<ObjectTemplate> raw_template = MakeMapTemplate(GetIsolate());
-    map_template_.Reset(GetIsolate(), raw_template);
-  }
-  Local<ObjectTemplate> templ =
-      Local<ObjectTemplate>::New(GetIsolate(), map_template_);
-
-  // Create an empty map wrapper.
-  Local<Object> result =
-      templ->NewInstance(GetIsolate()->GetCurrentContext()).ToLocalChecked();
-
-  // Wrap the raw C++ pointer in an External so it can be referenced
-  // from within JavaScript.
-  Local<External> map_ptr = External::New(GetIsolate(), obj);
-
-  // Store the map pointer in the JavaScript wrapper.
-  result->SetInternalField(0, map_ptr);
-
-  // Return the result through the current handle scope.  Since each
-  // of these handles will go away when the handle scope is deleted
-  // we need to call Close to let one, the result, escape into the
-  // outer handle scope.
-  return handle_scope.Escape(result);
-}
-
-
-// Utility function that extracts the C++ map pointer from a wrapper
-// object.
-map<string, string>* JsHttpRequestProcessor::UnwrapMap(Local<Object> obj) {
-  Local<External> field = Local<External>::Cast(obj->GetInternalField(0));
-  void* ptr = field->Value();
-  return static_cast<map<string, string>*>(ptr);
-}
-
-
-// Convert a JavaScript string to a std::string.  To not bother too
-// much with string encodings we just use ascii.
-string ObjectToString(v8::Isolate* isolate, Local<Value> value) {
-  String::Utf8Value utf8_value(isolate, value);
-  return string(*utf8_value);
-}
-
-
-void JsHttpRequestProcessor::MapGet(Local<Name> name,
-                                    const PropertyCallbackInfo<Value>& info) {
-  if (name->IsSymbol()) return;
-
-  // Fetch the map wrapped by this object.
-  map<string, string>* obj = UnwrapMap(info.Holder());
-
-  // Convert the JavaScript string to a std::string.
-  string key = ObjectToString(info.GetIsolate(), Local<String>::Cast(name));
-
-  // Look up the value if it exists using the standard STL ideom.
-  map<string, string>::iterator iter = obj->find(key);
-
-  // If the key is not present return an empty handle as signal
-  if (iter == obj->end()) return;
-
-  // Otherwise fetch the value and wrap it in a JavaScript string
-  const string& value = (*iter).second;
-  info.GetReturnValue().Set(
-      String::NewFromUtf8(info.GetIsolate(), value.c_str(),
-                          NewStringType::kNormal,
-                          static_cast<int>(value.length())).ToLocalChecked());
-}
-
-
-void JsHttpRequestProcessor::MapSet(Local<Name> name, Local<Value> value_obj,
-                                    const PropertyCallbackInfo<Value>& info) {
-  if (name->IsSymbol()) return;
-
-  // Fetch the map wrapped by this object.
-  map<string, string>* obj = UnwrapMap(info.Holder());
-
-  // Convert the key and value to std::strings.
-  string key = ObjectToString(info.GetIsolate(), Local<String>::Cast(name));
-  string value = ObjectToString(info.GetIsolate(), value_obj);
-
-  // Update the map.
-  (*obj)[key] = value;
-
-  // Return the value; any non-empty handle will work.
-  info.GetReturnValue().Set(value_obj);
-}
-
-
-Local<ObjectTemplate> JsHttpRequestProcessor::MakeMapTemplate(
-    Isolate* isolate) {
-  EscapableHandleScope handle_scope(isolate);
-
-  Local<ObjectTemplate> result = ObjectTemplate::New(isolate);
-  result->SetInternalFieldCount(1);
-  result->SetHandler(NamedPropertyHandlerConfiguration(MapGet, MapSet));
-
-  // Again, return the result through the current handle scope.
-  return handle_scope.Escape(result);
-}
-
-
-// -------------------------------------------
-// --- A c c e s s i n g   R e q u e s t s ---
-// -------------------------------------------
-
-/**
- * Utility function that wraps a C++ http request object in a
- * JavaScript object.
- */
-Local<Object> JsHttpRequestProcessor::WrapRequest(HttpRequest* request) {
-  // Local scope for temporary handles.
-  EscapableHandleScope handle_scope(GetIsolate());
-
-  // Fetch the template for creating JavaScript http request wrappers.
-  // It only has to be created once, which we do on demand.
-  if (request_template_.IsEmpty()) {
-    Local<ObjectTemplate> raw_template = MakeRequestTemplate(GetIsolate());
-    request_template_.Reset(GetIsolate(), raw_template);
-  }
-  Local<ObjectTemplate> templ =
-      Local<ObjectTemplate>::New(GetIsolate(), request_template_);
-
-  // Create an empty http request wrapper.
-  Local<Object> result =
-      templ->NewInstance(GetIsolate()->GetCurrentContext()).ToLocalChecked();
-
-  // Wrap the raw C++ pointer in an External so it can be referenced
-  // from within JavaScript.
-  Local<External> request_ptr = External::New(GetIsolate(), request);
-
-  // Store the request pointer in the JavaScript wrapper.
-  result->SetInternalField(0, request_ptr);
-
-  // Return the result through the current handle scope.  Since each
-  // of these handles will go away when the handle scope is deleted
-  // we need to call Close to let one, the result, escape into the
-  // outer handle scope.
-  return handle_scope.Escape(result);
-}
-
-
-/**
- * Utility function that extracts the C++ http request object from a
- * wrapper object.
- */
-HttpRequest* JsHttpRequestProcessor::UnwrapRequest(Local<Object> obj) {
-  Local<External> field = Local<External>::Cast(obj->GetInternalField(0));
-  void* ptr = field->Value();
-  return static_cast<HttpRequest*>(ptr);
-}
-
-
-void JsHttpRequestProcessor::GetPath(Local<String> name,
-                                     const PropertyCallbackInfo<Value>& info) {
-  // Extract the C++ request object from the JavaScript wrapper.
-  HttpRequest* request = UnwrapRequest(info.Holder());
-
-  // Fetch the path.
-  const string& path = request->Path();
-
-  // Wrap the result in a JavaScript string and return it.
-  info.GetReturnValue().Set(
-      String::NewFromUtf8(info.GetIsolate(), path.c_str(),
-                          NewStringType::kNormal,
-                          static_cast<int>(path.length())).ToLocalChecked());
-}
-
-
-void JsHttpRequestProcessor::GetReferrer(
-    Local<String> name,
-    const PropertyCallbackInfo<Value>& info) {
-  HttpRequest* request = UnwrapRequest(info.Holder());
-  const string& path = request->Referrer();
-  info.GetReturnValue().Set(
-      String::NewFromUtf8(info.GetIsolate(), path.c_str(),
-                          NewStringType::kNormal,
-                          static_cast<int>(path.length())).ToLocalChecked());
-}
-
-
-void JsHttpRequestProcessor::GetHost(Local<String> name,
-                                     const PropertyCallbackInfo<Value>& info) {
-  HttpRequest* request = UnwrapRequest(info.Holder());
-  const string& path = request->Host();
-  info.GetReturnValue().Set(
-      String::NewFromUtf8(info.GetIsolate(), path.c_str(),
-                          NewStringType::kNormal,
-                          static_cast<int>(path.length())).ToLocalChecked());
-}
-
-
-void JsHttpRequestProcessor::GetUserAgent(
-    Local<String> name,
-    const PropertyCallbackInfo<Value>& info) {
-  HttpRequest* request = UnwrapRequest(info.Holder());
-  const string& path = request->UserAgent();
-  info.GetReturnValue().Set(
-      String::NewFromUtf8(info.GetIsolate(), path.c_str(),
-                          NewStringType::kNormal,
-                          static_cast<int>(path.length())).ToLocalChecked());
-}
-
-
-Local<ObjectTemplate> JsHttpRequestProcessor::MakeRequestTemplate(
-    Isolate* isolate) {
-  EscapableHandleScope handle_scope(isolate);
-
-  Local<ObjectTemplate> result = ObjectTemplate::New(isolate);
-  result->SetInternalFieldCount(1);
-
-  // Add accessors for each of the fields of the request.
-  result->SetAccessor(
-      String::NewFromUtf8(isolate, "path", NewStringType::kInternalized)
-          .ToLocalChecked(),
-      GetPath);
-  result->SetAccessor(
-      String::NewFromUtf8(isolate, "referrer", NewStringType::kInternalized)
-          .ToLocalChecked(),
-      GetReferrer);
-  result->SetAccessor(
-      String::NewFromUtf8(isolate, "host", NewStringType::kInternalized)
-          .ToLocalChecked(),
-      GetHost);
-  result->SetAccessor(
-      String::NewFromUtf8(isolate, "userAgent", NewStringType::kInternalized)
-          .ToLocalChecked(),
-      GetUserAgent);
-
-  // Again, return the result through the current handle scope.
-  return handle_scope.Escape(result);
-}
+using v8::StartupData;
 
 
 // --- Test ---
 
 
-void HttpRequestProcessor::Log(const char* event) {
-  printf("Logged: %s\n", event);
-}
-
-
-/**
- * A simplified http request.
- */
-class StringHttpRequest : public HttpRequest {
- public:
-  StringHttpRequest(const string& path,
-                    const string& referrer,
-                    const string& host,
-                    const string& user_agent);
-  virtual const string& Path() { return path_; }
-  virtual const string& Referrer() { return referrer_; }
-  virtual const string& Host() { return host_; }
-  virtual const string& UserAgent() { return user_agent_; }
- private:
-  string path_;
-  string referrer_;
-  string host_;
-  string user_agent_;
-};
-
-
-StringHttpRequest::StringHttpRequest(const string& path,
-                                     const string& referrer,
-                                     const string& host,
-                                     const string& user_agent)
-    : path_(path),
-      referrer_(referrer),
-      host_(host),
-      user_agent_(user_agent) { }
-
-
-void ParseOptions(int argc,
-                  char* argv[],
-                  map<string, string>* options,
-                  string* file) {
-  for (int i = 1; i < argc; i++) {
-    string arg = argv[i];
-    size_t index = arg.find('=', 0);
-    if (index == string::npos) {
-      *file = arg;
-    } else {
-      string key = arg.substr(0, index);
-      string value = arg.substr(index+1);
-      (*options)[key] = value;
-    }
-  }
-}
-
-
-// Reads a file into a v8 string.
-MaybeLocal<String> ReadFile(Isolate* isolate, const string& name) {
-  FILE* file = fopen(name.c_str(), "rb");
-  if (file == NULL) return MaybeLocal<String>();
-
-  fseek(file, 0, SEEK_END);
-  size_t size = ftell(file);
-  rewind(file);
-
-  std::unique_ptr<char> chars(new char[size + 1]);
-  chars.get()[size] = '\0';
-  for (size_t i = 0; i < size;) {
-    i += fread(&chars.get()[i], 1, size - i, file);
-    if (ferror(file)) {
-      fclose(file);
-      return MaybeLocal<String>();
-    }
-  }
-  fclose(file);
-  MaybeLocal<String> result = String::NewFromUtf8(
-      isolate, chars.get(), NewStringType::kNormal, static_cast<int>(size));
-  return result;
-}
-
-
 const int kSampleSize = 6;
 StringHttpRequest kSampleRequests[kSampleSize] = {
   StringHttpRequest("/process.cc", "localhost", "google.com", "firefox"),
@@ -677,16 +62,63 @@ StringHttpRequest kSampleRequests[kSampleSize] = {
 };
 
 bool ProcessEntries(v8::Isolate* isolate, v8::Platform* platform,
-                    HttpRequestProcessor* processor, int count,
-                    StringHttpRequest* reqs) {
-  for (int i = 0; i < count; i++) {
-    bool result = processor->Process(&reqs[i]);
-    while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
-    if (!result) return false;
+                    JsHttpRequestProcessor* processor, int count,
+                    StringHttpRequest* reqs, int batch_size) {
+  if (batch_size <= 1) {
+    for (int i = 0; i < count; i++) {
+      // Requests the processor dropped are counted there; only a failing
+      // script ends the run.
+      int dropped = processor->dropped_requests();
+      bool result = processor->Process(&reqs[i]);
+      DrainMessageLoop(platform, isolate, processor->metrics());
+      if (!result && processor->dropped_requests() == dropped) return false;
+    }
+    return true;
+  }
+
+  // Hand the requests over batch_size at a time and only drain the
+  // message loop between batches.
+  std::vector<HttpRequest*> batch(batch_size);
+  std::unique_ptr<bool[]> results(new bool[batch_size]);
+  for (int i = 0; i < count; i += batch_size) {
+    int n = count - i < batch_size ? count - i : batch_size;
+    for (int j = 0; j < n; j++) batch[j] = &reqs[i + j];
+    int dropped = processor->dropped_requests();
+    bool result = processor->ProcessBatch(&batch[0], n, results.get());
+    DrainMessageLoop(platform, isolate, processor->metrics());
+    if (!result && processor->dropped_requests() == dropped) return false;
+  }
+  return true;
+}
+
+// Streams the requests of an access log through the processor.  Only
+// one batch of requests exists at a time and the log pages are dropped
+// behind the reader, so memory use does not grow with the log.
+bool ProcessLog(v8::Isolate* isolate, v8::Platform* platform,
+                JsHttpRequestProcessor* processor,
+                AccessLogReader* reader, int batch_size) {
+  std::vector<LogHttpRequest> requests(batch_size);
+  std::vector<HttpRequest*> batch(batch_size);
+  std::unique_ptr<bool[]> results(new bool[batch_size]);
+  for (int i = 0; i < batch_size; i++) batch[i] = &requests[i];
+  while (true) {
+    int n = 0;
+    while (n < batch_size && reader->Next(&requests[n])) n++;
+    if (n == 0) break;
+    int dropped = processor->dropped_requests();
+    bool result = batch_size == 1
+                      ? processor->Process(batch[0])
+                      : processor->ProcessBatch(&batch[0], n, results.get());
+    DrainMessageLoop(platform, isolate, processor->metrics());
+    if (!result && processor->dropped_requests() == dropped) return false;
+    reader->Release();
   }
+  if (reader->skipped() > 0)
+    fprintf(stderr, "Skipped %d malformed log lines.\n", reader->skipped());
   return true;
 }
 
+// Prints the output, one "key: value" line per key in key order.
 void PrintMap(map<string, string>* m) {
   for (map<string, string>::iterator i = m->begin(); i != m->end(); i++) {
     pair<string, string> entry = *i;
@@ -704,30 +136,106 @@ int main(int argc, char* argv[]) {
   map<string, string> options;
   string file;
   ParseOptions(argc, argv, &options, &file);
-  if (file.empty()) {
-    fprintf(stderr, "No script was specified.\n");
-    return 1;
+  ProcessorConfig config;
+  if (!ConfigureProcessor(options, file, &config)) return 1;
+
+  map<string, string>::iterator snapshot_out = options.find("snapshot_out");
+  if (snapshot_out != options.end()) {
+    StartupData blob;
+    if (config.snapshot != NULL ||
+        !JsHttpRequestProcessor::CreateSnapshot(
+            string(config.source->data(), config.source->size()), &options,
+            &blob)) {
+      fprintf(stderr, "Error creating snapshot.\n");
+      return 1;
+    }
+    bool written = WriteFileContents(snapshot_out->second, blob.data,
+                                     static_cast<size_t>(blob.raw_size));
+    delete[] blob.data;
+    if (!written) {
+      fprintf(stderr, "Error writing '%s'.\n", snapshot_out->second.c_str());
+      return 1;
+    }
+    return 0;
+  }
+
+  // 'log=<file>' processes the requests of an access log instead of the
+  // samples; with several workers every worker reads its own part of the
+  // log.  The log is mapped for as long as the isolates live, since
+  // request strings may point into it.
+  int worker_count = GetWorkerCount(options);
+  AccessLogReader log_reader;
+  LogRequestSource log_source;
+  map<string, string>::iterator log_file = options.find("log");
+  if (log_file != options.end()) {
+    bool opened = worker_count > 1
+                      ? log_source.Open(log_file->second, worker_count)
+                      : log_reader.Open(log_file->second);
+    if (!opened) {
+      fprintf(stderr, "Error reading '%s'.\n", log_file->second.c_str());
+      return 1;
+    }
+  }
+
+  if (worker_count > 1) {
+    WorkStealingQueue queue(worker_count);
+    RequestSource* source = &log_source;
+    if (log_file == options.end()) {
+      std::vector<HttpRequest*> samples;
+      for (int i = 0; i < kSampleSize; i++)
+        samples.push_back(&kSampleRequests[i]);
+      queue.PushAll(&samples[0], samples.size());
+      source = &queue;
+    }
+    map<string, string> output;
+    PoolStats stats;
+    if (!RunProcessorPool(platform.get(), config, options, worker_count,
+                          std::vector<HttpRequest*>(), source, &output,
+                          &stats)) {
+      return 1;
+    }
+    if (log_source.skipped() > 0) {
+      fprintf(stderr, "Skipped %d malformed log lines.\n",
+              log_source.skipped());
+    }
+    if (stats.dropped_requests > 0) {
+      fprintf(stderr, "Dropped %lld requests; %d calls timed out.\n",
+              static_cast<long long>(stats.dropped_requests), stats.timeouts);
+    }
+    if (config.code_cache) config.code_cache->PrintStats(stderr);
+    if (options.count("heap_stats") > 0) PooledAllocator::PrintStats(stderr);
+    PrintMap(&output);
+    return 0;
   }
   Isolate::CreateParams create_params;
-  create_params.array_buffer_allocator =
-      v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+  InitCreateParams(config, &create_params);
   Isolate* isolate = Isolate::New(create_params);
   Isolate::Scope isolate_scope(isolate);
   HandleScope scope(isolate);
-  Local<String> source;
-  if (!ReadFile(isolate, file).ToLocal(&source)) {
-    fprintf(stderr, "Error reading '%s'.\n", file.c_str());
-    return 1;
-  }
-  JsHttpRequestProcessor processor(isolate, source);
+  std::unique_ptr<JsHttpRequestProcessor> processor(
+      NewProcessor(isolate, config));
   map<string, string> output;
-  if (!processor.Initialize(&options, &output)) {
+  if (!processor->Initialize(&options, &output)) {
     fprintf(stderr, "Error initializing processor.\n");
     return 1;
   }
-  if (!ProcessEntries(isolate, platform.get(), &processor, kSampleSize,
-                      kSampleRequests)) {
-    return 1;
+  bool processed =
+      log_file != options.end()
+          ? ProcessLog(isolate, platform.get(), processor.get(), &log_reader,
+                       config.batch_size)
+          : ProcessEntries(isolate, platform.get(), processor.get(),
+                           kSampleSize, kSampleRequests, config.batch_size);
+  if (!processed) return 1;
+  processor->SyncOutput();
+  if (processor->dropped_requests() > 0) {
+    fprintf(stderr, "Dropped %d requests; %d calls timed out.\n",
+            processor->dropped_requests(), processor->timeouts());
+  }
+  if (config.count_allocations) processor->PrintAllocationStats(stderr);
+  if (options.count("heap_stats") > 0) {
+    processor->PrintHeapStatistics(stderr);
+    PooledAllocator::PrintStats(stderr);
   }
+  if (config.code_cache) config.code_cache->PrintStats(stderr);
   PrintMap(&output);
 }
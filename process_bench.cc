@@ -0,0 +1,609 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <include/v8.h>
+
+#include <include/libplatform/libplatform.h>
+
+#include "access_log.h"
+#include "http_processor.h"
+#include "processor_pool.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using std::map;
+using std::string;
+
+using v8::HandleScope;
+using v8::Isolate;
+
+// A benchmark driver for the request processor.  It generates (or loads)
+// a large set of requests, runs them through a JsHttpRequestProcessor
+// and prints throughput, latency percentiles and GC time as JSON:
+//
+//   process_bench count.js requests=1000000 hosts=1000 skew=1.1
+//
+// Besides the processor options understood by process (batch, store,
+// code_cache, snapshot, alloc_stats, budget_ms, wasm, allocator and the
+// heap options) it takes:
+//
+//   requests=N   number of requests to generate (default 1000000)
+//   hosts=N      number of distinct hosts (default 100)
+//   paths=N      number of distinct paths (default 1000)
+//   agents=N     number of distinct user agents (default 20)
+//   skew=S       Zipf exponent of the field distributions; 0 draws the
+//                values uniformly (default 1.0)
+//   seed=N       random seed (default 1)
+//   input=FILE   load requests from an access log instead, either in
+//                the combined log format or as tab separated path,
+//                referrer, host and user agent lines
+//   warmup=N     requests to run before measuring (default 10000)
+//   out=FILE     write the report to FILE instead of stdout
+//   workers=N,M  run the requests on a pool of N, then M, ... workers,
+//                each with its own isolate, and report the throughput
+//                of every pool size instead of the single isolate
+//                numbers; 'auto' is one worker per core, e.g.
+//                workers=1,2,4,8,16,32,auto
+
+
+/**
+ * Owns the distinct field values of all requests.  Values are kept in
+ * a deque so the strings never move and requests can point at them.
+ */
+class StringPool {
+ public:
+  const string* Intern(std::string_view value);
+  size_t size() const { return strings_.size(); }
+
+ private:
+  std::deque<string> strings_;
+  std::unordered_map<std::string_view, const string*> index_;
+};
+
+
+const string* StringPool::Intern(std::string_view value) {
+  std::unordered_map<std::string_view, const string*>::iterator iter =
+      index_.find(value);
+  if (iter != index_.end()) return iter->second;
+  strings_.push_back(string(value));
+  const string* result = &strings_.back();
+  index_[*result] = result;
+  return result;
+}
+
+
+/**
+ * A request whose fields live in a StringPool.
+ */
+class PooledHttpRequest : public HttpRequest {
+ public:
+  PooledHttpRequest(const string* path, const string* referrer,
+                    const string* host, const string* user_agent)
+      : path_(path), referrer_(referrer), host_(host),
+        user_agent_(user_agent) { }
+  virtual std::string_view Path() { return *path_; }
+  virtual std::string_view Referrer() { return *referrer_; }
+  virtual std::string_view Host() { return *host_; }
+  virtual std::string_view UserAgent() { return *user_agent_; }
+  virtual bool IsStorageStable() { return true; }
+
+ private:
+  const string* path_;
+  const string* referrer_;
+  const string* host_;
+  const string* user_agent_;
+};
+
+
+/**
+ * Draws ranks in [0, n) with probability proportional to 1 / (rank + 1)^s.
+ */
+class ZipfDistribution {
+ public:
+  ZipfDistribution(int n, double s);
+
+  int operator()(std::mt19937_64* random);
+
+ private:
+  std::vector<double> cdf_;
+  std::uniform_real_distribution<double> uniform_;
+};
+
+
+ZipfDistribution::ZipfDistribution(int n, double s) : cdf_(n) {
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += 1.0 / pow(i + 1.0, s);
+    cdf_[i] = sum;
+  }
+  for (int i = 0; i < n; i++) cdf_[i] /= sum;
+}
+
+
+int ZipfDistribution::operator()(std::mt19937_64* random) {
+  double u = uniform_(*random);
+  std::vector<double>::iterator iter =
+      std::lower_bound(cdf_.begin(), cdf_.end(), u);
+  if (iter == cdf_.end()) --iter;
+  return static_cast<int>(iter - cdf_.begin());
+}
+
+
+// Returns the integer value of an option, or the default if it is unset.
+static int64_t GetIntOption(const map<string, string>& options,
+                            const string& key, int64_t default_value) {
+  map<string, string>::const_iterator iter = options.find(key);
+  if (iter == options.end()) return default_value;
+  return strtoll(iter->second.c_str(), NULL, 10);
+}
+
+
+static void GenerateRequests(const map<string, string>& options,
+                             StringPool* pool,
+                             std::vector<PooledHttpRequest>* reqs) {
+  int64_t count = GetIntOption(options, "requests", 1000000);
+  int hosts = static_cast<int>(GetIntOption(options, "hosts", 100));
+  int paths = static_cast<int>(GetIntOption(options, "paths", 1000));
+  int agents = static_cast<int>(GetIntOption(options, "agents", 20));
+  map<string, string>::const_iterator skew_option = options.find("skew");
+  double skew = skew_option == options.end()
+                    ? 1.0
+                    : strtod(skew_option->second.c_str(), NULL);
+  std::mt19937_64 random(GetIntOption(options, "seed", 1));
+  ZipfDistribution host_rank(hosts < 1 ? 1 : hosts, skew);
+  ZipfDistribution path_rank(paths < 1 ? 1 : paths, skew);
+  ZipfDistribution agent_rank(agents < 1 ? 1 : agents, skew);
+
+  char buffer[128];
+  reqs->reserve(static_cast<size_t>(count));
+  for (int64_t i = 0; i < count; i++) {
+    int host = host_rank(&random);
+    snprintf(buffer, sizeof(buffer), "/page/%d.html", path_rank(&random));
+    const string* path = pool->Intern(buffer);
+    snprintf(buffer, sizeof(buffer), "http://www.site%d.com/", host);
+    const string* referrer = pool->Intern(buffer);
+    snprintf(buffer, sizeof(buffer), "site%d.com", host);
+    const string* host_name = pool->Intern(buffer);
+    snprintf(buffer, sizeof(buffer), "Mozilla/5.0 (compatible; Agent/%d)",
+             agent_rank(&random));
+    const string* user_agent = pool->Intern(buffer);
+    reqs->push_back(PooledHttpRequest(path, referrer, host_name, user_agent));
+  }
+}
+
+
+static bool LoadRequests(const string& name, StringPool* pool,
+                         std::vector<PooledHttpRequest>* reqs) {
+  AccessLogReader reader;
+  if (!reader.Open(name)) return false;
+  LogHttpRequest request;
+  while (reader.Next(&request)) {
+    reqs->push_back(PooledHttpRequest(
+        pool->Intern(request.Path()), pool->Intern(request.Referrer()),
+        pool->Intern(request.Host()), pool->Intern(request.UserAgent())));
+  }
+  return true;
+}
+
+
+/**
+ * Adds up the time the isolate spends in garbage collections.
+ */
+class GCTimer {
+ public:
+  explicit GCTimer(Isolate* isolate);
+  ~GCTimer();
+
+  int count() const { return count_; }
+  double total_ms() const { return total_ns_ / 1e6; }
+  void Reset() { count_ = 0; total_ns_ = 0; }
+
+ private:
+  static void OnPrologue(Isolate* isolate, v8::GCType type,
+                         v8::GCCallbackFlags flags, void* data);
+  static void OnEpilogue(Isolate* isolate, v8::GCType type,
+                         v8::GCCallbackFlags flags, void* data);
+
+  Isolate* isolate_;
+  // Collections can nest, e.g. a scavenge forced during a full GC, so
+  // only the outermost one is timed.
+  int depth_;
+  std::chrono::steady_clock::time_point start_;
+  int count_;
+  int64_t total_ns_;
+};
+
+
+GCTimer::GCTimer(Isolate* isolate)
+    : isolate_(isolate), depth_(0), count_(0), total_ns_(0) {
+  isolate_->AddGCPrologueCallback(OnPrologue, this);
+  isolate_->AddGCEpilogueCallback(OnEpilogue, this);
+}
+
+
+GCTimer::~GCTimer() {
+  isolate_->RemoveGCPrologueCallback(OnPrologue, this);
+  isolate_->RemoveGCEpilogueCallback(OnEpilogue, this);
+}
+
+
+void GCTimer::OnPrologue(Isolate* isolate, v8::GCType type,
+                         v8::GCCallbackFlags flags, void* data) {
+  GCTimer* timer = static_cast<GCTimer*>(data);
+  if (timer->depth_++ == 0) timer->start_ = std::chrono::steady_clock::now();
+}
+
+
+void GCTimer::OnEpilogue(Isolate* isolate, v8::GCType type,
+                         v8::GCCallbackFlags flags, void* data) {
+  GCTimer* timer = static_cast<GCTimer*>(data);
+  if (timer->depth_ == 0 || --timer->depth_ > 0) return;
+  timer->count_++;
+  timer->total_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - timer->start_)
+                          .count();
+}
+
+
+// Runs reqs[begin, end) through the processor batch_size at a time.  If
+// latencies is not NULL the duration of every call is appended to it.
+static bool RunRequests(Isolate* isolate, v8::Platform* platform,
+                        JsHttpRequestProcessor* processor,
+                        std::vector<PooledHttpRequest>* reqs, size_t begin,
+                        size_t end, int batch_size,
+                        std::vector<int64_t>* latencies) {
+  std::vector<HttpRequest*> batch(batch_size);
+  std::unique_ptr<bool[]> results(new bool[batch_size]);
+  for (size_t i = begin; i < end; i += batch_size) {
+    int n = static_cast<int>(std::min<size_t>(batch_size, end - i));
+    for (int j = 0; j < n; j++) batch[j] = &(*reqs)[i + j];
+    int dropped = processor->dropped_requests();
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    bool result = batch_size == 1
+                      ? processor->Process(batch[0])
+                      : processor->ProcessBatch(&batch[0], n, results.get());
+    if (latencies != NULL) {
+      latencies->push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count());
+    }
+    DrainMessageLoop(platform, isolate, processor->metrics());
+    // Timed out, shed and terminated requests are counted in the report,
+    // not fatal.
+    if (!result && processor->dropped_requests() == dropped) return false;
+  }
+  return true;
+}
+
+
+// Returns the nearest-rank percentile of sorted values.
+static int64_t Percentile(const std::vector<int64_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = static_cast<size_t>(ceil(p / 100.0 * sorted.size()));
+  if (rank > 0) rank--;
+  if (rank >= sorted.size()) rank = sorted.size() - 1;
+  return sorted[rank];
+}
+
+
+static string JsonEscape(const string& value) {
+  string result;
+  for (size_t i = 0; i < value.size(); i++) {
+    unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      result += buffer;
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+
+// Parses a comma separated list of worker counts.
+static bool ParseWorkerCounts(const string& value, std::vector<int>* counts) {
+  size_t begin = 0;
+  while (begin <= value.size()) {
+    size_t end = value.find(',', begin);
+    if (end == string::npos) end = value.size();
+    string item = value.substr(begin, end - begin);
+    int count = item == "auto"
+                    ? static_cast<int>(std::thread::hardware_concurrency())
+                    : atoi(item.c_str());
+    if (count < 1) return false;
+    counts->push_back(count);
+    begin = end + 1;
+  }
+  return !counts->empty();
+}
+
+
+// Runs all requests on a pool of each of the given sizes and reports the
+// throughput of each.  Every worker runs the warmup requests before the
+// clock starts; speedups are relative to the first pool size.
+static bool RunScaling(v8::Platform* platform, const ProcessorConfig& config,
+                       const map<string, string>& options,
+                       const std::vector<int>& worker_counts,
+                       std::vector<PooledHttpRequest>* reqs, size_t warmup,
+                       FILE* out) {
+  std::vector<HttpRequest*> requests(reqs->size());
+  for (size_t i = 0; i < reqs->size(); i++) requests[i] = &(*reqs)[i];
+  std::vector<HttpRequest*> warmup_requests(requests.begin(),
+                                            requests.begin() + warmup);
+  bool ok = true;
+  double base_rate = 0;
+  fprintf(out, "  \"scaling\": [\n");
+  for (size_t i = 0; i < worker_counts.size(); i++) {
+    WorkStealingQueue queue(worker_counts[i]);
+    queue.PushAll(&requests[0], requests.size());
+    map<string, string> output;
+    PoolStats stats;
+    if (!RunProcessorPool(platform, config, options, worker_counts[i],
+                          warmup_requests, &queue, &output, &stats)) {
+      fprintf(stderr, "Error processing requests with %d workers.\n",
+              worker_counts[i]);
+      ok = false;
+    }
+    double rate = stats.elapsed_s > 0 ? stats.requests / stats.elapsed_s : 0;
+    if (i == 0) base_rate = rate;
+    fprintf(out, "    {\"workers\": %d, \"elapsed_s\": %.6f, ",
+            worker_counts[i], stats.elapsed_s);
+    fprintf(out, "\"requests_per_second\": %.1f, \"speedup\": %.3f, ", rate,
+            base_rate > 0 ? rate / base_rate : 0.0);
+    fprintf(out, "\"timeouts\": %d, \"dropped_requests\": %lld, ",
+            stats.timeouts, static_cast<long long>(stats.dropped_requests));
+    fprintf(out, "\"worker_requests\": [");
+    for (size_t j = 0; j < stats.worker_requests.size(); j++) {
+      fprintf(out, "%s%lld", j > 0 ? ", " : "",
+              static_cast<long long>(stats.worker_requests[j]));
+    }
+    fprintf(out, "]}%s\n", i + 1 < worker_counts.size() ? "," : "");
+  }
+  fprintf(out, "  ],\n");
+  return ok;
+}
+
+
+int main(int argc, char* argv[]) {
+  v8::V8::InitializeICUDefaultLocation(argv[0]);
+  v8::V8::InitializeExternalStartupData(argv[0]);
+  std::unique_ptr<v8::Platform> platform = v8::platform::NewDefaultPlatform();
+  v8::V8::InitializePlatform(platform.get());
+  v8::V8::Initialize();
+  map<string, string> options;
+  string file;
+  ParseOptions(argc, argv, &options, &file);
+  ProcessorConfig config;
+  if (!ConfigureProcessor(options, file, &config)) return 1;
+
+  StringPool pool;
+  std::vector<PooledHttpRequest> reqs;
+  map<string, string>::iterator input = options.find("input");
+  if (input != options.end()) {
+    if (!LoadRequests(input->second, &pool, &reqs)) {
+      fprintf(stderr, "Error reading '%s'.\n", input->second.c_str());
+      return 1;
+    }
+  } else {
+    GenerateRequests(options, &pool, &reqs);
+  }
+  if (reqs.empty()) {
+    fprintf(stderr, "No requests to process.\n");
+    return 1;
+  }
+  size_t warmup = static_cast<size_t>(GetIntOption(options, "warmup", 10000));
+  if (warmup > reqs.size()) warmup = reqs.size();
+
+  FILE* out = stdout;
+  map<string, string>::iterator out_file = options.find("out");
+  if (out_file != options.end()) {
+    out = fopen(out_file->second.c_str(), "w");
+    if (out == NULL) {
+      fprintf(stderr, "Error writing '%s'.\n", out_file->second.c_str());
+      return 1;
+    }
+  }
+
+  map<string, string>::iterator workers = options.find("workers");
+  if (workers != options.end()) {
+    std::vector<int> worker_counts;
+    if (!ParseWorkerCounts(workers->second, &worker_counts)) {
+      fprintf(stderr, "Bad worker counts '%s'.\n", workers->second.c_str());
+      return 1;
+    }
+    fprintf(out, "{\n");
+    fprintf(out, "  \"script\": \"%s\",\n", JsonEscape(file).c_str());
+    fprintf(out, "  \"requests\": %zu,\n", reqs.size());
+    fprintf(out, "  \"warmup\": %zu,\n", warmup);
+    fprintf(out, "  \"distinct_values\": %zu,\n", pool.size());
+    fprintf(out, "  \"batch_size\": %d,\n", config.batch_size);
+    fprintf(out, "  \"native_store\": %s,\n",
+            config.native_store ? "true" : "false");
+    fprintf(out, "  \"cores\": %u,\n", std::thread::hardware_concurrency());
+    bool ok = RunScaling(platform.get(), config, options, worker_counts, &reqs,
+                         warmup, out);
+    if (config.code_cache != NULL) config.code_cache->PrintStats(stderr);
+    fprintf(out, "  \"ok\": %s\n", ok ? "true" : "false");
+    fprintf(out, "}\n");
+    if (out != stdout) fclose(out);
+    v8::V8::Dispose();
+    v8::V8::ShutdownPlatform();
+    return ok ? 0 : 1;
+  }
+
+  Isolate::CreateParams create_params;
+  InitCreateParams(config, &create_params);
+  Isolate* isolate = Isolate::New(create_params);
+  bool ok;
+  {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+    std::unique_ptr<JsHttpRequestProcessor> processor(
+        NewProcessor(isolate, config));
+    map<string, string> output;
+    if (!processor->Initialize(&options, &output)) {
+      fprintf(stderr, "Error initializing processor.\n");
+      return 1;
+    }
+
+    // The warmup pass runs the first requests unmeasured so the script is
+    // optimized before timing starts; the measured pass runs them all.
+    GCTimer gc_timer(isolate);
+    ok = RunRequests(isolate, platform.get(), processor.get(), &reqs, 0,
+                     warmup, config.batch_size, NULL);
+    gc_timer.Reset();
+    std::vector<int64_t> latencies;
+    latencies.reserve(reqs.size() / config.batch_size + 1);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    ok = ok && RunRequests(isolate, platform.get(), processor.get(), &reqs, 0,
+                           reqs.size(), config.batch_size, &latencies);
+    double elapsed_s =
+        std::chrono::duration_cast<std::chrono::duration<double> >(
+            std::chrono::steady_clock::now() - start)
+            .count();
+    processor->SyncOutput();
+    if (config.count_allocations) processor->PrintAllocationStats(stderr);
+    if (config.code_cache != NULL) config.code_cache->PrintStats(stderr);
+    if (!ok) fprintf(stderr, "Error processing requests.\n");
+
+    v8::HeapStatistics heap_stats;
+    isolate->GetHeapStatistics(&heap_stats);
+    double mean_ns = 0;
+    for (size_t i = 0; i < latencies.size(); i++) mean_ns += latencies[i];
+    if (!latencies.empty()) mean_ns /= latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+
+    // Latencies are per call, so with batch=N they cover N requests.
+    fprintf(out, "{\n");
+    fprintf(out, "  \"script\": \"%s\",\n", JsonEscape(file).c_str());
+    fprintf(out, "  \"requests\": %zu,\n", reqs.size());
+    fprintf(out, "  \"warmup\": %zu,\n", warmup);
+    fprintf(out, "  \"distinct_values\": %zu,\n", pool.size());
+    fprintf(out, "  \"batch_size\": %d,\n", config.batch_size);
+    fprintf(out, "  \"native_store\": %s,\n",
+            config.native_store ? "true" : "false");
+    fprintf(out, "  \"elapsed_s\": %.6f,\n", elapsed_s);
+    fprintf(out, "  \"requests_per_second\": %.1f,\n",
+            elapsed_s > 0 ? reqs.size() / elapsed_s : 0.0);
+    fprintf(out, "  \"latency_ns\": {\n");
+    fprintf(out, "    \"mean\": %.1f,\n", mean_ns);
+    fprintf(out, "    \"p50\": %lld,\n",
+            static_cast<long long>(Percentile(latencies, 50)));
+    fprintf(out, "    \"p99\": %lld,\n",
+            static_cast<long long>(Percentile(latencies, 99)));
+    fprintf(out, "    \"p999\": %lld,\n",
+            static_cast<long long>(Percentile(latencies, 99.9)));
+    fprintf(out, "    \"max\": %lld\n",
+            static_cast<long long>(latencies.empty() ? 0 : latencies.back()));
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"gc\": {\n");
+    fprintf(out, "    \"count\": %d,\n", gc_timer.count());
+    fprintf(out, "    \"total_ms\": %.3f,\n", gc_timer.total_ms());
+    fprintf(out, "    \"fraction\": %.4f\n",
+            elapsed_s > 0 ? gc_timer.total_ms() / 1000.0 / elapsed_s : 0.0);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"heap\": {\n");
+    fprintf(out, "    \"used_bytes\": %zu,\n", heap_stats.used_heap_size());
+    fprintf(out, "    \"total_bytes\": %zu,\n", heap_stats.total_heap_size());
+    fprintf(out, "    \"limit_bytes\": %zu,\n", heap_stats.heap_size_limit());
+    fprintf(out, "    \"external_bytes\": %zu,\n",
+            heap_stats.external_memory());
+    fprintf(out, "    \"limit_hits\": %d,\n", processor->heap_limit_hits());
+    fprintf(out, "    \"terminated_requests\": %d,\n",
+            processor->terminated_requests());
+    fprintf(out, "    \"shed_requests\": %d,\n", processor->shed_requests());
+    fprintf(out, "    \"restarts\": %d,\n", processor->restarts());
+    fprintf(out, "    \"restart_failed_requests\": %d\n",
+            processor->restart_failed_requests());
+    fprintf(out, "  },\n");
+    // Only the pooled allocators count what they allocate.
+    if (config.allocator != kDefaultAllocator) {
+      PooledAllocator::Stats buffers;
+      PooledAllocator::GetStats(&buffers);
+      fprintf(out, "  \"array_buffers\": {\n");
+      fprintf(out, "    \"allocations\": %llu,\n",
+              static_cast<unsigned long long>(buffers.allocations));
+      fprintf(out, "    \"allocations_per_s\": %.0f,\n",
+              elapsed_s > 0 ? buffers.allocations / elapsed_s : 0.0);
+      fprintf(out, "    \"allocated_bytes\": %llu,\n",
+              static_cast<unsigned long long>(buffers.allocated_bytes));
+      fprintf(out, "    \"reused\": %llu,\n",
+              static_cast<unsigned long long>(buffers.reused));
+      fprintf(out, "    \"live_bytes\": %zu,\n", buffers.live_bytes);
+      fprintf(out, "    \"peak_live_bytes\": %zu,\n",
+              buffers.peak_live_bytes);
+      fprintf(out, "    \"pooled_bytes\": %zu,\n", buffers.pooled_bytes);
+      fprintf(out, "    \"huge_page_buffers\": %llu\n",
+              static_cast<unsigned long long>(buffers.huge_page_buffers));
+      fprintf(out, "  },\n");
+    }
+    // Stage times cover warmup and initialization as well.
+    StageMetrics::Counters stages[kStageCount];
+    processor->metrics()->AddTo(stages);
+    fprintf(out, "  \"stages\": {\n");
+    for (int i = 0; i < kStageCount; i++) {
+      fprintf(out, "    \"%s\": {\"count\": %llu, \"total_ms\": %.3f}%s\n",
+              StageName(static_cast<Stage>(i)),
+              static_cast<unsigned long long>(stages[i].count),
+              stages[i].total_ns / 1e6, i + 1 < kStageCount ? "," : "");
+    }
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"timeouts\": %d,\n", processor->timeouts());
+    fprintf(out, "  \"dropped_requests\": %d,\n",
+            processor->dropped_requests());
+    fprintf(out, "  \"ok\": %s\n", ok ? "true" : "false");
+    fprintf(out, "}\n");
+  }
+  if (out != stdout) fclose(out);
+  isolate->Dispose();
+  v8::V8::Dispose();
+  v8::V8::ShutdownPlatform();
+  return ok ? 0 : 1;
+}
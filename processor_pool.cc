@@ -0,0 +1,375 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "processor_pool.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+
+using std::map;
+using std::string;
+
+using v8::HandleScope;
+using v8::Isolate;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+
+// Holds the workers back until all of them are ready, so the clock
+// starts once for all of them.
+class StartLine {
+ public:
+  explicit StartLine(int count) : waiting_(count) {}
+
+  void Arrive() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (--waiting_ == 0) {
+      start_ = Clock::now();
+      ready_.notify_all();
+      return;
+    }
+    ready_.wait(lock, [this]() { return waiting_ == 0; });
+  }
+
+  // Valid once every worker has arrived.
+  Clock::time_point start() const { return start_; }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  int waiting_;
+  Clock::time_point start_;
+};
+
+
+// One worker of a pool and what it did.
+struct PoolWorker {
+  int index;
+  v8::Platform* platform;
+  const ProcessorConfig* config;
+  const map<string, string>* options;
+  const std::vector<HttpRequest*>* warmup;
+  RequestSource* source;
+  StartLine* start_line;
+  std::atomic<bool>* failed;
+
+  map<string, string> output;
+  int64_t requests;
+  int dropped_requests;
+  int timeouts;
+  bool finished;
+  Clock::time_point finish;
+};
+
+
+// Parses a plain decimal number: an optional minus sign, digits and
+// optionally a fraction.  strtod alone would also take leading blanks,
+// hex, "inf" and "nan", and sum ids that merely look like numbers.
+bool ParseDecimal(const string& value, double* result) {
+  size_t i = !value.empty() && value[0] == '-' ? 1 : 0;
+  size_t digits = i;
+  while (i < value.size() && isdigit(static_cast<unsigned char>(value[i])))
+    i++;
+  if (i == digits) return false;
+  if (i < value.size() && value[i] == '.') {
+    size_t fraction = ++i;
+    while (i < value.size() && isdigit(static_cast<unsigned char>(value[i])))
+      i++;
+    if (i == fraction) return false;
+  }
+  if (i != value.size()) return false;
+  *result = strtod(value.c_str(), NULL);
+  return true;
+}
+
+
+// Runs requests through a processor batch_size at a time.
+bool ProcessRequests(v8::Platform* platform, Isolate* isolate,
+                     JsHttpRequestProcessor* processor,
+                     const std::vector<HttpRequest*>& reqs, int batch_size) {
+  std::vector<HttpRequest*> batch(batch_size);
+  std::unique_ptr<bool[]> results(new bool[batch_size]);
+  int count = static_cast<int>(reqs.size());
+  for (int i = 0; i < count; i += batch_size) {
+    int n = count - i < batch_size ? count - i : batch_size;
+    for (int j = 0; j < n; j++) batch[j] = reqs[i + j];
+    int dropped = processor->dropped_requests();
+    bool result = batch_size == 1
+                      ? processor->Process(batch[0])
+                      : processor->ProcessBatch(&batch[0], n, results.get());
+    DrainMessageLoop(platform, isolate, processor->metrics());
+    if (!result && processor->dropped_requests() == dropped) return false;
+  }
+  return true;
+}
+
+
+// Runs one worker of the pool: creates an isolate owned by this thread,
+// initializes a processor in it and processes requests until the source
+// has none left for it or some worker failed.
+void RunWorker(PoolWorker* worker) {
+  const ProcessorConfig& config = *worker->config;
+  Isolate::CreateParams create_params;
+  InitCreateParams(config, &create_params);
+  Isolate* isolate = Isolate::New(create_params);
+  {
+    Isolate::Scope isolate_scope(isolate);
+    HandleScope scope(isolate);
+    // Scripts may write to their options, so every worker gets a copy.
+    map<string, string> worker_options(*worker->options);
+    std::unique_ptr<JsHttpRequestProcessor> processor(
+        NewProcessor(isolate, config));
+    int batch_size = config.batch_size < 1 ? 1 : config.batch_size;
+    bool ready = processor->Initialize(&worker_options, &worker->output);
+    if (!ready) {
+      fprintf(stderr, "Error initializing processor in worker %d.\n",
+              worker->index);
+    } else {
+      ready = ProcessRequests(worker->platform, isolate, processor.get(),
+                              *worker->warmup, batch_size);
+    }
+    if (!ready) worker->failed->store(true);
+    // Arrive even after failing, or the others would wait forever.
+    worker->start_line->Arrive();
+
+    if (ready) {
+      std::vector<HttpRequest*> batch(batch_size);
+      std::unique_ptr<bool[]> results(new bool[batch_size]);
+      while (!worker->failed->load(std::memory_order_relaxed)) {
+        int n = worker->source->Fill(worker->index, &batch[0], batch_size);
+        if (n == 0) break;
+        worker->requests += n;
+        int dropped = processor->dropped_requests();
+        bool result = batch_size == 1
+                          ? processor->Process(batch[0])
+                          : processor->ProcessBatch(&batch[0], n,
+                                                    results.get());
+        DrainMessageLoop(worker->platform, isolate, processor->metrics());
+        // Requests the processor dropped do not stop the pool.
+        if (!result && processor->dropped_requests() == dropped)
+          worker->failed->store(true);
+      }
+      worker->finish = Clock::now();
+      worker->finished = true;
+      worker->dropped_requests = processor->dropped_requests();
+      worker->timeouts = processor->timeouts();
+      processor->SyncOutput();
+      if (config.count_allocations) processor->PrintAllocationStats(stderr);
+      if (worker->options->count("heap_stats") > 0)
+        processor->PrintHeapStatistics(stderr);
+    }
+  }
+  isolate->Dispose();
+}
+
+}  // namespace
+
+
+WorkStealingQueue::WorkStealingQueue(int worker_count) {
+  for (int i = 0; i < worker_count; i++)
+    deques_.push_back(std::unique_ptr<Deque>(new Deque()));
+}
+
+
+void WorkStealingQueue::Push(int worker, HttpRequest* request) {
+  Deque* deque = deques_[worker].get();
+  std::lock_guard<std::mutex> lock(deque->mutex);
+  deque->requests.push_back(request);
+}
+
+
+void WorkStealingQueue::PushAll(HttpRequest** requests, size_t count) {
+  size_t worker_count = deques_.size();
+  for (size_t worker = 0; worker < worker_count; worker++) {
+    size_t begin = count * worker / worker_count;
+    size_t end = count * (worker + 1) / worker_count;
+    Deque* deque = deques_[worker].get();
+    std::lock_guard<std::mutex> lock(deque->mutex);
+    deque->requests.insert(deque->requests.end(), requests + begin,
+                           requests + end);
+  }
+}
+
+
+HttpRequest* WorkStealingQueue::Pop(int worker) {
+  int count = static_cast<int>(deques_.size());
+  for (int i = 0; i < count; i++) {
+    Deque* deque = deques_[(worker + i) % count].get();
+    std::lock_guard<std::mutex> lock(deque->mutex);
+    if (deque->requests.empty()) continue;
+    HttpRequest* request;
+    if (i == 0) {
+      request = deque->requests.back();
+      deque->requests.pop_back();
+    } else {
+      request = deque->requests.front();
+      deque->requests.pop_front();
+    }
+    return request;
+  }
+  return NULL;
+}
+
+
+int WorkStealingQueue::Fill(int worker, HttpRequest** batch, int max) {
+  int n = 0;
+  while (n < max && (batch[n] = Pop(worker)) != NULL) n++;
+  return n;
+}
+
+
+bool LogRequestSource::Open(const string& name, int worker_count) {
+  parts_.clear();
+  for (int i = 0; i < worker_count; i++) {
+    std::unique_ptr<Part> part(new Part());
+    if (!part->reader.Open(name)) return false;
+    part->reader.Restrict(i, worker_count);
+    parts_.push_back(std::move(part));
+  }
+  return true;
+}
+
+
+int LogRequestSource::Fill(int worker, HttpRequest** batch, int max) {
+  Part* part = parts_[worker].get();
+  // The previous batch has been processed by now.
+  part->reader.Release();
+  if (part->requests.size() < static_cast<size_t>(max))
+    part->requests.resize(max);
+  int n = 0;
+  while (n < max && part->reader.Next(&part->requests[n])) {
+    batch[n] = &part->requests[n];
+    n++;
+  }
+  return n;
+}
+
+
+int LogRequestSource::skipped() const {
+  int skipped = 0;
+  for (size_t i = 0; i < parts_.size(); i++)
+    skipped += parts_[i]->reader.skipped();
+  return skipped;
+}
+
+
+int MergeOutput(map<string, string>* into, const map<string, string>& from) {
+  int conflicts = 0;
+  for (map<string, string>::const_iterator i = from.begin(); i != from.end();
+       i++) {
+    map<string, string>::iterator existing = into->find(i->first);
+    if (existing == into->end()) {
+      (*into)[i->first] = i->second;
+      continue;
+    }
+    double lhs;
+    double rhs;
+    if (!ParseDecimal(existing->second, &lhs) ||
+        !ParseDecimal(i->second, &rhs)) {
+      if (existing->second == i->second) continue;
+      conflicts++;
+      if (i->second < existing->second) existing->second = i->second;
+      continue;
+    }
+    existing->second = NumberToString(lhs + rhs);
+  }
+  return conflicts;
+}
+
+
+bool RunProcessorPool(v8::Platform* platform, const ProcessorConfig& config,
+                      const map<string, string>& options, int worker_count,
+                      const std::vector<HttpRequest*>& warmup,
+                      RequestSource* source, map<string, string>* output,
+                      PoolStats* stats) {
+  StartLine start_line(worker_count);
+  std::atomic<bool> failed(false);
+  std::vector<PoolWorker> workers(worker_count);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < worker_count; i++) {
+    PoolWorker* worker = &workers[i];
+    worker->index = i;
+    worker->platform = platform;
+    worker->config = &config;
+    worker->options = &options;
+    worker->warmup = &warmup;
+    worker->source = source;
+    worker->start_line = &start_line;
+    worker->failed = &failed;
+    worker->requests = 0;
+    worker->dropped_requests = 0;
+    worker->timeouts = 0;
+    worker->finished = false;
+    threads.push_back(std::thread(RunWorker, worker));
+  }
+  for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+  Clock::time_point finish = start_line.start();
+  stats->requests = 0;
+  stats->worker_requests.clear();
+  stats->dropped_requests = 0;
+  stats->timeouts = 0;
+  for (int i = 0; i < worker_count; i++) {
+    stats->requests += workers[i].requests;
+    stats->dropped_requests += workers[i].dropped_requests;
+    stats->timeouts += workers[i].timeouts;
+    stats->worker_requests.push_back(workers[i].requests);
+    if (workers[i].finished && workers[i].finish > finish)
+      finish = workers[i].finish;
+  }
+  stats->elapsed_s =
+      std::chrono::duration<double>(finish - start_line.start()).count();
+
+  int conflicts = 0;
+  for (int i = 0; i < worker_count; i++)
+    conflicts += MergeOutput(output, workers[i].output);
+  if (conflicts > 0) {
+    fprintf(stderr,
+            "Workers disagreed on %d output values; kept the smallest.\n",
+            conflicts);
+  }
+  return !failed.load();
+}
+
+
+int GetWorkerCount(const map<string, string>& options) {
+  map<string, string>::const_iterator iter = options.find("workers");
+  if (iter == options.end()) return 1;
+  int count = iter->second == "auto"
+                  ? static_cast<int>(std::thread::hardware_concurrency())
+                  : atoi(iter->second.c_str());
+  return count < 1 ? 1 : count;
+}
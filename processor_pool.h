@@ -0,0 +1,173 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PROCESSOR_POOL_H_
+#define PROCESSOR_POOL_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "access_log.h"
+#include "http_processor.h"
+
+
+/**
+ * Where the workers of a processor pool take their requests from.
+ */
+class RequestSource {
+ public:
+  virtual ~RequestSource() { }
+
+  // Fills batch with up to max requests for the given worker and returns
+  // how many there are, or 0 once the worker has nothing left to do.
+  // Called by that worker's thread only; the source may reuse the
+  // storage of the requests it handed out before on the next call.
+  virtual int Fill(int worker, HttpRequest** batch, int max) = 0;
+};
+
+
+/**
+ * A set of per-worker request deques.  Each worker takes requests from
+ * the back of its own deque and, once that runs dry, steals from the
+ * front of the other workers' deques, so a worker that got stuck with
+ * slow requests does not hold up the rest.  All requests are pushed
+ * before the workers start, so an empty queue means we are done.
+ */
+class WorkStealingQueue : public RequestSource {
+ public:
+  explicit WorkStealingQueue(int worker_count);
+
+  void Push(int worker, HttpRequest* request);
+  // Hands every worker a contiguous slice of the requests; stealing
+  // evens out the rest.
+  void PushAll(HttpRequest** requests, size_t count);
+
+  // Returns the next request for the given worker, or NULL when there
+  // is no work left anywhere.
+  HttpRequest* Pop(int worker);
+
+  virtual int Fill(int worker, HttpRequest** batch, int max);
+
+ private:
+  // Aligned so workers locking neighbouring deques do not contend on
+  // the same cache line.  new honours the alignment as of C++17.
+  struct alignas(64) Deque {
+    std::mutex mutex;
+    std::deque<HttpRequest*> requests;
+  };
+
+  std::vector<std::unique_ptr<Deque> > deques_;
+};
+
+
+/**
+ * Hands every worker the lines of its own part of an access log (see
+ * AccessLogReader::Restrict), so the workers parse the log in parallel
+ * without sharing a reader.  Every worker has its own mapping of the
+ * log, holds one batch of requests at a time and drops the pages behind
+ * it.  The log stays mapped as long as the source lives, since request
+ * strings point into it.  There is no stealing, so a worker whose part
+ * is quicker to process finishes early.
+ */
+class LogRequestSource : public RequestSource {
+ public:
+  bool Open(const std::string& name, int worker_count);
+
+  virtual int Fill(int worker, HttpRequest** batch, int max);
+
+  // The number of malformed lines skipped by all workers.
+  int skipped() const;
+
+ private:
+  struct Part {
+    AccessLogReader reader;
+    std::vector<LogHttpRequest> requests;
+  };
+
+  std::vector<std::unique_ptr<Part> > parts_;
+};
+
+
+/**
+ * What a pool run did.
+ */
+struct PoolStats {
+  PoolStats() : elapsed_s(0), requests(0), dropped_requests(0), timeouts(0) {}
+
+  // From the moment the last worker had initialized its processor and
+  // run its warmup requests until the last worker finished.
+  double elapsed_s;
+  // The requests taken from the source, in total and per worker.
+  int64_t requests;
+  std::vector<int64_t> worker_requests;
+  // Summed over the processors of all workers; see
+  // JsHttpRequestProcessor::dropped_requests.
+  int64_t dropped_requests;
+  int timeouts;
+};
+
+
+// Runs the requests of a source through a pool of worker threads, each
+// with its own isolate and processor set up from the config, and merges
+// the outputs of all workers into output (see MergeOutput).  Every
+// worker first runs the warmup requests, which are not timed.  Returns
+// false if a worker failed to initialize or to process a request.
+bool RunProcessorPool(v8::Platform* platform, const ProcessorConfig& config,
+                      const std::map<std::string, std::string>& options,
+                      int worker_count,
+                      const std::vector<HttpRequest*>& warmup,
+                      RequestSource* source,
+                      std::map<std::string, std::string>* output,
+                      PoolStats* stats);
+
+// Merges the output of one worker into the combined output.  Values
+// that are plain decimal numbers on both sides ("-12" or "3.5", but not
+// "0x1A" or " 12") are added up, which is what count style scripts
+// need.  Of two different values that are not both numbers the smaller
+// one in byte order is kept, so the result does not depend on the order
+// the workers are merged in.  Which worker handles
+// which request varies from run to run, though, so such a value is only
+// reproducible if the script's value for the key does not depend on the
+// requests a worker saw.  Returns the number of such conflicts, which
+// RunProcessorPool reports on stderr.
+int MergeOutput(std::map<std::string, std::string>* into,
+                const std::map<std::string, std::string>& from);
+
+// Returns the number of workers requested through the 'workers' option.
+// 'workers=auto' uses one worker per core.
+int GetWorkerCount(const std::map<std::string, std::string>& options);
+
+#endif  // PROCESSOR_POOL_H_
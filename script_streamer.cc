@@ -0,0 +1,104 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "script_streamer.h"
+
+#include <utility>
+
+#include "source_file.h"
+
+using std::string;
+
+
+class StreamedScript::ParseTask : public v8::Task {
+ public:
+  ParseTask(StreamedScript* script,
+            v8::ScriptCompiler::ScriptStreamingTask* task)
+      : script_(script), task_(task) {}
+
+  void Run() override {
+    task_->Run();
+    // The script may be gone as soon as it is told, so let go of
+    // everything first.
+    task_.reset();
+    std::lock_guard<std::mutex> lock(script_->mutex_);
+    script_->done_ = true;
+    script_->parsed_.notify_all();
+  }
+
+ private:
+  StreamedScript* script_;
+  std::unique_ptr<v8::ScriptCompiler::ScriptStreamingTask> task_;
+};
+
+
+StreamedScript::StreamedScript(const string& file,
+                               const std::shared_ptr<SourceFile>& source)
+    : file_(file), source_(source), done_(false) {}
+
+
+StreamedScript::~StreamedScript() { WaitForParse(); }
+
+
+std::unique_ptr<StreamedScript> StreamedScript::Start(v8::Isolate* isolate,
+                                                      v8::Platform* platform,
+                                                      const string& file) {
+  std::shared_ptr<SourceFile> source = SourceFile::Open(file);
+  if (source == NULL) return NULL;
+  std::unique_ptr<StreamedScript> script(new StreamedScript(file, source));
+  script->streamed_ = NewStreamedSource(source);
+  v8::ScriptCompiler::ScriptStreamingTask* task =
+      v8::ScriptCompiler::StartStreaming(isolate, script->streamed_.get());
+  platform->CallOnWorkerThread(
+      std::unique_ptr<v8::Task>(new ParseTask(script.get(), task)));
+  return script;
+}
+
+
+v8::MaybeLocal<v8::Script> StreamedScript::Compile(
+    v8::Local<v8::Context> context) {
+  v8::Isolate* isolate = context->GetIsolate();
+  WaitForParse();
+  v8::Local<v8::String> source;
+  if (!SourceFile::NewString(isolate, source_).ToLocal(&source)) {
+    return v8::MaybeLocal<v8::Script>();
+  }
+  v8::ScriptOrigin origin(
+      v8::String::NewFromUtf8(isolate, file_.c_str()).ToLocalChecked());
+  if (source_->encoding() == SourceFile::kLatin1) {
+    // The parser saw the file as UTF-8; start over from the string.
+    return v8::Script::Compile(context, source, &origin);
+  }
+  return v8::ScriptCompiler::Compile(context, streamed_.get(), source,
+                                     origin);
+}
+
+
+void StreamedScript::WaitForParse() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!done_) parsed_.wait(lock);
+}
@@ -0,0 +1,79 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SCRIPT_STREAMER_H_
+#define SCRIPT_STREAMER_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class SourceFile;
+
+/**
+ * A script file compiled ahead of running it.  The file is streamed to
+ * V8's parser on one of the platform's worker threads, so it is read
+ * while it is parsed, and scripts started together are read and parsed
+ * in parallel while the isolate thread goes on running JavaScript.
+ * Only the final step of compiling happens on the isolate thread.
+ */
+class StreamedScript {
+ public:
+  // Starts parsing a file.  Returns NULL if it cannot be read.
+  static std::unique_ptr<StreamedScript> Start(v8::Isolate* isolate,
+                                               v8::Platform* platform,
+                                               const std::string& file);
+
+  // Waits for the parse if it is still running.
+  ~StreamedScript();
+  StreamedScript(const StreamedScript&) = delete;
+  StreamedScript& operator=(const StreamedScript&) = delete;
+
+  // Waits for the parse and compiles the script in a context.  Must be
+  // called at most once, on the thread running the isolate.
+  v8::MaybeLocal<v8::Script> Compile(v8::Local<v8::Context> context);
+
+ private:
+  class ParseTask;
+
+  StreamedScript(const std::string& file,
+                 const std::shared_ptr<SourceFile>& source);
+  void WaitForParse();
+
+  std::string file_;
+  std::shared_ptr<SourceFile> source_;
+  std::unique_ptr<v8::ScriptCompiler::StreamedSource> streamed_;
+  std::mutex mutex_;
+  std::condition_variable parsed_;
+  bool done_;
+};
+
+#endif  // SCRIPT_STREAMER_H_
@@ -26,15 +26,30 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <include/v8.h>
+#include <include/v8-fast-api-calls.h>
 
 #include <include/libplatform/libplatform.h>
 
+#include "async_file.h"
+#include "code_cache.h"
+#include "heap_control.h"
+#include "mapped_file.h"
+#include "module_loader.h"
+#include "point_buffer.h"
+#include "pooled_allocator.h"
+#include "script_streamer.h"
+#include "slab_pool.h"
+#include "source_file.h"
+#include "wasm_loader.h"
+#include "worker.h"
+
 #include <assert.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <map>
+#include <vector>
 
 /**
  * This sample program shows how to implement a simple javascript shell
@@ -56,20 +71,36 @@ bool ExecuteString(v8::Isolate *isolate, v8::Local<v8::String> source,
                    v8::Local<v8::Value> name, bool print_result,
                    bool report_exceptions);
 
+bool ExecuteModule(v8::Isolate *isolate, const char *file,
+                   bool report_exceptions);
+
+bool ExecuteStreamed(v8::Isolate *isolate, StreamedScript *streamed,
+                     bool report_exceptions);
+
+bool IsModuleFile(const char *file);
+
+void SetUpIsolate(v8::Isolate *isolate);
+
+void TearDownIsolate(v8::Isolate *isolate);
+
+v8::Local<v8::Context> EnterWorker(v8::Isolate *isolate);
+
+void RunUntilIdle(v8::Isolate *isolate);
+
 void Print(const v8::FunctionCallbackInfo<v8::Value> &args);
 
 void Read(const v8::FunctionCallbackInfo<v8::Value> &args);
 
 void Load(const v8::FunctionCallbackInfo<v8::Value> &args);
 
+void MapFile(const v8::FunctionCallbackInfo<v8::Value> &args);
+
 void Quit(const v8::FunctionCallbackInfo<v8::Value> &args);
 
 void Version(const v8::FunctionCallbackInfo<v8::Value> &args);
 
 void Call(const v8::FunctionCallbackInfo<v8::Value> &args);
 
-v8::MaybeLocal<v8::String> ReadFile(v8::Isolate *isolate, const char *name);
-
 void ReportException(v8::Isolate *isolate, v8::TryCatch *handler);
 
 void GetPointX(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info);
@@ -82,27 +113,79 @@ void SetPointY(v8::Local<v8::String> property, v8::Local<v8::Value> value, const
 
 void PointMulti(const v8::FunctionCallbackInfo<v8::Value> &args);
 
+int32_t FastPointMulti(v8::Local<v8::Object> receiver);
+
+void SetMethod(v8::Isolate *isolate, v8::Local<v8::Template> templ,
+               const char *name, v8::FunctionCallback callback,
+               v8::Local<v8::Signature> signature,
+               const v8::CFunction *fast_callback);
+
 
 static bool run_shell;
 
+// Set by --code-cache=<dir>; scripts are compiled through it if present.
+static CodeCache *code_cache;
+
+// Set by --memory-events=<file>; passes cgroup memory pressure on to the
+// isolate.
+static MemoryPressureMonitor *memory_monitor;
+
+// How the isolates of workers are made; filled in by main.
+static WorkerConfig worker_config;
+
+// The state below belongs to one isolate.  Workers run their isolates
+// on threads of their own, so each thread has its own.
+
+// Backs readAsync and loadAsync; pending reads are waited for after each
+// script and each line of the shell.
+static thread_local AsyncFileLoader *async_files;
+
+// Loads the modules run with -m or given as .mjs files, and caches them
+// for the life of the isolate.
+static thread_local ModuleLoader *module_loader;
+
+// Runs the workers started by the isolate's scripts.
+static thread_local WorkerHost *workers;
+
+// Streams WebAssembly modules from files; compiles still running are
+// waited for like pending reads.
+static thread_local WasmLoader *wasm_loader;
+
 class Point {
 public:
     Point(int x, int y) : x_(x), y_(y) {}
 
     int x_, y_;
 
+    // Weak handle to the JavaScript wrapper; its finalizer frees the Point.
+    v8::Global<v8::Object> wrapper_;
+
 
     int multi() {
         return this->x_ * this->y_;
     }
 };
 
-// Utility function that extracts the C++ map pointer from a wrapper
-// object.
-std::map<std::string, std::string>* UnwrapMap(v8::Local<v8::Object> obj) {
-    v8::Local<v8::External> field = v8::Local<v8::External>::Cast(obj->GetInternalField(0));
-    void* ptr = field->Value();
-    return static_cast<std::map<std::string, std::string>*>(ptr);
+// Points are allocated from slabs so that they sit next to each other
+// instead of all over the malloc heap.  An isolate only runs on the
+// thread that created it, so each thread gets its own pool.
+static thread_local SlabPool<Point> point_pool;
+
+// Frees the Point of a wrapper that has been garbage collected and
+// tells V8 the memory is gone.
+void OnPointCollected(const v8::WeakCallbackInfo<Point> &info) {
+    Point *point = info.GetParameter();
+    point->wrapper_.Reset();
+    point_pool.Delete(point);
+    info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(
+            -static_cast<int64_t>(sizeof(Point)));
+}
+
+// Utility function that extracts the C++ Point from a wrapper object.
+// The pointer is stored as an aligned pointer rather than in an
+// External, so wrapping a Point allocates nothing on the V8 heap.
+Point *UnwrapPoint(v8::Local<v8::Object> obj) {
+    return static_cast<Point *>(obj->GetAlignedPointerFromInternalField(0));
 }
 
 std::string ObjectToString(v8::Isolate* isolate, v8::Local<v8::Value> value) {
@@ -112,21 +195,30 @@ std::string ObjectToString(v8::Isolate* isolate, v8::Local<v8::Value> value) {
 
 void constructPoint(const v8::FunctionCallbackInfo<v8::Value> &args) {
     v8::Isolate *isolate = v8::Isolate::GetCurrent();
+    if (!args.IsConstructCall()) {
+        isolate->ThrowException(v8::Exception::TypeError(
+                v8::String::NewFromUtf8(isolate, "Point must be called with new",
+                                        v8::NewStringType::kNormal).ToLocalChecked()));
+        return;
+    }
 
     //get an x and y
     double x = args[0]->NumberValue(isolate->GetCurrentContext()).ToChecked();
     double y = args[1]->NumberValue(isolate->GetCurrentContext()).ToChecked();
 
-    //generate a new point
-    Point *point = new Point(x, y);
+    //generate a new point; it lives until the wrapper is collected
+    Point *point = point_pool.New(x, y);
 
-    args.This()->SetInternalField(0, v8::External::New(isolate, point));
+    args.This()->SetAlignedPointerInInternalField(0, point);
+    point->wrapper_.Reset(isolate, args.This());
+    point->wrapper_.SetWeak(point, OnPointCollected,
+                            v8::WeakCallbackType::kParameter);
+    // Count the Point against the heap so that scripts creating many of
+    // them trigger collections that free them.
+    isolate->AdjustAmountOfExternalAllocatedMemory(sizeof(Point));
 }
 
 void PointGet(v8::Local<v8::Name> name, const v8::PropertyCallbackInfo<v8::Value> &info) {
-    // Fetch the map wrapped by this object.
-    std::map<std::string, std::string> *obj = UnwrapMap(info.Holder());
-
     // Convert the JavaScript string to a std::string.
     std::string key = ObjectToString(info.GetIsolate(),v8::Local<v8::String>::Cast(name));
 
@@ -137,10 +229,6 @@ void PointGet(v8::Local<v8::Name> name, const v8::PropertyCallbackInfo<v8::Value
 
 void PointSet(v8::Local<v8::Name> name, v8::Local<v8::Value> value_obj, const v8::PropertyCallbackInfo<v8::Value> &info) {
     if (name->IsSymbol()) return;
-    // Fetch the map wrapped by this object.
-    std::map<std::string, std::string>* obj = UnwrapMap(info.Holder());
-
-
     // Convert the key and value to std::strings.
     std::string key = ObjectToString(info.GetIsolate(), v8::Local<v8::String>::Cast(name));
     std::string value = ObjectToString(info.GetIsolate(), value_obj);
@@ -152,14 +240,55 @@ int main(int argc, char *argv[]) {
 
     v8::V8::InitializeICUDefaultLocation(argv[0]);
     v8::V8::InitializeExternalStartupData(argv[0]);
+    // Fast API calls are off by default; --no-turbo-fast-api-calls on the
+    // command line turns them back off to compare.
+    v8::V8::SetFlagsFromString("--turbo-fast-api-calls");
     std::unique_ptr<v8::Platform> platform = v8::platform::NewDefaultPlatform();
     v8::V8::InitializePlatform(platform.get());
     v8::V8::Initialize();
     v8::V8::SetFlagsFromCommandLine(&argc, argv, true);
     v8::Isolate::CreateParams create_params;
-    create_params.array_buffer_allocator =
-            v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+    size_t max_young_mb = 0;
+    size_t max_old_mb = 0;
+    bool heap_stats = false;
+    // --allocator=pooled|huge replaces V8's ArrayBuffer allocator; see
+    // PooledAllocator.
+    ArrayBufferAllocatorKind allocator = kDefaultAllocator;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--code-cache=", 13) == 0) {
+            code_cache = new CodeCache(argv[i] + 13);
+        } else if (strncmp(argv[i], "--heap-young-mb=", 16) == 0) {
+            max_young_mb = strtoul(argv[i] + 16, NULL, 10);
+        } else if (strncmp(argv[i], "--heap-old-mb=", 14) == 0) {
+            max_old_mb = strtoul(argv[i] + 14, NULL, 10);
+        } else if (strcmp(argv[i], "--heap-stats") == 0) {
+            heap_stats = true;
+        } else if (strncmp(argv[i], "--allocator=", 12) == 0) {
+            if (!ParseAllocatorKind(argv[i] + 12, &allocator)) {
+                fprintf(stderr, "Unknown allocator '%s'\n", argv[i] + 12);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--memory-events=", 16) == 0) {
+            memory_monitor = new MemoryPressureMonitor();
+            if (!memory_monitor->Start(argv[i] + 16)) {
+                fprintf(stderr, "Error watching '%s'\n", argv[i] + 16);
+                return 1;
+            }
+        }
+    }
+    // Shared, since buffers moved to workers may outlive the isolate.
+    create_params.array_buffer_allocator_shared =
+            NewArrayBufferAllocator(allocator);
+    SetHeapLimits(max_young_mb, max_old_mb, &create_params);
+    worker_config.platform = platform.get();
+    worker_config.allocator = allocator;
+    worker_config.max_young_mb = max_young_mb;
+    worker_config.max_old_mb = max_old_mb;
+    worker_config.enter = EnterWorker;
+    worker_config.run_until_idle = RunUntilIdle;
+    worker_config.exit = TearDownIsolate;
     v8::Isolate *isolate = v8::Isolate::New(create_params);
+    SetUpIsolate(isolate);
     run_shell = (argc == 1);
     int result;
     {
@@ -174,10 +303,19 @@ int main(int argc, char *argv[]) {
         result = RunMain(isolate, platform.get(), argc, argv);
         if (run_shell) RunShell(context, platform.get());
     }
+    if (heap_stats) {
+        PrintHeapStatistics(isolate, stderr);
+        PooledAllocator::PrintStats(stderr);
+    }
+    TearDownIsolate(isolate);
+    delete memory_monitor;
     isolate->Dispose();
+    if (code_cache != NULL) {
+        code_cache->PrintStats(stderr);
+        delete code_cache;
+    }
     v8::V8::Dispose();
     v8::V8::ShutdownPlatform();
-    delete create_params.array_buffer_allocator;
     return result;
 }
 
@@ -207,6 +345,16 @@ v8::Local<v8::Context> CreateShellContext(v8::Isolate *isolate) {
     global->Set(
             v8::String::NewFromUtf8(isolate, "load", v8::NewStringType::kNormal).ToLocalChecked(),
             v8::FunctionTemplate::New(isolate, Load));
+    // Bind the global 'mapFile' function to the C++ MapFile callback.
+    global->Set(
+            v8::String::NewFromUtf8(isolate, "mapFile", v8::NewStringType::kNormal).ToLocalChecked(),
+            v8::FunctionTemplate::New(isolate, MapFile));
+    // Bind 'readAsync' and 'loadAsync', which read on worker threads.
+    async_files->Install(global);
+    // Bind 'Worker', which runs scripts on threads of their own.
+    workers->Install(global);
+    // Bind 'loadWasm', which compiles a module while its file is read.
+    wasm_loader->Install(global);
     // Bind the 'quit' function
     global->Set(
             v8::String::NewFromUtf8(isolate, "quit", v8::NewStringType::kNormal).ToLocalChecked(),
@@ -236,10 +384,12 @@ v8::Local<v8::Context> CreateShellContext(v8::Isolate *isolate) {
     //初始化原型模板
     v8::Local<v8::ObjectTemplate> point_proto = point_templ->PrototypeTemplate();
 
-    // 原型模板上挂载multi方法
-    point_proto->Set(v8::String::NewFromUtf8(
-            isolate, "multi", v8::NewStringType::kNormal).ToLocalChecked(),
-                     v8::FunctionTemplate::New(isolate, PointMulti));
+    // 原型模板上挂载multi方法.  Optimized code calls FastPointMulti
+    // directly; the signature guarantees it a Point receiver.
+    static const v8::CFunction fast_point_multi =
+            v8::CFunction::Make(FastPointMulti);
+    SetMethod(isolate, point_proto, "multi", PointMulti,
+              v8::Signature::New(isolate, point_templ), &fast_point_multi);
 
     // 初始化实例模板
     v8::Local<v8::ObjectTemplate> point_inst = point_templ->InstanceTemplate();
@@ -253,6 +403,11 @@ v8::Local<v8::Context> CreateShellContext(v8::Isolate *isolate) {
 
     point_inst->SetHandler(v8::NamedPropertyHandlerConfiguration(PointGet,PointSet));
 
+    // Points in bulk, as coordinate arrays with native kernels.
+    global->Set(v8::String::NewFromUtf8(
+            isolate, "PointBuffer", v8::NewStringType::kNormal).ToLocalChecked(),
+                NewPointBufferTemplate(isolate));
+
 
     const v8::Local<v8::Context> context = v8::Context::New(isolate, NULL, global);
 
@@ -266,16 +421,39 @@ void PointMulti(const v8::FunctionCallbackInfo<v8::Value> &args) {
     v8::HandleScope handle_scope(isolate);
 
 
-    v8::Local<v8::Object> self = args.Holder();
-    v8::Local<v8::External> wrap = v8::Local<v8::External>::Cast(self->GetInternalField(0));
-    void *ptr = wrap->Value();
-
-    int value = static_cast<Point *>(ptr)->multi();
+    int value = UnwrapPoint(args.Holder())->multi();
 
     args.GetReturnValue().Set(value);
 }
 
 
+// The fast path of PointMulti, called by optimized code without handle
+// scopes or boxed arguments.  It must not allocate on the V8 heap or
+// call back into JavaScript.
+int32_t FastPointMulti(v8::Local<v8::Object> receiver) {
+    return UnwrapPoint(receiver)->multi();
+}
+
+
+// Binds a method to a template.  If fast_callback is given, optimized
+// code calls it directly whenever the arguments allow and callback
+// handles all other calls, so both must do the same thing.  The
+// CFunction must outlive the template, and a fast callback that uses
+// its receiver needs a signature to make sure it gets the right kind.
+void SetMethod(v8::Isolate *isolate, v8::Local<v8::Template> templ,
+               const char *name, v8::FunctionCallback callback,
+               v8::Local<v8::Signature> signature,
+               const v8::CFunction *fast_callback) {
+    v8::Local<v8::FunctionTemplate> function = v8::FunctionTemplate::New(
+            isolate, callback, v8::Local<v8::Value>(), signature, 0,
+            v8::ConstructorBehavior::kThrow,
+            v8::SideEffectType::kHasSideEffect, fast_callback);
+    templ->Set(v8::String::NewFromUtf8(
+            isolate, name, v8::NewStringType::kInternalized).ToLocalChecked(),
+               function);
+}
+
+
 // The callback that is invoked by v8 whenever the JavaScript 'print'
 // function is called.  Prints its arguments on stdout separated by
 // spaces and ending with a newline.
@@ -325,7 +503,7 @@ void Read(const v8::FunctionCallbackInfo<v8::Value> &args) {
         return;
     }
     v8::Local<v8::String> source;
-    if (!ReadFile(args.GetIsolate(), *file).ToLocal(&source)) {
+    if (!ReadSourceFile(args.GetIsolate(), *file).ToLocal(&source)) {
         args.GetIsolate()->ThrowException(
                 v8::String::NewFromUtf8(args.GetIsolate(), "Error loading file",
                                         v8::NewStringType::kNormal).ToLocalChecked());
@@ -335,10 +513,44 @@ void Read(const v8::FunctionCallbackInfo<v8::Value> &args) {
     args.GetReturnValue().Set(source);
 }
 
+// The callback that is invoked by v8 whenever the JavaScript 'mapFile'
+// function is called.  Returns an ArrayBuffer over a mapping of the file
+// named in the argument, so scripts can read large or binary files
+// through typed arrays without copying them.
+void MapFile(const v8::FunctionCallbackInfo<v8::Value> &args) {
+    if (args.Length() != 1) {
+        args.GetIsolate()->ThrowException(
+                v8::String::NewFromUtf8(args.GetIsolate(), "Bad parameters",
+                                        v8::NewStringType::kNormal).ToLocalChecked());
+        return;
+    }
+    v8::String::Utf8Value file(args.GetIsolate(), args[0]);
+    v8::Local<v8::ArrayBuffer> buffer;
+    if (*file == NULL ||
+        !MapFileToArrayBuffer(args.GetIsolate(), *file).ToLocal(&buffer)) {
+        args.GetIsolate()->ThrowException(
+                v8::String::NewFromUtf8(args.GetIsolate(), "Error mapping file",
+                                        v8::NewStringType::kNormal).ToLocalChecked());
+        return;
+    }
+
+    args.GetReturnValue().Set(buffer);
+}
+
 // The callback that is invoked by v8 whenever the JavaScript 'load'
 // function is called.  Loads, compiles and executes its argument
 // JavaScript file.
 void Load(const v8::FunctionCallbackInfo<v8::Value> &args) {
+    // Compile all the files on worker threads while the first ones run.
+    // Streamed scripts cannot use the code cache, so go without them if
+    // there is one.
+    std::vector<std::unique_ptr<StreamedScript>> scripts(args.Length());
+    for (int i = 0; i < args.Length() && code_cache == NULL; i++) {
+        v8::String::Utf8Value file(args.GetIsolate(), args[i]);
+        if (*file == NULL) continue;
+        scripts[i] = StreamedScript::Start(args.GetIsolate(),
+                                           worker_config.platform, *file);
+    }
     for (int i = 0; i < args.Length(); i++) {
         v8::HandleScope handle_scope(args.GetIsolate());
         v8::String::Utf8Value file(args.GetIsolate(), args[i]);
@@ -348,8 +560,17 @@ void Load(const v8::FunctionCallbackInfo<v8::Value> &args) {
                                             v8::NewStringType::kNormal).ToLocalChecked());
             return;
         }
+        if (scripts[i] != NULL) {
+            if (!ExecuteStreamed(args.GetIsolate(), scripts[i].get(), false)) {
+                args.GetIsolate()->ThrowException(
+                        v8::String::NewFromUtf8(args.GetIsolate(), "Error executing file",
+                                                v8::NewStringType::kNormal).ToLocalChecked());
+                return;
+            }
+            continue;
+        }
         v8::Local<v8::String> source;
-        if (!ReadFile(args.GetIsolate(), *file).ToLocal(&source)) {
+        if (!ReadSourceFile(args.GetIsolate(), *file).ToLocal(&source)) {
             args.GetIsolate()->ThrowException(
                     v8::String::NewFromUtf8(args.GetIsolate(), "Error loading file",
                                             v8::NewStringType::kNormal).ToLocalChecked());
@@ -386,35 +607,23 @@ void Version(const v8::FunctionCallbackInfo<v8::Value> &args) {
 }
 
 
-// Reads a file into a v8 string.
-v8::MaybeLocal<v8::String> ReadFile(v8::Isolate *isolate, const char *name) {
-    FILE *file = fopen(name, "rb");
-    if (file == NULL) return v8::MaybeLocal<v8::String>();
-
-    fseek(file, 0, SEEK_END);
-    size_t size = ftell(file);
-    rewind(file);
-
-    char *chars = new char[size + 1];
-    chars[size] = '\0';
-    for (size_t i = 0; i < size;) {
-        i += fread(&chars[i], 1, size - i, file);
-        if (ferror(file)) {
-            fclose(file);
-            return v8::MaybeLocal<v8::String>();
-        }
-    }
-    fclose(file);
-    v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(
-            isolate, chars, v8::NewStringType::kNormal, static_cast<int>(size));
-    delete[] chars;
-    return result;
-}
-
-
 // Process remaining command line arguments and execute files
 int RunMain(v8::Isolate *isolate, v8::Platform *platform, int argc,
             char *argv[]) {
+    // Start compiling every script file on worker threads, so that they
+    // are read and parsed in parallel with each other and with running
+    // the ones before them.  Streamed scripts cannot use the code cache,
+    // so go without them if there is one.
+    std::vector<std::unique_ptr<StreamedScript>> scripts(argc);
+    for (int i = 1; i < argc && code_cache == NULL; i++) {
+        const char *str = argv[i];
+        if ((strcmp(str, "-e") == 0 || strcmp(str, "-m") == 0) && i + 1 < argc) {
+            i++;
+        } else if (strcmp(str, "-f") != 0 && strncmp(str, "--", 2) != 0 &&
+                   !IsModuleFile(str)) {
+            scripts[i] = StreamedScript::Start(isolate, platform, str);
+        }
+    }
     for (int i = 1; i < argc; i++) {
         const char *str = argv[i];
         if (strcmp(str, "--shell") == 0) {
@@ -423,6 +632,14 @@ int RunMain(v8::Isolate *isolate, v8::Platform *platform, int argc,
             // Ignore any -f flags for compatibility with the other stand-
             // alone JavaScript engines.
             continue;
+        } else if (strncmp(str, "--code-cache=", 13) == 0 ||
+                   strncmp(str, "--heap-young-mb=", 16) == 0 ||
+                   strncmp(str, "--heap-old-mb=", 14) == 0 ||
+                   strcmp(str, "--heap-stats") == 0 ||
+                   strncmp(str, "--allocator=", 12) == 0 ||
+                   strncmp(str, "--memory-events=", 16) == 0) {
+            // Handled in main.
+            continue;
         } else if (strncmp(str, "--", 2) == 0) {
             fprintf(stderr,
                     "Warning: unknown flag %s.\nTry --help for options\n", str);
@@ -438,22 +655,36 @@ int RunMain(v8::Isolate *isolate, v8::Platform *platform, int argc,
                 return 1;
             }
             bool success = ExecuteString(isolate, source, file_name, false, true);
-            while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
+            RunUntilIdle(isolate);
+            if (!success) return 1;
+        } else if ((strcmp(str, "-m") == 0 && i + 1 < argc) ||
+                   IsModuleFile(str)) {
+            // Run the module given to -m, or a .mjs file, as an ES module.
+            if (strcmp(str, "-m") == 0) str = argv[++i];
+            bool success = ExecuteModule(isolate, str, true);
+            RunUntilIdle(isolate);
             if (!success) return 1;
         } else {
 
             fprintf(stdout, "read file '%s'\n", str);
             // Use all other arguments as names of files to load and run.
+            if (scripts[i] != NULL) {
+                bool success = ExecuteStreamed(isolate, scripts[i].get(), true);
+                scripts[i].reset();
+                RunUntilIdle(isolate);
+                if (!success) return 1;
+                continue;
+            }
             v8::Local<v8::String> file_name =
                     v8::String::NewFromUtf8(isolate, str, v8::NewStringType::kNormal)
                             .ToLocalChecked();
             v8::Local<v8::String> source;
-            if (!ReadFile(isolate, str).ToLocal(&source)) {
+            if (!ReadSourceFile(isolate, str).ToLocal(&source)) {
                 fprintf(stderr, "Error reading '%s'\n", str);
                 continue;
             }
             bool success = ExecuteString(isolate, source, file_name, false, true);
-            while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
+            RunUntilIdle(isolate);
 
             if (!success) return 1;
         }
@@ -483,8 +714,7 @@ void RunShell(v8::Local<v8::Context> context, v8::Platform *platform) {
                 name, //name
                 true,
                 true);
-        while (v8::platform::PumpMessageLoop(platform, context->GetIsolate()))
-            continue;
+        RunUntilIdle(context->GetIsolate());
     }
     fprintf(stderr, "\n");
 }
@@ -499,7 +729,12 @@ bool ExecuteString(v8::Isolate *isolate, v8::Local<v8::String> source,
     v8::ScriptOrigin origin(name);
     v8::Local<v8::Context> context(isolate->GetCurrentContext());
     v8::Local<v8::Script> script;
-    if (!v8::Script::Compile(context, source, &origin).ToLocal(&script)) {
+    bool produce_cache = false;
+    v8::MaybeLocal<v8::Script> maybe_script =
+            code_cache != NULL
+                    ? code_cache->Compile(context, source, &origin, &produce_cache)
+                    : v8::Script::Compile(context, source, &origin);
+    if (!maybe_script.ToLocal(&script)) {
         // Print errors that happened during compilation.
         if (report_exceptions)
             ReportException(isolate, &try_catch);
@@ -514,6 +749,9 @@ bool ExecuteString(v8::Isolate *isolate, v8::Local<v8::String> source,
             return false;
         } else {
             assert(!try_catch.HasCaught());
+            // Cache the script now that it has run, so the cache also
+            // covers the functions it compiled lazily.
+            if (produce_cache) code_cache->Produce(isolate, script, source);
             if (print_result && !result->IsUndefined()) {
                 // If all went well and the result wasn't undefined then print
                 // the returned value.
@@ -527,6 +765,90 @@ bool ExecuteString(v8::Isolate *isolate, v8::Local<v8::String> source,
 }
 
 
+// Creates the state of the shell for an isolate run by this thread.
+void SetUpIsolate(v8::Isolate *isolate) {
+    if (memory_monitor != NULL) memory_monitor->Add(isolate);
+    async_files = new AsyncFileLoader(isolate, worker_config.platform,
+                                      code_cache);
+    module_loader = new ModuleLoader(isolate, worker_config.platform);
+    workers = new WorkerHost(isolate, worker_config);
+    // Before any context is made, so they get WebAssembly.compileStreaming.
+    wasm_loader = new WasmLoader(isolate, worker_config.platform, code_cache);
+}
+
+
+// Undoes SetUpIsolate before the isolate is disposed.
+void TearDownIsolate(v8::Isolate *isolate) {
+    delete workers;
+    delete wasm_loader;
+    delete async_files;
+    delete module_loader;
+    if (memory_monitor != NULL) memory_monitor->Remove(isolate);
+}
+
+
+// Sets up the isolate of a worker and gives it the shell's bindings.
+v8::Local<v8::Context> EnterWorker(v8::Isolate *isolate) {
+    SetUpIsolate(isolate);
+    return CreateShellContext(isolate);
+}
+
+
+// Runs the tasks of an isolate until its pending reads and WebAssembly
+// compiles have completed and its workers are idle.  Messages may start
+// reads and reads may post messages, so go around until none of them
+// has anything left.
+void RunUntilIdle(v8::Isolate *isolate) {
+    do {
+        while (v8::platform::PumpMessageLoop(worker_config.platform, isolate))
+            continue;
+        async_files->RunUntilIdle();
+        wasm_loader->RunUntilIdle();
+        workers->RunUntilIdle();
+    } while (async_files->pending() > 0 || wasm_loader->pending() > 0 ||
+             workers->busy());
+}
+
+
+// Runs a script compiled ahead by a StreamedScript.
+bool ExecuteStreamed(v8::Isolate *isolate, StreamedScript *streamed,
+                     bool report_exceptions) {
+    v8::HandleScope handle_scope(isolate);
+    v8::TryCatch try_catch(isolate);
+    v8::Local<v8::Context> context(isolate->GetCurrentContext());
+    v8::Local<v8::Script> script;
+    if (!streamed->Compile(context).ToLocal(&script) ||
+        script->Run(context).IsEmpty()) {
+        if (report_exceptions && try_catch.HasCaught())
+            ReportException(isolate, &try_catch);
+        return false;
+    }
+    return true;
+}
+
+
+// Whether a file on the command line is run as an ES module.
+bool IsModuleFile(const char *file) {
+    size_t length = strlen(file);
+    return length > 4 && strcmp(file + length - 4, ".mjs") == 0;
+}
+
+
+// Loads a module file along with everything it imports and runs it.
+bool ExecuteModule(v8::Isolate *isolate, const char *file,
+                   bool report_exceptions) {
+    v8::HandleScope handle_scope(isolate);
+    v8::TryCatch try_catch(isolate);
+    v8::Local<v8::Context> context(isolate->GetCurrentContext());
+    if (module_loader->Run(context, file).IsEmpty()) {
+        if (report_exceptions)
+            ReportException(isolate, &try_catch);
+        return false;
+    }
+    return true;
+}
+
+
 void ReportException(v8::Isolate *isolate, v8::TryCatch *try_catch) {
     v8::HandleScope handle_scope(isolate);
     v8::String::Utf8Value exception(isolate, try_catch->Exception());
@@ -574,34 +896,22 @@ void ReportException(v8::Isolate *isolate, v8::TryCatch *try_catch) {
 void GetPointX(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info) {
     printf("GetPointX is calling\n");
 
-    v8::Local<v8::Object> self = info.Holder();
-    v8::Local<v8::External> wrap = v8::Local<v8::External>::Cast(self->GetInternalField(0));
-    void *ptr = wrap->Value();
-    int value = static_cast<Point *>(ptr)->x_;
+    int value = UnwrapPoint(info.Holder())->x_;
     info.GetReturnValue().Set(value);
 }
 
 void SetPointX(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info) {
     printf("SetPointX is calling\n");
 
-    v8::Local<v8::Object> self = info.Holder();
-    v8::Local<v8::External> wrap = v8::Local<v8::External>::Cast(self->GetInternalField(0));
-    void *ptr = wrap->Value();
-    static_cast<Point *>(ptr)->x_ = value->Int32Value(info.GetIsolate()->GetCurrentContext()).ToChecked();
+    UnwrapPoint(info.Holder())->x_ = value->Int32Value(info.GetIsolate()->GetCurrentContext()).ToChecked();
 }
 
 
 void GetPointY(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info) {
-    v8::Local<v8::Object> self = info.Holder();
-    v8::Local<v8::External> wrap = v8::Local<v8::External>::Cast(self->GetInternalField(0));
-    void *ptr = wrap->Value();
-    int value = static_cast<Point *>(ptr)->y_;
+    int value = UnwrapPoint(info.Holder())->y_;
     info.GetReturnValue().Set(value);
 }
 
 void SetPointY(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info) {
-    v8::Local<v8::Object> self = info.Holder();
-    v8::Local<v8::External> wrap = v8::Local<v8::External>::Cast(self->GetInternalField(0));
-    void *ptr = wrap->Value();
-    static_cast<Point *>(ptr)->y_ = value->Int32Value(info.GetIsolate()->GetCurrentContext()).ToChecked();
+    UnwrapPoint(info.Holder())->y_ = value->Int32Value(info.GetIsolate()->GetCurrentContext()).ToChecked();
 }
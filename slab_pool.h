@@ -0,0 +1,97 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SLAB_POOL_H_
+#define SLAB_POOL_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Allocates objects of one type from slabs of a fixed number of slots,
+ * reusing freed slots before carving new ones.  Objects that live
+ * together end up next to each other instead of scattered over the
+ * malloc heap, and allocating one is a pointer pop.
+ *
+ * The pool is not thread safe.  Destroying it releases the slabs
+ * without running the destructors of objects still alive.
+ */
+template <typename T, size_t kSlabSize = 256>
+class SlabPool {
+ public:
+  SlabPool() : free_list_(nullptr), live_(0) {}
+  SlabPool(const SlabPool&) = delete;
+  SlabPool& operator=(const SlabPool&) = delete;
+
+  template <typename... Args>
+  T* New(Args&&... args) {
+    if (free_list_ == nullptr) AddSlab();
+    Slot* slot = free_list_;
+    free_list_ = slot->next;
+    live_++;
+    return new (slot->storage) T(std::forward<Args>(args)...);
+  }
+
+  void Delete(T* object) {
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = free_list_;
+    free_list_ = slot;
+    live_--;
+  }
+
+  // The number of objects alive, and the bytes taken by all slabs.
+  size_t live() const { return live_; }
+  size_t capacity_bytes() const {
+    return slabs_.size() * kSlabSize * sizeof(Slot);
+  }
+
+ private:
+  union Slot {
+    Slot* next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  void AddSlab() {
+    Slot* slab = new Slot[kSlabSize];
+    slabs_.emplace_back(slab);
+    for (size_t i = kSlabSize; i > 0; i--) {
+      slab[i - 1].next = free_list_;
+      free_list_ = &slab[i - 1];
+    }
+  }
+
+  std::vector<std::unique_ptr<Slot[]>> slabs_;
+  Slot* free_list_;
+  size_t live_;
+};
+
+#endif  // SLAB_POOL_H_
@@ -0,0 +1,230 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "source_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+
+namespace {
+
+// Checks that a buffer is well-formed UTF-8: no stray continuation
+// bytes, no truncated or overlong sequences and nothing above U+10FFFF
+// or in the surrogate range.
+bool IsValidUtf8(const unsigned char* p, size_t size) {
+  const unsigned char* end = p + size;
+  while (p < end) {
+    unsigned char c = *p++;
+    if (c < 0x80) continue;
+    int extra;
+    uint32_t min;
+    uint32_t code;
+    if ((c & 0xE0) == 0xC0) {
+      extra = 1;
+      min = 0x80;
+      code = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+      extra = 2;
+      min = 0x800;
+      code = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+      extra = 3;
+      min = 0x10000;
+      code = c & 0x07;
+    } else {
+      return false;
+    }
+    if (end - p < extra) return false;
+    for (int i = 0; i < extra; i++) {
+      if ((p[i] & 0xC0) != 0x80) return false;
+      code = (code << 6) | (p[i] & 0x3F);
+    }
+    if (code < min || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF)) {
+      return false;
+    }
+    p += extra;
+  }
+  return true;
+}
+
+
+// Anything that is neither ASCII nor UTF-8 is taken to be Latin-1.
+SourceFile::Encoding Classify(const char* data, size_t size) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (i < size && p[i] < 0x80) i++;
+  if (i == size) return SourceFile::kAscii;
+  return IsValidUtf8(p + i, size - i) ? SourceFile::kUtf8
+                                      : SourceFile::kLatin1;
+}
+
+
+// A string resource pointing into the mapping of a source file.
+class SourceFileResource : public v8::String::ExternalOneByteStringResource {
+ public:
+  explicit SourceFileResource(const std::shared_ptr<SourceFile>& file)
+      : file_(file) {}
+  virtual const char* data() const { return file_->data(); }
+  virtual size_t length() const { return file_->size(); }
+
+ private:
+  std::shared_ptr<SourceFile> file_;
+};
+
+
+// Feeds the parser a source file in chunks.
+class SourceFileStream : public v8::ScriptCompiler::ExternalSourceStream {
+ public:
+  static const size_t kChunkSize = 64 * 1024;
+
+  explicit SourceFileStream(const std::shared_ptr<SourceFile>& file)
+      : file_(file), position_(0) {}
+
+  virtual size_t GetMoreData(const uint8_t** src) {
+    size_t length = file_->size() - position_;
+    if (length > kChunkSize) length = kChunkSize;
+    if (length == 0) {
+      *src = NULL;
+      return 0;
+    }
+    // The parser takes ownership of the chunk.
+    uint8_t* chunk = new uint8_t[length];
+    memcpy(chunk, file_->data() + position_, length);
+    position_ += length;
+    *src = chunk;
+    return length;
+  }
+
+ private:
+  std::shared_ptr<SourceFile> file_;
+  size_t position_;
+};
+
+}  // namespace
+
+
+std::shared_ptr<SourceFile> SourceFile::Open(const string& name) {
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  std::shared_ptr<SourceFile> file(new SourceFile());
+  file->size_ = static_cast<size_t>(st.st_size);
+  if (file->size_ == 0) {
+    close(fd);
+    return file;
+  }
+  if ((st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) != 0) {
+    // V8 reads sources again when it compiles functions lazily, so a
+    // mapping of a file rewritten in place would hand it other bytes,
+    // or SIGBUS once the file is truncated.  Read such files instead.
+    file->copy_.reset(new char[file->size_]);
+    size_t done = 0;
+    while (done < file->size_) {
+      ssize_t n = read(fd, file->copy_.get() + done, file->size_ - done);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) {
+        close(fd);
+        return NULL;
+      }
+      if (n == 0) break;
+      done += static_cast<size_t>(n);
+    }
+    close(fd);
+    file->size_ = done;
+    file->data_ = file->copy_.get();
+    return file;
+  }
+  void* data = mmap(NULL, file->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return NULL;
+  madvise(data, file->size_, MADV_SEQUENTIAL);
+  file->data_ = static_cast<const char*>(data);
+  file->mapped_ = true;
+  return file;
+}
+
+
+SourceFile::~SourceFile() {
+  if (mapped_) munmap(const_cast<char*>(data_), size_);
+}
+
+
+SourceFile::Encoding SourceFile::encoding() const {
+  std::call_once(scanned_,
+                 [this]() { encoding_ = Classify(data_, size_); });
+  return encoding_;
+}
+
+
+v8::MaybeLocal<v8::String> SourceFile::NewString(
+    v8::Isolate* isolate, const std::shared_ptr<SourceFile>& file) {
+  if (file->size_ > static_cast<size_t>(v8::String::kMaxLength)) {
+    return v8::MaybeLocal<v8::String>();
+  }
+  bool one_byte = file->encoding() != kUtf8;
+  if (one_byte && file->size_ >= kMinExternalLength) {
+    return v8::String::NewExternalOneByte(isolate,
+                                          new SourceFileResource(file));
+  }
+  if (one_byte) {
+    return v8::String::NewFromOneByte(
+        isolate, reinterpret_cast<const uint8_t*>(file->data_),
+        v8::NewStringType::kNormal, static_cast<int>(file->size_));
+  }
+  return v8::String::NewFromUtf8(isolate, file->data_,
+                                 v8::NewStringType::kNormal,
+                                 static_cast<int>(file->size_));
+}
+
+
+std::unique_ptr<v8::ScriptCompiler::StreamedSource> NewStreamedSource(
+    const std::shared_ptr<SourceFile>& file) {
+  return std::unique_ptr<v8::ScriptCompiler::StreamedSource>(
+      new v8::ScriptCompiler::StreamedSource(
+          std::unique_ptr<v8::ScriptCompiler::ExternalSourceStream>(
+              new SourceFileStream(file)),
+          v8::ScriptCompiler::StreamedSource::UTF8));
+}
+
+
+v8::MaybeLocal<v8::String> ReadSourceFile(v8::Isolate* isolate,
+                                          const char* name) {
+  std::shared_ptr<SourceFile> file = SourceFile::Open(name);
+  if (file == NULL) return v8::MaybeLocal<v8::String>();
+  return SourceFile::NewString(isolate, file);
+}
@@ -0,0 +1,110 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SOURCE_FILE_H_
+#define SOURCE_FILE_H_
+
+#include <include/v8.h>
+
+#include <stddef.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * A script source file, mapped read-only into memory.  Sources that are
+ * pure ASCII, or Latin-1 (that is, not valid UTF-8), become external
+ * one-byte strings backed by the mapping, so they are copied neither to
+ * the malloc heap nor to the V8 heap.  Other sources are decoded from
+ * UTF-8 into a heap string as before.
+ *
+ * V8 assumes a string never changes and reads the source again whenever
+ * it compiles a function lazily, for as long as the string lives.  Only
+ * files nobody has write permission for are therefore mapped; others
+ * are read into memory once.  A mapped file must still only be replaced
+ * by renaming a new file over it: rewriting it in place (which root
+ * can) changes the compiled script under V8, and truncating it makes
+ * the next lazy compile die of SIGBUS.
+ *
+ * The encoding is only worked out once it is needed, so a file handed
+ * to the streaming parser is first read on the parsing thread.
+ *
+ * The strings keep the file alive, so one file may back strings in
+ * several isolates; it is unmapped once the last of them is collected
+ * and the last reference held elsewhere is dropped.
+ */
+class SourceFile {
+ public:
+  enum Encoding { kAscii, kUtf8, kLatin1 };
+
+  // Sources shorter than this are copied; the external string and the
+  // mapping would cost more than the copy.
+  static const size_t kMinExternalLength = 1024;
+
+  // Maps a file.  Returns NULL if it cannot be read.
+  static std::shared_ptr<SourceFile> Open(const std::string& name);
+
+  ~SourceFile();
+  SourceFile(const SourceFile&) = delete;
+  SourceFile& operator=(const SourceFile&) = delete;
+
+  // Makes a string of the source in an isolate.
+  static v8::MaybeLocal<v8::String> NewString(
+      v8::Isolate* isolate, const std::shared_ptr<SourceFile>& file);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  // Scans the source the first time it is called.
+  Encoding encoding() const;
+
+ private:
+  SourceFile() : data_(""), size_(0), mapped_(false), encoding_(kAscii) {}
+
+  const char* data_;
+  size_t size_;
+  bool mapped_;
+  // Holds the contents of files that are read rather than mapped.
+  std::unique_ptr<char[]> copy_;
+  mutable std::once_flag scanned_;
+  mutable Encoding encoding_;
+};
+
+// Makes a source that streams a file to V8's parser as UTF-8.  The
+// chunks are copied out of the mapping as the parser asks for them,
+// which is what reads the file, so it is read on the thread doing the
+// parsing.  The result of parsing a kLatin1 file does not match the
+// string SourceFile::NewString makes of it; compile such files from
+// that string instead.
+std::unique_ptr<v8::ScriptCompiler::StreamedSource> NewStreamedSource(
+    const std::shared_ptr<SourceFile>& file);
+
+// Reads a script source file into a string in the isolate.
+v8::MaybeLocal<v8::String> ReadSourceFile(v8::Isolate* isolate,
+                                          const char* name);
+
+#endif  // SOURCE_FILE_H_
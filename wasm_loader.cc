@@ -0,0 +1,298 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "wasm_loader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "code_cache.h"
+#include "source_file.h"
+
+using std::string;
+
+namespace {
+
+// V8 gets the file in chunks of this size.
+const size_t kChunkSize = 1 << 20;
+
+}  // namespace
+
+
+// A file being streamed to V8.  Created on the isolate thread and
+// deleted there once the stream is finished.  The worker reading the
+// file fills in the cache fields before it posts the first chunk.
+struct WasmLoader::Stream {
+  std::shared_ptr<v8::WasmStreaming> streaming;
+  std::shared_ptr<SourceFile> file;
+  bool started;
+  // The bytes handed to V8 so far.
+  size_t fed;
+  bool keyed;
+  CodeCache::Key key;
+  // The module compiled by an earlier run, if the cache had it.
+  std::shared_ptr<string> cached;
+};
+
+
+// Writes the module V8 compiled into the cache.  V8 keeps the client
+// until it is done with the module, so it also keeps the cached bytes
+// alive while V8 may still be reading them.
+class WasmLoader::CacheClient : public v8::WasmStreaming::Client {
+ public:
+  CacheClient(CodeCache* code_cache, const CodeCache::Key& key,
+              const std::shared_ptr<string>& cached, bool write)
+      : code_cache_(code_cache), key_(key), cached_(cached), write_(write) {}
+
+  // May be called on any thread.
+  void OnModuleCompiled(v8::CompiledWasmModule compiled_module) override {
+    if (!write_) return;
+    v8::OwnedBuffer buffer = compiled_module.Serialize();
+    if (buffer.size > 0) {
+      code_cache_->WriteWasm(key_, buffer.buffer.get(), buffer.size);
+    }
+  }
+
+ private:
+  CodeCache* code_cache_;
+  CodeCache::Key key_;
+  std::shared_ptr<string> cached_;
+  bool write_;
+};
+
+
+// Hands bytes read by a ReadTask to V8 on the isolate thread.
+class WasmLoader::FeedTask : public v8::Task {
+ public:
+  FeedTask(WasmLoader* loader, Stream* stream, size_t end, bool last)
+      : loader_(loader), stream_(stream), end_(end), last_(last) {}
+
+  void Run() override { loader_->Feed(stream_, end_, last_); }
+
+ private:
+  WasmLoader* loader_;
+  Stream* stream_;
+  size_t end_;
+  bool last_;
+};
+
+
+// Reads a file on a worker thread, a chunk at a time, and posts every
+// chunk to the isolate thread as soon as it is in memory.
+class WasmLoader::ReadTask : public v8::Task {
+ public:
+  ReadTask(WasmLoader* loader, Stream* stream)
+      : loader_(loader), stream_(stream) {}
+
+  void Run() override {
+    const uint8_t* data =
+        reinterpret_cast<const uint8_t*>(stream_->file->data());
+    size_t size = stream_->file->size();
+    std::shared_ptr<v8::TaskRunner> runner =
+        loader_->platform_->GetForegroundTaskRunner(loader_->isolate_);
+
+    if (loader_->code_cache_ != NULL) {
+      // The key covers all of the bytes, so this reads the whole file
+      // before V8 sees any of it.
+      stream_->keyed = true;
+      stream_->key = CodeCache::WasmKey(data, size);
+      std::shared_ptr<string> cached(new string());
+      if (loader_->code_cache_->ReadWasm(stream_->key, cached.get())) {
+        stream_->cached = cached;
+      }
+    }
+
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t position = 0;
+    do {
+      size_t end = position + kChunkSize < size ? position + kChunkSize : size;
+      // Touch every page, so the chunk is read here and not when V8
+      // copies it on the isolate thread.
+      volatile uint8_t sink = 0;
+      for (size_t i = position; i < end; i += page_size) sink ^= data[i];
+      position = end;
+      runner->PostTask(std::unique_ptr<v8::Task>(
+          new FeedTask(loader_, stream_, end, end == size)));
+    } while (position < size);
+  }
+
+ private:
+  WasmLoader* loader_;
+  Stream* stream_;
+};
+
+
+WasmLoader::WasmLoader(v8::Isolate* isolate, v8::Platform* platform,
+                       CodeCache* code_cache)
+    : isolate_(isolate),
+      platform_(platform),
+      code_cache_(code_cache),
+      pending_(0) {
+  isolate_->SetData(kLoaderSlot, this);
+  // V8 only gives contexts the streaming functions of WebAssembly if
+  // the callback is there when they are made.
+  isolate_->SetWasmStreamingCallback(OnStreaming);
+}
+
+
+WasmLoader::~WasmLoader() {
+  isolate_->SetWasmStreamingCallback(NULL);
+  isolate_->SetData(kLoaderSlot, NULL);
+}
+
+
+void WasmLoader::Install(v8::Local<v8::ObjectTemplate> global) {
+  global->Set(v8::String::NewFromUtf8Literal(isolate_, "loadWasm"),
+              v8::FunctionTemplate::New(isolate_, LoadWasm,
+                                        v8::External::New(isolate_, this)));
+}
+
+
+void WasmLoader::RunUntilIdle() {
+  while (pending_ > 0) {
+    v8::platform::PumpMessageLoop(
+        platform_, isolate_, v8::platform::MessageLoopBehavior::kWaitForWork);
+  }
+}
+
+
+void WasmLoader::OnStreaming(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  WasmLoader* loader = static_cast<WasmLoader*>(isolate->GetData(kLoaderSlot));
+  std::shared_ptr<v8::WasmStreaming> streaming =
+      v8::WasmStreaming::Unpack(isolate, args.Data());
+  if (!args[0]->IsString()) {
+    streaming->Abort(v8::Exception::TypeError(v8::String::NewFromUtf8Literal(
+        isolate, "WebAssembly streaming expects a file name")));
+    return;
+  }
+  v8::String::Utf8Value path(isolate, args[0]);
+  std::shared_ptr<SourceFile> file =
+      *path != NULL ? SourceFile::Open(*path) : NULL;
+  if (file == NULL) {
+    string message = "Error loading file '" +
+                     string(*path != NULL ? *path : "") + "'";
+    streaming->Abort(v8::Exception::Error(
+        v8::String::NewFromUtf8(isolate, message.c_str()).ToLocalChecked()));
+    return;
+  }
+
+  Stream* stream = new Stream();
+  stream->streaming = streaming;
+  stream->file = file;
+  stream->started = false;
+  stream->fed = 0;
+  stream->keyed = false;
+  loader->pending_++;
+  loader->platform_->CallOnWorkerThread(
+      std::unique_ptr<v8::Task>(new ReadTask(loader, stream)));
+}
+
+
+void WasmLoader::Feed(Stream* stream, size_t end, bool last) {
+  v8::HandleScope handle_scope(isolate_);
+  if (!stream->started) {
+    stream->started = true;
+    if (stream->keyed) {
+      bool use_cache = stream->cached != NULL;
+      if (use_cache && !stream->streaming->SetCompiledModuleBytes(
+                           reinterpret_cast<const uint8_t*>(
+                               stream->cached->data()),
+                           stream->cached->size())) {
+        code_cache_->RejectWasm();
+        use_cache = false;
+      }
+      stream->streaming->SetClient(std::make_shared<CacheClient>(
+          code_cache_, stream->key, stream->cached, !use_cache));
+    }
+  }
+  if (end > stream->fed) {
+    stream->streaming->OnBytesReceived(
+        reinterpret_cast<const uint8_t*>(stream->file->data()) + stream->fed,
+        end - stream->fed);
+    stream->fed = end;
+  }
+  if (last) {
+    stream->streaming->Finish();
+    delete stream;
+    pending_--;
+  }
+}
+
+
+// loadWasm(path) is WebAssembly.compileStreaming(path), with the shell
+// waiting for the promise before it moves on.
+void WasmLoader::LoadWasm(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  WasmLoader* loader =
+      static_cast<WasmLoader*>(args.Data().As<v8::External>()->Value());
+  v8::Local<v8::Value> wasm;
+  v8::Local<v8::Value> compile;
+  if (!context->Global()
+           ->Get(context, v8::String::NewFromUtf8Literal(isolate,
+                                                         "WebAssembly"))
+           .ToLocal(&wasm) ||
+      !wasm->IsObject() ||
+      !wasm.As<v8::Object>()
+           ->Get(context,
+                 v8::String::NewFromUtf8Literal(isolate, "compileStreaming"))
+           .ToLocal(&compile) ||
+      !compile->IsFunction()) {
+    if (!isolate->IsExecutionTerminating()) {
+      isolate->ThrowException(
+          v8::Exception::Error(v8::String::NewFromUtf8Literal(
+              isolate, "WebAssembly streaming is not available")));
+    }
+    return;
+  }
+  v8::Local<v8::Value> path = args[0];
+  v8::Local<v8::Value> result;
+  if (!compile.As<v8::Function>()->Call(context, wasm, 1, &path).ToLocal(
+          &result)) {
+    return;
+  }
+  if (result->IsPromise()) {
+    v8::Local<v8::External> data = v8::External::New(isolate, loader);
+    v8::Local<v8::Function> settled;
+    if (v8::Function::New(context, OnSettled, data).ToLocal(&settled) &&
+        !result.As<v8::Promise>()->Then(context, settled, settled).IsEmpty()) {
+      loader->pending_++;
+    }
+  }
+  args.GetReturnValue().Set(result);
+}
+
+
+void WasmLoader::OnSettled(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  static_cast<WasmLoader*>(args.Data().As<v8::External>()->Value())
+      ->pending_--;
+}
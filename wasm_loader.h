@@ -0,0 +1,97 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef WASM_LOADER_H_
+#define WASM_LOADER_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+class CodeCache;
+
+/**
+ * Compiles WebAssembly modules from files with streaming compilation
+ * and, given a code cache, keeps the compiled modules across runs.
+ *
+ * Once the loader is made, WebAssembly.compileStreaming and
+ * WebAssembly.instantiateStreaming take file names in its isolate, and
+ * Install adds
+ *
+ *   loadWasm(path)   // a promise of the WebAssembly.Module in the file
+ *
+ * The file is read on one of the platform's worker threads and handed
+ * to V8 in chunks as it is read, so V8 compiles the functions that have
+ * arrived while the rest is still being read.  With a code cache the
+ * worker first hashes the wire bytes and looks up the module compiled
+ * by an earlier run; V8 then deserializes it instead of compiling.
+ * Modules that were compiled are serialized into the cache once V8 has
+ * finished optimizing them.
+ *
+ * All methods must be called on the thread running the isolate.
+ */
+class WasmLoader {
+ public:
+  WasmLoader(v8::Isolate* isolate, v8::Platform* platform,
+             CodeCache* code_cache);
+  ~WasmLoader();
+  WasmLoader(const WasmLoader&) = delete;
+  WasmLoader& operator=(const WasmLoader&) = delete;
+
+  // Adds loadWasm to a global object template.
+  void Install(v8::Local<v8::ObjectTemplate> global);
+
+  // Runs foreground tasks until every file has been handed to V8 and
+  // every loadWasm promise has settled.
+  void RunUntilIdle();
+
+  int pending() const { return pending_; }
+
+ private:
+  // The isolate data slot holding the loader.
+  static const uint32_t kLoaderSlot = 1;
+
+  struct Stream;
+  class ReadTask;
+  class FeedTask;
+  class CacheClient;
+
+  static void OnStreaming(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void LoadWasm(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void OnSettled(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  // Hands the next chunk of a file to V8, finishing the stream after the
+  // last one.
+  void Feed(Stream* stream, size_t end, bool last);
+
+  v8::Isolate* isolate_;
+  v8::Platform* platform_;
+  CodeCache* code_cache_;
+  // Streams not finished yet plus loadWasm promises not settled yet.
+  int pending_;
+};
+
+#endif  // WASM_LOADER_H_
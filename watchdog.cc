@@ -0,0 +1,116 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "watchdog.h"
+
+#include <chrono>
+
+
+Watchdog::Watchdog(v8::Isolate* isolate, int budget_ms)
+    : isolate_(isolate),
+      budget_ns_(static_cast<int64_t>(budget_ms) * 1000000),
+      calls_(0),
+      state_(kIdle),
+      deadline_ns_(0),
+      sleeping_(false),
+      stop_(false) {
+  thread_ = std::thread(&Watchdog::Run, this);
+}
+
+
+Watchdog::~Watchdog() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+}
+
+
+int64_t Watchdog::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+
+void Watchdog::Arm(int budgets) {
+  calls_++;
+  deadline_ns_.store(Now() + budget_ns_ * budgets, std::memory_order_relaxed);
+  // Sequentially consistent, paired with Run: either the thread sees the
+  // call armed or we see it asleep and wake it.
+  state_.store((calls_ << kStateBits) | kArmed);
+  if (sleeping_.load()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    wake_.notify_one();
+  }
+}
+
+
+bool Watchdog::Disarm() {
+  uint64_t armed = (calls_ << kStateBits) | kArmed;
+  uint64_t idle = calls_ << kStateBits;
+  uint64_t state = armed;
+  if (state_.compare_exchange_strong(state, idle,
+                                     std::memory_order_acq_rel)) {
+    return false;
+  }
+  // The watchdog got there first.  Wait until it has actually asked for
+  // the termination, so it cannot land in the next call instead.
+  while ((state_.load(std::memory_order_acquire) & kStateMask) == kFiring)
+    std::this_thread::yield();
+  state_.store(idle, std::memory_order_relaxed);
+  return true;
+}
+
+
+void Watchdog::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    sleeping_.store(true);
+    uint64_t state = state_.load();
+    if ((state & kStateMask) != kArmed) {
+      // Nothing to watch until Arm wakes us.
+      wake_.wait(lock);
+      continue;
+    }
+    sleeping_.store(false);
+    // A call armed since has a later deadline, so this is never late.
+    int64_t wait_ns = deadline_ns_.load(std::memory_order_relaxed) - Now();
+    if (wait_ns > 0) {
+      wake_.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+      continue;
+    }
+    uint64_t call = state & ~kStateMask;
+    if (state_.compare_exchange_strong(state, call | kFiring,
+                                       std::memory_order_acq_rel)) {
+      isolate_->TerminateExecution();
+      state_.store(call | kFired, std::memory_order_release);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef WATCHDOG_H_
+#define WATCHDOG_H_
+
+#include <include/v8.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * Enforces a time budget on calls into an isolate.  The thread making
+ * the calls arms the watchdog before each call and disarms it after;
+ * a background thread terminates execution in the isolate if a call is
+ * still armed when its deadline passes.
+ *
+ * Arming and disarming are a clock read and a few atomic operations, so
+ * calls that finish in time pay next to nothing.  The background thread
+ * sleeps until the deadline of the armed call and looks again then, and
+ * sleeps without a timeout while no call is armed; Arm only has to wake
+ * it in that case.  An idle watchdog thus costs no wakeups at all.
+ */
+class Watchdog {
+ public:
+  Watchdog(v8::Isolate* isolate, int budget_ms);
+  ~Watchdog();
+
+  // Starts the clock for a call allowed the given number of budgets.
+  void Arm(int budgets = 1);
+
+  // Stops the clock.  Returns true if the call ran out of time and was
+  // terminated, in which case the caller must cancel the termination
+  // once it has left JavaScript.
+  bool Disarm();
+
+  int budget_ms() const { return static_cast<int>(budget_ns_ / 1000000); }
+
+ private:
+  // The low bits of state_ hold one of these, the rest the number of
+  // the call it refers to, so the watchdog never terminates a call
+  // that was armed after it looked at the deadline.
+  enum State { kIdle = 0, kArmed = 1, kFiring = 2, kFired = 3 };
+  static const int kStateBits = 2;
+  static const uint64_t kStateMask = (1 << kStateBits) - 1;
+
+  static int64_t Now();
+  void Run();
+
+  v8::Isolate* isolate_;
+  int64_t budget_ns_;
+  // Only touched by the thread making the calls.
+  uint64_t calls_;
+  std::atomic<uint64_t> state_;
+  std::atomic<int64_t> deadline_ns_;
+
+  std::mutex mutex_;
+  // Signalled by Arm when the thread is asleep with nothing armed, and
+  // by the destructor.
+  std::condition_variable wake_;
+  // Set by the thread before it checks for an armed call.
+  std::atomic<bool> sleeping_;
+  bool stop_;
+  std::thread thread_;
+};
+
+#endif  // WATCHDOG_H_
@@ -0,0 +1,683 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "worker.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "heap_control.h"
+#include "source_file.h"
+
+using std::string;
+
+/**
+ * A message in flight between two isolates: the serialized value and
+ * the backing stores of the array buffers it refers to.
+ */
+struct WorkerMessage {
+  WorkerMessage() : data(NULL), size(0) {}
+  ~WorkerMessage() { free(data); }
+
+  uint8_t* data;
+  size_t size;
+  std::vector<std::shared_ptr<v8::BackingStore>> array_buffers;
+  std::vector<std::shared_ptr<v8::BackingStore>> shared_array_buffers;
+};
+
+namespace {
+
+enum WorkerField { kWorkerField, kWorkerFieldCount };
+
+
+void ThrowTypeError(v8::Isolate* isolate, const char* message) {
+  isolate->ThrowException(v8::Exception::TypeError(
+      v8::String::NewFromUtf8(isolate, message).ToLocalChecked()));
+}
+
+
+// Prints an exception caught in a worker or in an onmessage function.
+void PrintException(v8::Isolate* isolate, v8::TryCatch* try_catch) {
+  if (try_catch->HasTerminated()) return;
+  v8::String::Utf8Value exception(isolate, try_catch->Exception());
+  const char* text = *exception != NULL ? *exception : "<exception>";
+  v8::Local<v8::Message> message = try_catch->Message();
+  if (message.IsEmpty()) {
+    fprintf(stderr, "%s\n", text);
+    return;
+  }
+  v8::String::Utf8Value file(isolate,
+                             message->GetScriptOrigin().ResourceName());
+  fprintf(stderr, "%s:%d: %s\n", *file != NULL ? *file : "<unknown>",
+          message->GetLineNumber(isolate->GetCurrentContext()).FromMaybe(0),
+          text);
+}
+
+
+class SerializerDelegate : public v8::ValueSerializer::Delegate {
+ public:
+  SerializerDelegate(v8::Isolate* isolate, WorkerMessage* message)
+      : isolate_(isolate), message_(message) {}
+
+  void ThrowDataCloneError(v8::Local<v8::String> message) override {
+    isolate_->ThrowException(v8::Exception::Error(message));
+  }
+
+  v8::Maybe<uint32_t> GetSharedArrayBufferId(
+      v8::Isolate* isolate, v8::Local<v8::SharedArrayBuffer> buffer) override {
+    message_->shared_array_buffers.push_back(buffer->GetBackingStore());
+    return v8::Just(
+        static_cast<uint32_t>(message_->shared_array_buffers.size() - 1));
+  }
+
+ private:
+  v8::Isolate* isolate_;
+  WorkerMessage* message_;
+};
+
+
+class DeserializerDelegate : public v8::ValueDeserializer::Delegate {
+ public:
+  explicit DeserializerDelegate(WorkerMessage* message) : message_(message) {}
+
+  v8::MaybeLocal<v8::SharedArrayBuffer> GetSharedArrayBufferFromId(
+      v8::Isolate* isolate, uint32_t id) override {
+    if (id >= message_->shared_array_buffers.size()) {
+      return v8::MaybeLocal<v8::SharedArrayBuffer>();
+    }
+    return v8::SharedArrayBuffer::New(isolate,
+                                      message_->shared_array_buffers[id]);
+  }
+
+ private:
+  WorkerMessage* message_;
+};
+
+
+// Serializes a value, moving the array buffers in the transfer list
+// into the message.  Returns false with an exception pending if the
+// value cannot be sent.
+bool Serialize(v8::Local<v8::Context> context, v8::Local<v8::Value> value,
+               v8::Local<v8::Value> transfer, WorkerMessage* message) {
+  v8::Isolate* isolate = context->GetIsolate();
+  std::vector<v8::Local<v8::ArrayBuffer>> transferred;
+  if (!transfer->IsUndefined()) {
+    if (!transfer->IsArray()) {
+      ThrowTypeError(isolate, "Transfer list must be an array");
+      return false;
+    }
+    v8::Local<v8::Array> list = transfer.As<v8::Array>();
+    for (uint32_t i = 0; i < list->Length(); i++) {
+      v8::Local<v8::Value> item;
+      if (!list->Get(context, i).ToLocal(&item)) return false;
+      if (!item->IsArrayBuffer() ||
+          !item.As<v8::ArrayBuffer>()->IsDetachable()) {
+        ThrowTypeError(isolate, "Only ArrayBuffers can be transferred");
+        return false;
+      }
+      for (size_t j = 0; j < transferred.size(); j++) {
+        if (transferred[j] == item) {
+          ThrowTypeError(isolate, "ArrayBuffer transferred twice");
+          return false;
+        }
+      }
+      transferred.push_back(item.As<v8::ArrayBuffer>());
+    }
+  }
+
+  SerializerDelegate delegate(isolate, message);
+  v8::ValueSerializer serializer(isolate, &delegate);
+  for (size_t i = 0; i < transferred.size(); i++) {
+    serializer.TransferArrayBuffer(static_cast<uint32_t>(i), transferred[i]);
+  }
+  serializer.WriteHeader();
+  bool ok;
+  if (!serializer.WriteValue(context, value).To(&ok)) return false;
+  std::pair<uint8_t*, size_t> data = serializer.Release();
+  message->data = data.first;
+  message->size = data.second;
+  for (size_t i = 0; i < transferred.size(); i++) {
+    message->array_buffers.push_back(transferred[i]->GetBackingStore());
+    transferred[i]->Detach();
+  }
+  return true;
+}
+
+
+// Turns a message back into a value in another isolate, wrapped in an
+// event object as its 'data'.
+v8::MaybeLocal<v8::Value> Deserialize(v8::Local<v8::Context> context,
+                                      WorkerMessage* message) {
+  v8::Isolate* isolate = context->GetIsolate();
+  DeserializerDelegate delegate(message);
+  v8::ValueDeserializer deserializer(isolate, message->data, message->size,
+                                     &delegate);
+  for (size_t i = 0; i < message->array_buffers.size(); i++) {
+    deserializer.TransferArrayBuffer(
+        static_cast<uint32_t>(i),
+        v8::ArrayBuffer::New(isolate, message->array_buffers[i]));
+  }
+  bool ok;
+  v8::Local<v8::Value> value;
+  if (!deserializer.ReadHeader(context).To(&ok) ||
+      !deserializer.ReadValue(context).ToLocal(&value)) {
+    return v8::MaybeLocal<v8::Value>();
+  }
+  v8::Local<v8::Object> event = v8::Object::New(isolate);
+  if (event->Set(context, v8::String::NewFromUtf8Literal(isolate, "data"),
+                 value)
+          .IsNothing()) {
+    return v8::MaybeLocal<v8::Value>();
+  }
+  return event;
+}
+
+
+// Calls the 'onmessage' function of an object, if it has one, with a
+// message.  Exceptions are printed.
+void DispatchMessage(v8::Local<v8::Context> context,
+                     v8::Local<v8::Object> target, WorkerMessage* message) {
+  v8::Isolate* isolate = context->GetIsolate();
+  v8::TryCatch try_catch(isolate);
+  v8::Local<v8::Value> handler;
+  v8::Local<v8::Value> event;
+  if (!target->Get(context, v8::String::NewFromUtf8Literal(isolate,
+                                                           "onmessage"))
+           .ToLocal(&handler) ||
+      !handler->IsFunction() ||
+      !Deserialize(context, message).ToLocal(&event) ||
+      handler.As<v8::Function>()->Call(context, target, 1, &event).IsEmpty()) {
+    if (try_catch.HasCaught()) PrintException(isolate, &try_catch);
+  }
+}
+
+
+class NoopTask : public v8::Task {
+ public:
+  void Run() override {}
+};
+
+
+// Hands a message from a worker to the parent's isolate thread.
+class DeliverTask : public v8::Task {
+ public:
+  DeliverTask(Worker* worker, std::unique_ptr<WorkerMessage> message)
+      : worker_(worker), message_(std::move(message)) {}
+
+  void Run() override;
+
+ private:
+  Worker* worker_;
+  std::unique_ptr<WorkerMessage> message_;
+};
+
+}  // namespace
+
+
+/**
+ * One worker: its thread, its isolate and its queue of messages from
+ * the parent.  The queue and the states are guarded by the mutex of the
+ * parent's WorkerHost.
+ */
+class Worker {
+ public:
+  Worker(WorkerHost* parent, const string& script, bool is_source)
+      : parent_(parent),
+        script_(script),
+        is_source_(is_source),
+        busy_(true),
+        terminated_(false),
+        finished_(false),
+        undelivered_(0),
+        closed_(false),
+        isolate_(NULL) {}
+
+  void Start() { thread_ = std::thread(&Worker::Run, this); }
+  void Join() {
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Called on the parent's thread.
+  void Post(std::unique_ptr<WorkerMessage> message);
+  void Terminate();
+  void Deliver(WorkerMessage* message);
+  // Holds the wrapper strongly while the worker may still call its
+  // onmessage function.  Otherwise the wrapper is weak, and a worker
+  // whose wrapper is collected is terminated, as nothing can reach it.
+  void HoldWrapper(bool strong);
+  // Joins the thread of a worker that is done and cuts the wrapper
+  // loose from it.
+  void Release();
+
+  // Called on the parent's thread with its mutex held.  A worker is
+  // idle while it waits for messages and none of its own are on the
+  // way, and done once its thread has ended and all of its messages
+  // have been handled.
+  bool idle() const { return !busy_ && undelivered_ == 0; }
+  bool done() const { return finished_ && undelivered_ == 0; }
+
+  // The JavaScript object and context of the worker in the parent.
+  v8::Global<v8::Object> wrapper;
+  v8::Global<v8::Context> context;
+
+ private:
+  static void PostToParent(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Close(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void OnWrapperCollected(const v8::WeakCallbackInfo<Worker>& info);
+
+  void Run();
+  bool RunScript(v8::Isolate* isolate, v8::Local<v8::Context> context);
+  // Handles messages from the parent until the worker is terminated or
+  // closed or has no onmessage function.
+  void HandleMessages(v8::Isolate* isolate, v8::Local<v8::Context> context);
+
+  WorkerHost* parent_;
+  string script_;
+  bool is_source_;
+  std::deque<std::unique_ptr<WorkerMessage>> inbox_;
+  std::condition_variable wake_;
+  // Whether the worker counts as busy in the parent.
+  bool busy_;
+  bool terminated_;
+  // Set once the worker's thread is about to end.
+  bool finished_;
+  // Messages posted to the parent that have not been handled yet.
+  int undelivered_;
+  // Set by close(); only used on the worker's thread.
+  bool closed_;
+  // The worker's isolate while it exists.
+  v8::Isolate* isolate_;
+  std::thread thread_;
+};
+
+
+void DeliverTask::Run() { worker_->Deliver(message_.get()); }
+
+
+void Worker::Deliver(WorkerMessage* message) {
+  parent_->Deliver(this, message);
+  // Only now, so the worker is not released while its message is out.
+  std::lock_guard<std::mutex> lock(parent_->mutex_);
+  undelivered_--;
+  parent_->undelivered_--;
+}
+
+
+void Worker::HoldWrapper(bool strong) {
+  if (wrapper.IsEmpty() || wrapper.IsWeak() != strong) return;
+  if (strong) {
+    wrapper.ClearWeak();
+  } else {
+    wrapper.SetWeak(this, OnWrapperCollected,
+                    v8::WeakCallbackType::kParameter);
+  }
+}
+
+
+void Worker::OnWrapperCollected(const v8::WeakCallbackInfo<Worker>& info) {
+  Worker* worker = info.GetParameter();
+  worker->wrapper.Reset();
+  worker->Terminate();
+}
+
+
+void Worker::Release() {
+  Join();
+  if (!wrapper.IsEmpty()) {
+    v8::HandleScope handle_scope(parent_->isolate_);
+    wrapper.Get(parent_->isolate_)
+        ->SetAlignedPointerInInternalField(kWorkerField, NULL);
+  }
+  wrapper.Reset();
+  context.Reset();
+}
+
+
+void Worker::Post(std::unique_ptr<WorkerMessage> message) {
+  std::lock_guard<std::mutex> lock(parent_->mutex_);
+  if (terminated_) return;
+  inbox_.push_back(std::move(message));
+  if (!busy_) {
+    busy_ = true;
+    parent_->busy_workers_++;
+  }
+  wake_.notify_one();
+}
+
+
+void Worker::Terminate() {
+  std::lock_guard<std::mutex> lock(parent_->mutex_);
+  terminated_ = true;
+  inbox_.clear();
+  if (isolate_ != NULL) {
+    isolate_->TerminateExecution();
+    // In case the worker is waiting for tasks of its own.
+    parent_->config_.platform->GetForegroundTaskRunner(isolate_)->PostTask(
+        std::unique_ptr<v8::Task>(new NoopTask()));
+  }
+  wake_.notify_one();
+}
+
+
+void Worker::Run() {
+  const WorkerConfig& config = parent_->config_;
+  v8::Isolate::CreateParams create_params;
+  // Buffers made here may be moved to the parent or still be waiting in
+  // an inbox when the isolate is gone; their stores keep the allocator
+  // that has to free them alive.
+  create_params.array_buffer_allocator_shared =
+      NewArrayBufferAllocator(config.allocator);
+  SetHeapLimits(config.max_young_mb, config.max_old_mb, &create_params);
+  v8::Isolate* isolate = v8::Isolate::New(create_params);
+  bool terminated;
+  {
+    std::lock_guard<std::mutex> lock(parent_->mutex_);
+    isolate_ = isolate;
+    terminated = terminated_;
+  }
+  if (!terminated) {
+    v8::Isolate::Scope isolate_scope(isolate);
+    v8::HandleScope handle_scope(isolate);
+    v8::Local<v8::Context> context = config.enter(isolate);
+    if (!context.IsEmpty()) {
+      v8::Context::Scope context_scope(context);
+      if (RunScript(isolate, context)) {
+        config.run_until_idle(isolate);
+        HandleMessages(isolate, context);
+      }
+    }
+    config.exit(isolate);
+  }
+  {
+    std::lock_guard<std::mutex> lock(parent_->mutex_);
+    isolate_ = NULL;
+  }
+  isolate->Dispose();
+
+  std::lock_guard<std::mutex> lock(parent_->mutex_);
+  terminated_ = true;
+  finished_ = true;
+  if (busy_) {
+    busy_ = false;
+    parent_->busy_workers_--;
+  }
+  parent_->Wake();
+}
+
+
+bool Worker::RunScript(v8::Isolate* isolate, v8::Local<v8::Context> context) {
+  v8::TryCatch try_catch(isolate);
+  v8::Local<v8::External> data = v8::External::New(isolate, this);
+  v8::Local<v8::Object> global = context->Global();
+  v8::Local<v8::Function> post_message;
+  v8::Local<v8::Function> close;
+  if (!v8::Function::New(context, PostToParent, data).ToLocal(&post_message) ||
+      !v8::Function::New(context, Close, data).ToLocal(&close) ||
+      global
+          ->Set(context, v8::String::NewFromUtf8Literal(isolate, "postMessage"),
+                post_message)
+          .IsNothing() ||
+      global->Set(context, v8::String::NewFromUtf8Literal(isolate, "close"),
+                  close)
+          .IsNothing()) {
+    PrintException(isolate, &try_catch);
+    return false;
+  }
+
+  v8::Local<v8::String> source;
+  v8::Local<v8::String> name;
+  if (is_source_) {
+    name = v8::String::NewFromUtf8Literal(isolate, "worker");
+    if (!v8::String::NewFromUtf8(isolate, script_.c_str()).ToLocal(&source)) {
+      return false;
+    }
+  } else {
+    name = v8::String::NewFromUtf8(isolate, script_.c_str()).ToLocalChecked();
+    if (!ReadSourceFile(isolate, script_.c_str()).ToLocal(&source)) {
+      fprintf(stderr, "Error reading '%s'\n", script_.c_str());
+      return false;
+    }
+  }
+  v8::ScriptOrigin origin(name);
+  v8::Local<v8::Script> script;
+  if (!v8::Script::Compile(context, source, &origin).ToLocal(&script) ||
+      script->Run(context).IsEmpty()) {
+    PrintException(isolate, &try_catch);
+    return false;
+  }
+  return true;
+}
+
+
+void Worker::HandleMessages(v8::Isolate* isolate,
+                            v8::Local<v8::Context> context) {
+  v8::Local<v8::String> onmessage =
+      v8::String::NewFromUtf8Literal(isolate, "onmessage");
+  for (;;) {
+    v8::HandleScope handle_scope(isolate);
+    v8::Local<v8::Value> handler;
+    if (closed_ ||
+        !context->Global()->Get(context, onmessage).ToLocal(&handler) ||
+        !handler->IsFunction()) {
+      return;
+    }
+    std::unique_ptr<WorkerMessage> message;
+    {
+      std::unique_lock<std::mutex> lock(parent_->mutex_);
+      if (inbox_.empty() && busy_) {
+        busy_ = false;
+        parent_->busy_workers_--;
+        parent_->Wake();
+      }
+      while (!terminated_ && inbox_.empty()) wake_.wait(lock);
+      if (terminated_) return;
+      message = std::move(inbox_.front());
+      inbox_.pop_front();
+    }
+    DispatchMessage(context, context->Global(), message.get());
+    parent_->config_.run_until_idle(isolate);
+  }
+}
+
+
+void Worker::PostToParent(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Worker* worker =
+      static_cast<Worker*>(args.Data().As<v8::External>()->Value());
+  std::unique_ptr<WorkerMessage> message(new WorkerMessage());
+  if (!Serialize(args.GetIsolate()->GetCurrentContext(), args[0], args[1],
+                 message.get())) {
+    return;
+  }
+  WorkerHost* parent = worker->parent_;
+  std::lock_guard<std::mutex> lock(parent->mutex_);
+  worker->undelivered_++;
+  parent->undelivered_++;
+  parent->task_runner_->PostTask(std::unique_ptr<v8::Task>(
+      new DeliverTask(worker, std::move(message))));
+}
+
+
+void Worker::Close(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  static_cast<Worker*>(args.Data().As<v8::External>()->Value())->closed_ =
+      true;
+}
+
+
+WorkerHost::WorkerHost(v8::Isolate* isolate, const WorkerConfig& config)
+    : isolate_(isolate),
+      config_(config),
+      task_runner_(config.platform->GetForegroundTaskRunner(isolate)),
+      busy_workers_(0),
+      undelivered_(0) {}
+
+
+WorkerHost::~WorkerHost() {
+  for (size_t i = 0; i < workers_.size(); i++) workers_[i]->Terminate();
+  for (size_t i = 0; i < workers_.size(); i++) workers_[i]->Join();
+}
+
+
+void WorkerHost::Install(v8::Local<v8::ObjectTemplate> global) {
+  v8::Local<v8::FunctionTemplate> templ = v8::FunctionTemplate::New(
+      isolate_, ConstructWorker, v8::External::New(isolate_, this));
+  templ->SetClassName(v8::String::NewFromUtf8Literal(isolate_, "Worker"));
+  templ->InstanceTemplate()->SetInternalFieldCount(kWorkerFieldCount);
+  v8::Local<v8::Signature> signature = v8::Signature::New(isolate_, templ);
+  v8::Local<v8::ObjectTemplate> proto = templ->PrototypeTemplate();
+  proto->Set(v8::String::NewFromUtf8Literal(isolate_, "postMessage"),
+             v8::FunctionTemplate::New(isolate_, PostMessage,
+                                       v8::Local<v8::Value>(), signature));
+  proto->Set(v8::String::NewFromUtf8Literal(isolate_, "terminate"),
+             v8::FunctionTemplate::New(isolate_, Terminate,
+                                       v8::Local<v8::Value>(), signature));
+  global->Set(v8::String::NewFromUtf8Literal(isolate_, "Worker"), templ);
+}
+
+
+void WorkerHost::RunUntilIdle() {
+  for (;;) {
+    while (v8::platform::PumpMessageLoop(config_.platform, isolate_)) continue;
+    CollectWorkers();
+    if (!busy()) return;
+    v8::platform::PumpMessageLoop(
+        config_.platform, isolate_,
+        v8::platform::MessageLoopBehavior::kWaitForWork);
+  }
+}
+
+
+void WorkerHost::CollectWorkers() {
+  std::vector<std::shared_ptr<Worker>> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t kept = 0;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      if (workers_[i]->done()) {
+        done.push_back(workers_[i]);
+        continue;
+      }
+      workers_[i]->HoldWrapper(!workers_[i]->idle());
+      workers_[kept++] = workers_[i];
+    }
+    workers_.resize(kept);
+  }
+  for (size_t i = 0; i < done.size(); i++) done[i]->Release();
+}
+
+
+bool WorkerHost::busy() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return busy_workers_ > 0 || undelivered_ > 0;
+}
+
+
+void WorkerHost::ConstructWorker(
+    const v8::FunctionCallbackInfo<v8::Value>& args) {
+  v8::Isolate* isolate = args.GetIsolate();
+  v8::Local<v8::Context> context = isolate->GetCurrentContext();
+  WorkerHost* host =
+      static_cast<WorkerHost*>(args.Data().As<v8::External>()->Value());
+  if (!args.IsConstructCall()) {
+    ThrowTypeError(isolate, "Worker must be called with new");
+    return;
+  }
+  if (!args[0]->IsString()) {
+    ThrowTypeError(isolate, "Worker expects a file name or a source");
+    return;
+  }
+  // {type: 'string'} runs the argument itself instead of a file.
+  bool is_source = false;
+  if (args[1]->IsObject()) {
+    v8::Local<v8::Value> type;
+    if (!args[1]
+             .As<v8::Object>()
+             ->Get(context, v8::String::NewFromUtf8Literal(isolate, "type"))
+             .ToLocal(&type)) {
+      return;
+    }
+    v8::String::Utf8Value type_name(isolate, type);
+    is_source = *type_name != NULL && string(*type_name) == "string";
+  }
+  v8::String::Utf8Value script(isolate, args[0]);
+
+  std::shared_ptr<Worker> worker(new Worker(host, *script, is_source));
+  worker->wrapper.Reset(isolate, args.This());
+  worker->context.Reset(isolate, context);
+  args.This()->SetAlignedPointerInInternalField(kWorkerField, worker.get());
+  {
+    std::lock_guard<std::mutex> lock(host->mutex_);
+    host->workers_.push_back(worker);
+    host->busy_workers_++;
+  }
+  worker->Start();
+}
+
+
+void WorkerHost::PostMessage(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Worker* worker = static_cast<Worker*>(
+      args.Holder()->GetAlignedPointerFromInternalField(kWorkerField));
+  // Messages to a worker that has ended go nowhere.
+  if (worker == NULL) return;
+  std::unique_ptr<WorkerMessage> message(new WorkerMessage());
+  if (!Serialize(args.GetIsolate()->GetCurrentContext(), args[0], args[1],
+                 message.get())) {
+    return;
+  }
+  // The worker may answer, so it needs its wrapper again.
+  worker->HoldWrapper(true);
+  worker->Post(std::move(message));
+}
+
+
+void WorkerHost::Terminate(const v8::FunctionCallbackInfo<v8::Value>& args) {
+  Worker* worker = static_cast<Worker*>(
+      args.Holder()->GetAlignedPointerFromInternalField(kWorkerField));
+  if (worker != NULL) worker->Terminate();
+}
+
+
+void WorkerHost::Deliver(Worker* worker, WorkerMessage* message) {
+  // A worker whose wrapper was collected has no onmessage to call.
+  if (worker->wrapper.IsEmpty()) return;
+  v8::HandleScope handle_scope(isolate_);
+  v8::Local<v8::Context> context = worker->context.Get(isolate_);
+  v8::Context::Scope context_scope(context);
+  DispatchMessage(context, worker->wrapper.Get(isolate_), message);
+  isolate_->PerformMicrotaskCheckpoint();
+}
+
+
+void WorkerHost::Wake() {
+  task_runner_->PostTask(std::unique_ptr<v8::Task>(new NoopTask()));
+}
@@ -0,0 +1,144 @@
+// Copyright 2012 the V8 project authors. All rights reserved.
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//     * Neither the name of Google Inc. nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef WORKER_H_
+#define WORKER_H_
+
+#include <include/libplatform/libplatform.h>
+#include <include/v8.h>
+
+#include <stddef.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "pooled_allocator.h"
+
+class Worker;
+struct WorkerMessage;
+
+/**
+ * How the isolates of workers are created and set up.  The hooks are
+ * called on the worker's thread with its isolate entered.
+ */
+struct WorkerConfig {
+  WorkerConfig()
+      : platform(NULL),
+        max_young_mb(0),
+        max_old_mb(0),
+        allocator(kDefaultAllocator),
+        enter(NULL),
+        run_until_idle(NULL),
+        exit(NULL) {}
+
+  v8::Platform* platform;
+  // Heap limits of worker isolates, as for SetHeapLimits.
+  size_t max_young_mb;
+  size_t max_old_mb;
+  // The ArrayBuffer allocator of worker isolates.
+  ArrayBufferAllocatorKind allocator;
+  // Sets up whatever scripts need and returns the context to run the
+  // worker's script in.
+  v8::Local<v8::Context> (*enter)(v8::Isolate* isolate);
+  // Runs the tasks a script has left behind, such as pending reads or
+  // messages from its own workers, until there are none.
+  void (*run_until_idle)(v8::Isolate* isolate);
+  // Undoes enter before the isolate is disposed.
+  void (*exit)(v8::Isolate* isolate);
+};
+
+
+/**
+ * Gives the scripts of an isolate a Worker constructor, which runs a
+ * script on a new thread in an isolate of its own:
+ *
+ *   var worker = new Worker('job.js');      // or new Worker(source,
+ *                                            //   {type: 'string'})
+ *   worker.onmessage = function(event) { print(event.data); };
+ *   worker.postMessage(value, [arrayBuffer]);
+ *   worker.terminate();
+ *
+ * Within the worker, postMessage(value, transfer) sends a message back,
+ * an 'onmessage' function receives the messages of the parent and
+ * close() ends the worker once the current message is handled.  A
+ * worker without an 'onmessage' function ends when its script is done.
+ *
+ * Messages are copied with the structured clone algorithm through
+ * ValueSerializer.  ArrayBuffers in the transfer list are moved to the
+ * receiving isolate and detached in the sending one; SharedArrayBuffers
+ * are shared by both.
+ *
+ * All methods must be called on the thread running the isolate.
+ * Workers that have ended are released by RunUntilIdle, as are idle
+ * workers the scripts can no longer reach.  Destroying the host
+ * terminates its workers and waits for them.
+ */
+class WorkerHost {
+ public:
+  WorkerHost(v8::Isolate* isolate, const WorkerConfig& config);
+  ~WorkerHost();
+  WorkerHost(const WorkerHost&) = delete;
+  WorkerHost& operator=(const WorkerHost&) = delete;
+
+  // Adds the Worker constructor to a global object template.
+  void Install(v8::Local<v8::ObjectTemplate> global);
+
+  // Runs foreground tasks until no worker is busy and all messages from
+  // workers have been handled.  A worker waiting for messages with
+  // nothing in its queue is not busy.
+  void RunUntilIdle();
+
+  bool busy() const;
+
+ private:
+  friend class Worker;
+
+  static void ConstructWorker(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void PostMessage(const v8::FunctionCallbackInfo<v8::Value>& args);
+  static void Terminate(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+  // Hands a message from a worker to its onmessage function.
+  void Deliver(Worker* worker, WorkerMessage* message);
+  // Releases the workers that are done and holds the wrappers of the
+  // others weakly while they are idle, so workers do not pile up.
+  void CollectWorkers();
+  // Makes RunUntilIdle look at the workers again.
+  void Wake();
+
+  v8::Isolate* isolate_;
+  WorkerConfig config_;
+  std::shared_ptr<v8::TaskRunner> task_runner_;
+  // Guards the counts below and the queues and states of the workers.
+  mutable std::mutex mutex_;
+  int busy_workers_;
+  // Messages posted by workers that have not been delivered yet.
+  int undelivered_;
+  std::vector<std::shared_ptr<Worker>> workers_;
+};
+
+#endif  // WORKER_H_